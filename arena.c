@@ -0,0 +1,134 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	arena.c
+ *	Descrioption:	arena allocator for board states and other bulk data
+ *
+ *	Memory is taken from the system in slabs of 2 MB, each one huge page
+ *	if the system has huge pages reserved, or otherwise 2 MB aligned and
+ *	advised for transparent huge pages.  Blocks are cut from the newest
+ *	slab by bumping a pointer and are never freed one by one; instead the
+ *	whole arena is reset, which moves its list of slabs to the spare list
+ *	in O(1) for reuse by the next generation.  Only blocks larger than a
+ *	slab are mapped by themselves and unmapped at a reset.
+ */
+
+#include "arena.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#define SLAB_HEADER ARENA_ALIGN
+
+struct arena_slab {
+    ArenaSlab *next;
+    size_t size; /* bytes mapped */
+};
+
+static atomic_int no_hugetlb; /* MAP_HUGETLB has failed once */
+
+static ArenaSlab *map_slab(size_t);
+
+/*=============================================================================
+ *   Allocation
+ *===========================================================================*/
+void *arena_alloc(Arena *a, size_t size) {
+    ArenaSlab *slab;
+    char *p;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size > ARENA_SLAB_SIZE - SLAB_HEADER) {
+        slab = map_slab((size + SLAB_HEADER + ARENA_SLAB_SIZE - 1) &
+                        ~(ARENA_SLAB_SIZE - 1));
+        if (slab == NULL) return NULL;
+        slab->next = a->large;
+        a->large = slab;
+        return (char *)slab + SLAB_HEADER;
+    }
+
+    if (a->p == NULL || (size_t)(a->end - a->p) < size) {
+        if (a->spare != NULL) {
+            slab = a->spare;
+            a->spare = slab->next;
+        } else if ((slab = map_slab(ARENA_SLAB_SIZE)) == NULL) {
+            return NULL;
+        }
+        slab->next = a->slabs;
+        a->slabs = slab;
+        if (a->last == NULL) a->last = slab;
+        a->p = (char *)slab + SLAB_HEADER;
+        a->end = (char *)slab + ARENA_SLAB_SIZE;
+    }
+    p = a->p;
+    a->p += size;
+    return p;
+}
+
+/*
+ *   Free every block of the arena at once
+ */
+void arena_reset(Arena *a) {
+    ArenaSlab *slab;
+
+    if (a->slabs != NULL) {
+        a->last->next = a->spare;
+        a->spare = a->slabs;
+        a->slabs = a->last = NULL;
+    }
+    a->p = a->end = NULL;
+    while ((slab = a->large) != NULL) {
+        a->large = slab->next;
+        munmap(slab, slab->size);
+    }
+}
+
+/*
+ *   Return all the memory of the arena to the system
+ */
+void arena_destroy(Arena *a) {
+    ArenaSlab *slab;
+
+    arena_reset(a);
+    while ((slab = a->spare) != NULL) {
+        a->spare = slab->next;
+        munmap(slab, slab->size);
+    }
+}
+
+/*=============================================================================
+ *   Slabs
+ *===========================================================================*/
+/*
+ *   size is a multiple of ARENA_SLAB_SIZE
+ */
+static ArenaSlab *map_slab(size_t size) {
+    const int PROT = PROT_READ | PROT_WRITE;
+    const int FLAGS = MAP_PRIVATE | MAP_ANONYMOUS;
+    ArenaSlab *slab;
+    char *p = MAP_FAILED;
+    uintptr_t head;
+
+#ifdef MAP_HUGETLB
+    if (!atomic_load_explicit(&no_hugetlb, memory_order_relaxed)) {
+        p = mmap(NULL, size, PROT, FLAGS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) atomic_store(&no_hugetlb, 1);
+    }
+#endif
+    if (p == MAP_FAILED) {
+        /* map one slab more and trim it to a 2 MB boundary */
+        p = mmap(NULL, size + ARENA_SLAB_SIZE, PROT, FLAGS, -1, 0);
+        if (p == MAP_FAILED) return NULL;
+        head = -(uintptr_t)p & (ARENA_SLAB_SIZE - 1);
+        if (head) munmap(p, head);
+        munmap(p + head + size, ARENA_SLAB_SIZE - head);
+        p += head;
+#ifdef MADV_HUGEPAGE
+        madvise(p, size, MADV_HUGEPAGE);
+#endif
+    }
+    slab = (ArenaSlab *)p;
+    slab->size = size;
+    return slab;
+}
@@ -0,0 +1,41 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	arena.h
+ *	Descrioption:	arena allocator for board states and other bulk data
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*=============================================================================
+ *   Arena (one generation of allocations)
+ *===========================================================================*/
+#define ARENA_SLAB_SIZE (2UL << 20) /* a huge page */
+#define ARENA_ALIGN 64              /* every block starts on a cache line */
+
+typedef struct arena_slab ArenaSlab;
+
+/*
+ *   An arena is not locked: give each thread its own arena, or guard a
+ *   shared one with a lock of the user.
+ */
+typedef struct arena {
+    ArenaSlab *slabs; /* in use, the newest first */
+    ArenaSlab *last;  /* the oldest in use */
+    ArenaSlab *spare; /* freed and kept for reuse */
+    ArenaSlab *large; /* blocks larger than a slab, mapped by themselves */
+    char *p;          /* free space of the newest slab */
+    char *end;
+} Arena;
+
+#define ARENA_INIT {NULL, NULL, NULL, NULL, NULL, NULL}
+
+void *arena_alloc(Arena *, size_t);
+void arena_reset(Arena *);
+void arena_destroy(Arena *);
+
+#endif /* ARENA_H */
@@ -0,0 +1,490 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	asm.c
+ *	Descrioption:	assembler of the board mnemonics
+ *
+ *	Source syntax (one statement per line, ';' or '#' starts a comment):
+ *	    label:  LD   ACC,0x10        ; B: ACC IX n [n] (n) [IX+n] (IX+n)
+ *	            BNZ  label
+ *	    .text [addr]                 ; addr is hex, as in read_mem_file
+ *	    .data [addr]
+ *	    table:  .byte 1,2,0x30,40H
+ *	Numbers are decimal, 0x-prefixed hex or H-suffixed hex.
+ */
+
+#include "asm.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ASM_LABEL_SIZE 32
+#define ASM_LABEL_SLOTS 1024 /* power of 2 */
+#define ASM_FIXUP_MAX MEMORY_SIZE
+
+enum Mnemonic_kind {
+    K_NONE, /* no operand */
+    K_A,    /* operand A */
+    K_AB,   /* operand A, operand B */
+    K_ST,   /* operand A, memory operand B */
+    K_ADDR  /* address */
+};
+
+typedef struct mnemonic {
+    const char *name;
+    Uword kind;
+    Uword code;
+} Mnemonic;
+
+static const Mnemonic MNEMONICS[] = {
+    {"NOP", K_NONE, NOP}, {"HLT", K_NONE, HLT},  {"OUT", K_NONE, OUT},
+    {"IN", K_NONE, IN},   {"RCF", K_NONE, RCF},  {"SCF", K_NONE, SCF},
+    {"JR", K_NONE, JR},   {"JAL", K_ADDR, JAL},  {"LD", K_AB, LD},
+    {"ST", K_ST, ST},     {"ADD", K_AB, ADD},    {"ADC", K_AB, ADC},
+    {"SUB", K_AB, SUB},   {"SBC", K_AB, SBC},    {"CMP", K_AB, CMP},
+    {"AND", K_AB, AND},   {"OR", K_AB, OR},      {"EOR", K_AB, EOR},
+    {"SRA", K_A, SRSM | 0}, {"SLA", K_A, SRSM | 1}, {"SRL", K_A, SRSM | 2},
+    {"SLL", K_A, SRSM | 3}, {"RRA", K_A, SRSM | 4}, {"RLA", K_A, SRSM | 5},
+    {"RRL", K_A, SRSM | 6}, {"RLL", K_A, SRSM | 7}, {"BA", K_ADDR, BBC | 0x0},
+    {"BNZ", K_ADDR, BBC | 0x1}, {"BZP", K_ADDR, BBC | 0x2},
+    {"BP", K_ADDR, BBC | 0x3},  {"BNI", K_ADDR, BBC | 0x4},
+    {"BNC", K_ADDR, BBC | 0x5}, {"BGE", K_ADDR, BBC | 0x6},
+    {"BGT", K_ADDR, BBC | 0x7}, {"BVF", K_ADDR, BBC | 0x8},
+    {"BZ", K_ADDR, BBC | 0x9},  {"BN", K_ADDR, BBC | 0xa},
+    {"BZN", K_ADDR, BBC | 0xb}, {"BNO", K_ADDR, BBC | 0xc},
+    {"BC", K_ADDR, BBC | 0xd},  {"BLT", K_ADDR, BBC | 0xe},
+    {"BLE", K_ADDR, BBC | 0xf}, {"BNK", K_A, BNK}};
+
+#define N_MNEMONICS (int)(sizeof(MNEMONICS) / sizeof(MNEMONICS[0]))
+
+typedef struct asm_label {
+    char name[ASM_LABEL_SIZE];
+    Uword defined;
+    Uword value;
+} AsmLabel;
+
+typedef struct asm_fixup {
+    Addr addr; /* memory location of the second word */
+    int label; /* slot in the label table */
+    int line;
+} AsmFixup;
+
+typedef struct asm_state {
+    Cpub *cpub;
+    const char *p;   /* current position */
+    const char *end; /* end of the source */
+    int line;
+    Addr area;       /* 0x000:.text, 0x100:.data */
+    unsigned int loc[2]; /* location counters of .text and .data */
+    AsmLabel label[ASM_LABEL_SLOTS];
+    AsmFixup fixup[ASM_FIXUP_MAX];
+    int n_fixup;
+} AsmState;
+
+static int asm_line(AsmState *);
+static int asm_directive(AsmState *, const char *, int);
+static int asm_instruction(AsmState *, const Mnemonic *);
+static int asm_operand_a(AsmState *, Uword *);
+static int asm_operand_b(AsmState *, Uword *, Uword *, int *);
+static int asm_value(AsmState *, Uword *, int *);
+static int asm_emit(AsmState *, Uword);
+static int asm_fixup(AsmState *, int);
+static int asm_label_slot(AsmState *, const char *, int);
+static int asm_ident(AsmState *, const char **);
+static void asm_skip_space(AsmState *);
+static int asm_expect(AsmState *, char);
+static int asm_at_eol(AsmState *);
+static int asm_error(AsmState *, const char *);
+
+/*=============================================================================
+ *   Assemble a Source Text into the Main Memory
+ *===========================================================================*/
+/*
+ *   Forward references are resolved by a fixup list after a single pass,
+ *   so the source is scanned only once.  Returns 0, or -1 on an error.
+ */
+int assemble(Cpub *cpub, const char *src, int len) {
+    AsmState *st; /* too large for the stack, and one per call */
+    int i, status = -1;
+
+    if ((st = calloc(1, sizeof(AsmState))) == NULL) {
+        fprintf(stderr, "Unable to allocate memory for the assembler\n");
+        return -1;
+    }
+    st->cpub = cpub;
+    st->p = src;
+    st->end = src + len;
+    st->line = 1;
+    st->area = 0x000;
+
+    while (st->p < st->end) {
+        if (asm_line(st) < 0) goto out;
+    }
+
+    for (i = 0; i < st->n_fixup; i++) {
+        AsmLabel *l = &st->label[st->fixup[i].label];
+        if (!l->defined) {
+            fprintf(stderr, "line %d: Undefined label: %s\n",
+                    st->fixup[i].line, l->name);
+            goto out;
+        }
+        cpub->mem[st->fixup[i].addr] = l->value;
+    }
+    status = 0;
+
+out:
+    free(st);
+    return status;
+}
+
+int assemble_file(Cpub *cpub, char *file) {
+    FILE *fp;
+    char *src;
+    long len;
+    int status;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+        fprintf(stderr, "Unable to open %s\n", file);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (len < 0 || (src = malloc(len + 1)) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    len = fread(src, 1, len, fp);
+    fclose(fp);
+
+    status = assemble(cpub, src, (int)len);
+    free(src);
+    return status;
+}
+
+/*=============================================================================
+ *   Statements
+ *===========================================================================*/
+static int asm_line(AsmState *st) {
+    const char *name;
+    int len, i;
+
+    asm_skip_space(st);
+    if (!asm_at_eol(st)) {
+        len = asm_ident(st, &name);
+        if (len == 0) return asm_error(st, "Syntax error");
+
+        if (st->p < st->end && *st->p == ':') { /* label */
+            int slot = asm_label_slot(st, name, len);
+            if (slot < 0) return -1;
+            if (st->label[slot].defined)
+                return asm_error(st, "Duplicate label");
+            st->label[slot].defined = 1;
+            st->label[slot].value = st->loc[st->area >> 8] & 0xff;
+            st->p++;
+            asm_skip_space(st);
+            len = asm_at_eol(st) ? 0 : asm_ident(st, &name);
+        }
+
+        if (len > 0) {
+            if (name[0] == '.') {
+                if (asm_directive(st, name + 1, len - 1) < 0) return -1;
+            } else {
+                for (i = 0; i < N_MNEMONICS; i++) {
+                    if (strncasecmp(MNEMONICS[i].name, name, len) == 0 &&
+                        MNEMONICS[i].name[len] == '\0')
+                        break;
+                }
+                if (i == N_MNEMONICS) return asm_error(st, "Unknown mnemonic");
+                if (asm_instruction(st, &MNEMONICS[i]) < 0) return -1;
+            }
+        }
+        if (!asm_at_eol(st)) return asm_error(st, "Extra operand");
+    }
+
+    /* skip the rest of the line (comment) */
+    while (st->p < st->end && *st->p != '\n') st->p++;
+    if (st->p < st->end) st->p++;
+    st->line++;
+    return 0;
+}
+
+static int asm_directive(AsmState *st, const char *name, int len) {
+    Uword value;
+    int label;
+
+    if (len == 4 && (!strncmp(name, "text", 4) || !strncmp(name, "data", 4))) {
+        st->area = (name[0] == 't') ? 0x000 : 0x100;
+        asm_skip_space(st);
+        if (!asm_at_eol(st)) { /* hex address, as in read_mem_file */
+            char *next;
+            unsigned long addr = strtoul(st->p, &next, 16);
+            if (next == st->p || addr > 0xff)
+                return asm_error(st, "Invalid address");
+            st->p = next;
+            st->loc[st->area >> 8] = addr;
+        }
+        return 0;
+    }
+
+    if (len == 4 && !strncmp(name, "byte", 4)) {
+        while (1) {
+            if (asm_value(st, &value, &label) < 0) return -1;
+            if (label >= 0 && asm_fixup(st, label) < 0) return -1;
+            if (asm_emit(st, value) < 0) return -1;
+            asm_skip_space(st);
+            if (st->p >= st->end || *st->p != ',') break;
+            st->p++;
+        }
+        return 0;
+    }
+
+    return asm_error(st, "Unknown directive");
+}
+
+static int asm_instruction(AsmState *st, const Mnemonic *m) {
+    Uword code = m->code, opa = ACC, opb = ACC, second_word = 0;
+    int label = -1, length = 1;
+
+    switch (m->kind) {
+        case K_NONE:
+            break;
+        case K_A:
+            if (asm_operand_a(st, &opa) < 0) return -1;
+            code |= opa;
+            break;
+        case K_AB:
+        case K_ST:
+            if (asm_operand_a(st, &opa) < 0) return -1;
+            if (asm_expect(st, ',') < 0) return -1;
+            if (asm_operand_b(st, &opb, &second_word, &label) < 0) return -1;
+            if (m->kind == K_ST && (opb == ACC || opb == IX ||
+                                    opb == IMMEDIATE_ADDRESS))
+                return asm_error(st, "ST needs a memory operand");
+            code |= opa | opb;
+            length = (opb == ACC || opb == IX) ? 1 : 2;
+            break;
+        case K_ADDR:
+            if (asm_value(st, &second_word, &label) < 0) return -1;
+            length = 2;
+            break;
+    }
+
+    if (asm_emit(st, code) < 0) return -1;
+    if (length == 2) {
+        if (label >= 0 && asm_fixup(st, label) < 0) return -1;
+        if (asm_emit(st, second_word) < 0) return -1;
+    }
+    return 0;
+}
+
+/*=============================================================================
+ *   Operands
+ *===========================================================================*/
+static int asm_operand_a(AsmState *st, Uword *opa) {
+    const char *name;
+    int len;
+
+    asm_skip_space(st);
+    len = asm_ident(st, &name);
+    if (len == 3 && !strncasecmp(name, "ACC", 3)) {
+        *opa = 0x00;
+    } else if (len == 2 && !strncasecmp(name, "IX", 2)) {
+        *opa = 0x08;
+    } else {
+        return asm_error(st, "Operand A must be ACC or IX");
+    }
+    return 0;
+}
+
+static int asm_operand_b(AsmState *st, Uword *opb, Uword *second_word,
+                         int *label) {
+    char close;
+    Uword program_area;
+
+    asm_skip_space(st);
+    if (st->p < st->end && (*st->p == '[' || *st->p == '(')) {
+        program_area = (*st->p == '[');
+        close = program_area ? ']' : ')';
+        st->p++;
+        asm_skip_space(st);
+        if (st->end - st->p >= 2 && !strncasecmp(st->p, "IX", 2) &&
+            (st->end - st->p == 2 || !(isalnum((unsigned char)st->p[2]) ||
+                                       st->p[2] == '_'))) {
+            st->p += 2;
+            if (asm_expect(st, '+') < 0) return -1;
+            *opb = program_area ? IX_MODIFICATION_PROGRAM_ADDRESS
+                                : IX_MODIFICATION_DATA_ADDRESS;
+        } else {
+            *opb = program_area ? ABSOLUTE_PROGRAM_ADDRESS
+                                : ABSOLUTE_DATA_ADDRESS;
+        }
+        if (asm_value(st, second_word, label) < 0) return -1;
+        return asm_expect(st, close);
+    }
+
+    if (st->p < st->end && isalpha((unsigned char)*st->p)) {
+        const char *save = st->p;
+        const char *name;
+        int len = asm_ident(st, &name);
+        if (len == 3 && !strncasecmp(name, "ACC", 3)) {
+            *opb = ACC;
+            return 0;
+        } else if (len == 2 && !strncasecmp(name, "IX", 2)) {
+            *opb = IX;
+            return 0;
+        }
+        st->p = save; /* an immediate label */
+    }
+
+    *opb = IMMEDIATE_ADDRESS;
+    return asm_value(st, second_word, label);
+}
+
+/*
+ *   A number, or a label whose slot is returned in *label (-1 otherwise)
+ */
+static int asm_value(AsmState *st, Uword *value, int *label) {
+    const char *p, *q, *name;
+    unsigned long v = 0;
+    int len, digit;
+
+    *label = -1;
+    *value = 0;
+    asm_skip_space(st);
+    if (st->p >= st->end) return asm_error(st, "Missing operand");
+
+    if (!isdigit((unsigned char)*st->p)) {
+        len = asm_ident(st, &name);
+        if (len == 0 || name[0] == '.') return asm_error(st, "Bad operand");
+        *label = asm_label_slot(st, name, len);
+        if (*label < 0) return -1;
+        return 0;
+    }
+
+    /* find the end of the number to check for the H suffix */
+    for (q = st->p; q < st->end && isalnum((unsigned char)*q); q++)
+        ;
+    p = st->p;
+    if (q - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        for (p += 2; p < q; p++) {
+            if (!isxdigit((unsigned char)*p)) break;
+            digit = isdigit((unsigned char)*p) ? *p - '0'
+                                               : (tolower(*p) - 'a' + 10);
+            v = v * 16 + digit;
+            if (v > 0xff) break;
+        }
+    } else if (q[-1] == 'h' || q[-1] == 'H') {
+        for (; p < q - 1; p++) {
+            if (!isxdigit((unsigned char)*p)) break;
+            digit = isdigit((unsigned char)*p) ? *p - '0'
+                                               : (tolower(*p) - 'a' + 10);
+            v = v * 16 + digit;
+            if (v > 0xff) break;
+        }
+        if (p == q - 1) p = q;
+    } else {
+        for (; p < q; p++) {
+            if (!isdigit((unsigned char)*p)) break;
+            v = v * 10 + (*p - '0');
+            if (v > 0xff) break;
+        }
+    }
+    if (p != q || v > 0xff) return asm_error(st, "Invalid value");
+
+    st->p = q;
+    *value = v;
+    return 0;
+}
+
+/*=============================================================================
+ *   Helpers
+ *===========================================================================*/
+static int asm_emit(AsmState *st, Uword word) {
+    unsigned int *loc = &st->loc[st->area >> 8];
+
+    if (*loc > 0xff)
+        return asm_error(st, st->area ? "Data area overflow"
+                                      : "Program area overflow");
+    st->cpub->mem[st->area | *loc] = word;
+    (*loc)++;
+    return 0;
+}
+
+/*
+ *   Record that the next word emitted is the value of a label
+ */
+static int asm_fixup(AsmState *st, int label) {
+    AsmFixup *f;
+
+    if (st->n_fixup == ASM_FIXUP_MAX)
+        return asm_error(st, "Too many label references");
+    f = &st->fixup[st->n_fixup++];
+    f->addr = st->area | (st->loc[st->area >> 8] & 0xff);
+    f->label = label;
+    f->line = st->line;
+    return 0;
+}
+
+static int asm_label_slot(AsmState *st, const char *name, int len) {
+    unsigned int hash = 2166136261u;
+    int i, slot;
+
+    if (len >= ASM_LABEL_SIZE) return asm_error(st, "Too long label");
+
+    for (i = 0; i < len; i++) hash = (hash ^ (Uword)name[i]) * 16777619u;
+
+    for (i = 0; i < ASM_LABEL_SLOTS; i++) {
+        slot = (hash + i) & (ASM_LABEL_SLOTS - 1);
+        if (st->label[slot].name[0] == '\0') {
+            memcpy(st->label[slot].name, name, len);
+            st->label[slot].name[len] = '\0';
+            return slot;
+        }
+        if (strncmp(st->label[slot].name, name, len) == 0 &&
+            st->label[slot].name[len] == '\0')
+            return slot;
+    }
+    return asm_error(st, "Too many labels");
+}
+
+static int asm_ident(AsmState *st, const char **name) {
+    const char *p = st->p;
+
+    *name = p;
+    if (p < st->end && *p == '.') p++;
+    while (p < st->end && (isalnum((unsigned char)*p) || *p == '_')) p++;
+    st->p = p;
+    return p - *name;
+}
+
+static void asm_skip_space(AsmState *st) {
+    while (st->p < st->end && (*st->p == ' ' || *st->p == '\t' ||
+                               *st->p == '\r'))
+        st->p++;
+}
+
+static int asm_expect(AsmState *st, char c) {
+    asm_skip_space(st);
+    if (st->p >= st->end || *st->p != c) {
+        char msg[32];
+        snprintf(msg, sizeof(msg), "\'%c\' expected", c);
+        return asm_error(st, msg);
+    }
+    st->p++;
+    return 0;
+}
+
+static int asm_at_eol(AsmState *st) {
+    asm_skip_space(st);
+    return st->p >= st->end || *st->p == '\n' || *st->p == ';' ||
+           *st->p == '#';
+}
+
+static int asm_error(AsmState *st, const char *msg) {
+    fprintf(stderr, "line %d: %s\n", st->line, msg);
+    return -1;
+}
@@ -0,0 +1,20 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	asm.h
+ *	Descrioption:	assembler of the board mnemonics
+ */
+
+#ifndef ASM_H
+#define ASM_H
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Assembler
+ *===========================================================================*/
+int assemble(Cpub *, const char *, int);
+int assemble_file(Cpub *, char *);
+
+#endif /* ASM_H */
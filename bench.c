@@ -0,0 +1,159 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	bench.c
+ *	Descrioption:	benchmark of Cpub against PackedCpub
+ *
+ *	Usage:	bench [-b boards] [-n steps] [-s slice] [image-file]
+ *
+ *	Every board runs the same program on its own data area.  The boards are
+ *	stepped round robin, slice instructions at a time, so that with enough
+ *	boards the states do not stay in the caches, as in a large exploration.
+ *	At the end the packed states are unpacked and compared with the Cpubs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "asm.h"
+#include "cpuboard.h"
+#include "image.h"
+#include "packed.h"
+
+#define CACHE_LINE 64
+
+/* checksum over the data area, forever */
+static const char WORKLOAD[] =
+    "        LD   IX,0\n"
+    "loop:   LD   ACC,(IX+0)\n"
+    "        ADC  ACC,(0xff)\n"
+    "        RLL  ACC\n"
+    "        EOR  ACC,IX\n"
+    "        ST   ACC,(IX+0)\n"
+    "        SUB  IX,1\n"
+    "        BNZ  loop\n"
+    "        LD   ACC,(0)\n"
+    "        OUT\n"
+    "        BA   loop\n";
+
+static double elapsed(const struct timespec *);
+static long lines_of(long, long);
+
+int main(int argc, char *argv[]) {
+    static Cpub init;
+    IOBuf ibuf = {0, 0};
+    long n_boards = 65536, steps = 1024, slice = 16, done, i, j;
+    Cpub *cpubs;
+    IOBuf *ibufs;
+    PackedCpub *packs;
+    struct timespec t0;
+    double t_cpub, t_packed;
+    int opt, n_diff = 0;
+
+    while ((opt = getopt(argc, argv, "b:n:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                n_boards = atol(optarg);
+                break;
+            case 'n':
+                steps = atol(optarg);
+                break;
+            case 's':
+                slice = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b boards] [-n steps] [-s slice] "
+                                "[image-file]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (n_boards < 1 || steps < 1 || slice < 1) {
+        fprintf(stderr, "Invalid value (out of range)\n");
+        return 1;
+    }
+
+    init.ibuf = &ibuf;
+    if (optind < argc) {
+        read_mem_file(&init, argv[optind]);
+    } else if (assemble(&init, WORKLOAD, sizeof(WORKLOAD) - 1) < 0) {
+        return 1;
+    }
+
+    cpubs = malloc(n_boards * sizeof(Cpub));
+    ibufs = malloc(n_boards * sizeof(IOBuf));
+    packs = aligned_alloc(CACHE_LINE, n_boards * sizeof(PackedCpub));
+    if (cpubs == NULL || ibufs == NULL || packs == NULL) {
+        fprintf(stderr, "Not enough memory for %ld boards\n", n_boards);
+        return 1;
+    }
+    for (i = 0; i < n_boards; i++) {
+        cpubs[i] = init;
+        ibufs[i] = ibuf;
+        cpubs[i].ibuf = &ibufs[i];
+        for (j = 0; j < IMEMORY_SIZE; j++)
+            cpubs[i].mem[0x100 + j] ^= (Uword)(i * 31 + j);
+        pack_cpub(&packs[i], &cpubs[i]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (j = 0; j < steps; j += slice) {
+        for (i = 0; i < n_boards; i++) step_n(&cpubs[i], slice, &done);
+    }
+    t_cpub = elapsed(&t0);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (j = 0; j < steps; j += slice) {
+        for (i = 0; i < n_boards; i++) packed_step_n(&packs[i], slice, &done);
+    }
+    t_packed = elapsed(&t0);
+
+    for (i = 0; i < n_boards; i++) {
+        Cpub c;
+        IOBuf b;
+
+        c.ibuf = &b;
+        unpack_cpub(&c, &packs[i]);
+        if (c.pc != cpubs[i].pc || c.acc != cpubs[i].acc ||
+            c.ix != cpubs[i].ix || c.cf != (cpubs[i].cf != 0) ||
+            c.vf != cpubs[i].vf || c.nf != cpubs[i].nf ||
+            c.zf != cpubs[i].zf || c.obuf.buf != cpubs[i].obuf.buf ||
+            memcmp(c.mem, cpubs[i].mem, MEMORY_SIZE)) {
+            n_diff++;
+        }
+    }
+
+    steps = (steps + slice - 1) / slice * slice;
+    printf("%ld boards x %ld steps (slice %ld)\n", n_boards, steps, slice);
+    printf("\t%-12s%6s%8s%12s%14s\n", "", "bytes", "lines", "registers",
+           "Msteps/sec");
+    printf("\t%-12s%6zu%8ld%12s%14.1f\n", "Cpub", sizeof(Cpub) + sizeof(IOBuf),
+           lines_of((long)sizeof(Cpub), 16) + 1, "2 lines",
+           n_boards * steps / t_cpub / 1e6);
+    printf("\t%-12s%6zu%8ld%12s%14.1f\n", "PackedCpub", sizeof(PackedCpub),
+           lines_of((long)sizeof(PackedCpub), CACHE_LINE), "1 line",
+           n_boards * steps / t_packed / 1e6);
+    printf("\tresults: %s\n", n_diff ? "DIFFERENT" : "same");
+
+    free(cpubs);
+    free(ibufs);
+    free(packs);
+    return n_diff ? 2 : 0;
+}
+
+static double elapsed(const struct timespec *t0) {
+    struct timespec t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/*
+ *   Cache lines spanned by an object of size bytes at the worst alignment
+ */
+static long lines_of(long size, long align) {
+    return (size + (CACHE_LINE - align) + CACHE_LINE - 1) / CACHE_LINE;
+}
@@ -0,0 +1,274 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	cpubgen.c
+ *	Descrioption:	compiler of a fixed program image into C
+ *
+ *	Usage:	cpubgen image-file > program.c
+ *		cpubgen source.s > program.c	(assembled first)
+ *
+ *	Every program address becomes a label, and each instruction is compiled
+ *	with its operands as constants, so the program runs as straight-line C
+ *	connected by gotos.  JR and the entry go through a switch on the PC.
+ *	A store that changes a word of the program area leaves the compiled
+ *	code and the rest of the run is done by step() (run_script()).
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "asm.h"
+#include "cpuboard.h"
+#include "disasm.h"
+#include "image.h"
+
+static void gen_instruction(Cpub *, int);
+static const char *gen_operand_b(Uword, Uword, char *);
+static const char *gen_condition(Uword);
+
+int main(int argc, char *argv[]) {
+    static Cpub cpub;
+    IOBuf ibuf = {0, 0};
+    int addr, has_jr = 0;
+    size_t len;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s image-file|source.s\n", argv[0]);
+        return 1;
+    }
+    cpub.ibuf = &ibuf;
+    len = strlen(argv[1]);
+    if (len > 2 && !strcmp(argv[1] + len - 2, ".s")) {
+        if (assemble_file(&cpub, argv[1]) < 0) return 1;
+    } else {
+        read_mem_file(&cpub, argv[1]);
+    }
+    init_disasm();
+
+    printf("/* generated by cpubgen from %s */\n\n", argv[1]);
+    printf("#include <stdio.h>\n#include <string.h>\n\n"
+           "#include \"cpubgen.h\"\n\n");
+
+    printf("const Uword gen_image[MEMORY_SIZE] = {");
+    for (addr = 0; addr < MEMORY_SIZE; addr++)
+        printf("%s0x%02x,", addr % 16 ? " " : "\n    ", cpub.mem[addr]);
+    printf("\n};\n\n");
+
+    printf("#define STEP(A) \\\n"
+           "    if (++n > max_steps) { c->pc = (A); goto limit; }\n"
+           "#define FEED() \\\n"
+           "    if (!c->ibuf->flag && rs->in_pos < rs->n_in) { \\\n"
+           "        c->ibuf->buf = rs->in[rs->in_pos++]; \\\n"
+           "        c->ibuf->flag = 1; \\\n"
+           "    }\n"
+           "#define OUTPUT(A) \\\n"
+           "    if (rs->n_out < rs->max_out) rs->out[rs->n_out] = c->obuf.buf; \\\n"
+           "    c->obuf.flag = 0; \\\n"
+           "    if (++rs->n_out == rs->stop_out) { \\\n"
+           "        c->pc = (A); status = SCRIPT_OUTPUT; goto out; \\\n"
+           "    }\n"
+           "#define SELF_MODIFY(EA, A) \\\n"
+           "    if (c->mem[EA] != gen_image[EA]) { c->pc = (A); goto interp; }\n"
+           "\n");
+
+    printf("int gen_run(Cpub *c, RunScript *rs, long max_steps) {\n"
+           "    long n = rs->steps;\n"
+           "    int status;\n\n"
+           "    if (memcmp(c->mem, gen_image, IMEMORY_SIZE)) goto interp;\n"
+           "    FEED();\n");
+    for (addr = 0; addr < IMEMORY_SIZE; addr++) has_jr |= cpub.mem[addr] == JR;
+    printf("%s    switch (c->pc) {\n", has_jr ? "dispatch:\n" : "");
+    for (addr = 0; addr < IMEMORY_SIZE; addr++)
+        printf("        case 0x%02x: goto L_%02x;\n", addr, addr);
+    printf("    }\n\n");
+
+    for (addr = 0; addr < IMEMORY_SIZE; addr++) gen_instruction(&cpub, addr);
+
+    printf("limit:\n"
+           "    status = SCRIPT_LIMIT;\n"
+           "    n = max_steps;\n"
+           "    goto out;\n"
+           "interp:\n"
+           "    rs->steps = n;\n"
+           "    return run_script(c, rs, max_steps);\n"
+           "out:\n"
+           "    rs->steps = n;\n"
+           "    return status;\n"
+           "}\n");
+    return 0;
+}
+
+/*=============================================================================
+ *   Compile an Instruction
+ *===========================================================================*/
+static void gen_instruction(Cpub *cpub, int addr) {
+    static const char *const REG[] = {"acc", "", "", "", "", "", "", "",
+                                      "ix"};
+    const Uword IR = cpub->mem[addr];
+    const Uword SW = cpub->mem[(addr + 1) & 0xff];
+    const Decoded *d = &decode_table[IR];
+    const int NEXT = (addr + d->length) & 0xff;
+    const char *text, *a = REG[d->opa];
+    char b[40];
+
+    disasm(cpub, addr, &text);
+    printf("L_%02x: /* %s */\n    STEP(0x%02x);\n", addr, text, addr);
+
+    switch (d->format) {
+        case FMT_UNKNOWN:
+            printf("    c->pc = 0x%02x;\n"
+                   "    fprintf(stderr, \"%%#x is unknown or not implemented "
+                   "instruction code.\\n\", 0x%02x);\n"
+                   "    status = SCRIPT_HALT;\n    goto out;\n",
+                   (addr + 1) & 0xff, IR);
+            return;
+        case FMT_A:
+            if ((IR & 0xf0) == BNK) { /* left to step() */
+                printf("    n--;\n    c->pc = 0x%02x;\n    goto interp;\n", addr);
+                return;
+            }
+            printf("    c->%s = gen_shift(c, %d, c->%s);\n", a, IR & 0x07, a);
+            break;
+        case FMT_ADDR:
+            if (IR == JAL) {
+                printf("    c->acc = 0x%02x;\n    goto L_%02x;\n", NEXT, SW);
+                return;
+            }
+            if ((IR & 0x0f) == 0x0) { /* BA */
+                printf("    goto L_%02x;\n", SW);
+                return;
+            }
+            if ((IR & 0x0f) == 0xd) /* BC: as step_BBC does */
+                printf("    if (c->cf) c->cf = 0x%02x;\n", SW);
+            else
+                printf("    if (%s) goto L_%02x;\n", gen_condition(IR & 0x0f),
+                       SW);
+            break;
+        case FMT_NONE:
+            if ((IR & 0xf8) == NOP) {
+                break;
+            } else if (((IR & 0xfc) | 0x03) == HLT) {
+                printf("    c->pc = 0x%02x;\n    status = SCRIPT_HALT;\n"
+                       "    goto out;\n", NEXT);
+                return;
+            } else if (IR == JR) {
+                printf("    c->pc = c->acc;\n    goto dispatch;\n");
+                return;
+            } else if ((IR & 0xf8) == OUT) {
+                printf("    c->obuf.buf = c->acc;\n    c->obuf.flag = 1;\n"
+                       "    OUTPUT(0x%02x);\n", NEXT);
+            } else if ((IR & 0xf0) == 0x10) { /* IN */
+                printf("    c->acc = c->ibuf->buf;\n    c->ibuf->flag = 0;\n"
+                       "    FEED();\n");
+            } else {
+                printf("    c->cf = %d;\n", (IR & 0xf8) == RCF ? 0 : 1);
+            }
+            break;
+        case FMT_AB:
+            gen_operand_b(d->opb, SW, b);
+            switch (IR & 0xf0) {
+                case LD:
+                    printf("    c->%s = %s;\n", a, b);
+                    break;
+                case ST:
+                    if (d->opb < ABSOLUTE_PROGRAM_ADDRESS) {
+                        /* same messages as step_ST */
+                        printf("    c->pc = 0x%02x;\n"
+                               "    fprintf(stderr, \"%s\\n\");\n"
+                               "    status = SCRIPT_HALT;\n    goto out;\n",
+                               NEXT,
+                               d->opb == ACC ? "ACC is Undefined operating(ST)"
+                               : d->opb == IX
+                                   ? "IX is Undefined operating (ST)"
+                                   : "IMMEDIATE_ADDRESS is Undefined "
+                                     "operating in (ST)");
+                        return;
+                    }
+                    printf("    %s = c->%s;\n", b, a);
+                    if (d->opb == ABSOLUTE_PROGRAM_ADDRESS)
+                        printf("    SELF_MODIFY(0x%02x, 0x%02x);\n", SW, NEXT);
+                    else if (d->opb == IX_MODIFICATION_PROGRAM_ADDRESS)
+                        printf("    SELF_MODIFY((Uword)(c->ix + 0x%02x), "
+                               "0x%02x);\n", SW, NEXT);
+                    break;
+                case ADD:
+                    printf("    c->%s = gen_add(c, c->%s, %s);\n", a, a, b);
+                    break;
+                case ADC:
+                    printf("    c->%s = gen_adc(c, c->%s, %s);\n", a, a, b);
+                    break;
+                case SUB:
+                    printf("    c->%s = gen_sub(c, c->%s, %s);\n", a, a, b);
+                    break;
+                case SBC:
+                    printf("    c->%s = gen_sbc(c, c->%s, %s);\n", a, a, b);
+                    break;
+                case CMP:
+                    printf("    gen_sub(c, c->%s, %s);\n", a, b);
+                    break;
+                case AND:
+                    printf("    c->%s = gen_logic(c, c->%s & %s);\n", a, a, b);
+                    break;
+                case OR:
+                    printf("    c->%s = gen_logic(c, c->%s | %s);\n", a, a, b);
+                    break;
+                case EOR:
+                    printf("    c->%s = gen_logic(c, c->%s ^ %s);\n", a, a, b);
+                    break;
+            }
+            break;
+    }
+
+    if (NEXT != ((addr + 1) & 0xff) || addr == IMEMORY_SIZE - 1)
+        printf("    goto L_%02x;\n", NEXT);
+}
+
+static const char *gen_operand_b(Uword opb, Uword sw, char *buf) {
+    switch (opb) {
+        case ACC:
+            return strcpy(buf, "c->acc");
+        case IX:
+            return strcpy(buf, "c->ix");
+        case IMMEDIATE_ADDRESS:
+            sprintf(buf, "0x%02x", sw);
+            break;
+        case ABSOLUTE_PROGRAM_ADDRESS:
+            sprintf(buf, "c->mem[0x%03x]", sw);
+            break;
+        case ABSOLUTE_DATA_ADDRESS:
+            sprintf(buf, "c->mem[0x%03x]", 0x100 + sw);
+            break;
+        case IX_MODIFICATION_PROGRAM_ADDRESS:
+            sprintf(buf, "c->mem[(Uword)(c->ix + 0x%02x)]", sw);
+            break;
+        case IX_MODIFICATION_DATA_ADDRESS:
+            sprintf(buf, "c->mem[0x100 + (Uword)(c->ix + 0x%02x)]", sw);
+            break;
+    }
+    return buf;
+}
+
+/*
+ *   Branch conditions, as in step_BBC
+ */
+static const char *gen_condition(Uword code) {
+    static const char *const COND[16] = {
+        "1",
+        "!c->zf",
+        "!c->nf",
+        "!(c->nf | c->zf)",
+        "!c->ibuf->flag",
+        "!c->cf",
+        "!(c->vf ^ c->nf)",
+        "!((c->vf ^ c->nf) | c->zf)",
+        "c->vf",
+        "c->zf",
+        "c->nf",
+        "c->nf | c->zf",
+        "c->obuf.flag",
+        "c->cf",
+        "c->vf ^ c->nf",
+        "(c->vf ^ c->nf) | c->zf"};
+    return COND[code];
+}
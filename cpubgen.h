@@ -0,0 +1,95 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	cpubgen.h
+ *	Descrioption:	runtime of programs compiled by cpubgen
+ *
+ *	The helpers below compute exactly the results and flags of the step_*
+ *	functions in cpuboard.c, so a compiled program and step() agree.
+ */
+
+#ifndef CPUBGEN_H
+#define CPUBGEN_H
+
+#include "cpuboard.h"
+#include "run.h"
+
+/*=============================================================================
+ *   Entry of a Compiled Program
+ *===========================================================================*/
+extern const Uword gen_image[MEMORY_SIZE]; /* the image it was compiled from */
+int gen_run(Cpub *, RunScript *, long);
+
+/*=============================================================================
+ *   ALU
+ *===========================================================================*/
+static inline Bit gen_overflow(Uword a, Uword b, int ans) {
+    return ((a ^ ans) & (b ^ ans) & 0x80) != 0;
+}
+
+static inline void gen_nzflags(Cpub *c, int ans) {
+    c->cf = c->cf != 0; /* set_flag stores every flag as 0 or 1 */
+    c->nf = (ans >> 7) & 1;
+    c->zf = (ans & 0xff) == 0;
+}
+
+static inline Uword gen_add(Cpub *c, Uword a, Uword b) {
+    int sum = a + b;
+    /* ADD keeps CF, and a carry is an overflow */
+    c->vf = ((sum >> 8) & 1) | gen_overflow(a, b, sum);
+    gen_nzflags(c, sum);
+    return sum;
+}
+
+static inline Uword gen_adc(Cpub *c, Uword a, Uword b) {
+    int sum = a + b + c->cf;
+    c->cf = (sum >> 8) & 1;
+    c->vf = gen_overflow(a, b, sum);
+    gen_nzflags(c, sum);
+    return sum;
+}
+
+static inline Uword gen_sub(Cpub *c, Uword a, Uword b) {
+    Uword nb = ~b + 1;
+    int sum = a + nb;
+    c->vf = gen_overflow(a, nb, sum);
+    gen_nzflags(c, sum);
+    return sum;
+}
+
+static inline Uword gen_sbc(Cpub *c, Uword a, Uword b) {
+    Uword nb = ~b + 1;
+    int sum = a + nb - c->cf;
+    c->cf = !((sum >> 8) & 1);
+    c->vf = gen_overflow(a, nb, sum);
+    gen_nzflags(c, sum);
+    return sum;
+}
+
+static inline Uword gen_logic(Cpub *c, Uword ans) {
+    c->vf = 0;
+    gen_nzflags(c, ans);
+    return ans;
+}
+
+static inline Uword gen_shift(Cpub *c, int mode, Uword v) {
+    Uword ans, push;
+
+    if (mode & 1) { /* SLA SLL RLA RLL */
+        push = (mode == 5) ? (c->cf != 0) : (mode == 7) ? (v >> 7) : 0;
+        ans = ((v << 1) & 0xfe) | push;
+        c->cf = v >> 7;
+        c->vf = (mode == 1 || mode == 5) ? ((v ^ ans) >> 7) & 1 : 0;
+    } else { /* SRA SRL RRA RRL */
+        push = (mode == 0) ? (v >> 7) : (mode == 4) ? (c->cf != 0)
+                                      : (mode == 6) ? (v & 1) : 0;
+        ans = ((v >> 1) & 0x7f) | (push << 7);
+        c->cf = v & 1;
+        c->vf = 0;
+    }
+    gen_nzflags(c, ans);
+    return ans;
+}
+
+#endif /* CPUBGEN_H */
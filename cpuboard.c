@@ -8,91 +8,95 @@
 
 #include "cpuboard.h"
 
+#include <stdint.h>
 #include <stdio.h>
-
-enum Instruction_code {
-    NOP = 0x00,
-    HLT = 0x0f,
-    OUT = 0x10,
-    IN = 0x1f,
-    RCF = 0x20,
-    SCF = 0x2f,
-    LD = 0x60,
-    ST = 0x70,
-    ADD = 0xB0,
-    ADC = 0x90,
-    SUB = 0xa0,
-    SBC = 0x80,
-    CMP = 0xf0,
-    AND = 0xe0,
-    OR = 0xd0,
-    EOR = 0xC0,
-    SRSM = 0x40,
-    BBC = 0x30,
-    JAL = 0x0a,
-    JR = 0x0b
-};
-
-enum Operand_B_3bits {
-    ACC = 0x00,
-    IX = 0x01,
-    IMMEDIATE_ADDRESS = 0x02,
-    ABSOLUTE_PROGRAM_ADDRESS = 0x04,
-    ABSOLUTE_DATA_ADDRESS = 0x05,
-    IX_MODIFICATION_PROGRAM_ADDRESS = 0x06,
-    IX_MODIFICATION_DATA_ADDRESS = 0x07
-};
-
-void step_OUT();
-void step_IN();
-void step_RCF();
-void step_SCF();
-int step_ST();
-void step_LD();
-void step_ADD();
-void step_ADC();
-void step_SUB();
-void step_SBC();
-void step_CMP();
-void step_AND();
-void step_OR();
-void step_EOR();
-void step_SRSM();
-void R_Rotate(const Uword VALUE, const Uword PUSH_BIT, Uword *out, Bit *cf, Bit *vf);
-void L_Rotate(const Uword VALUE, const Uword PUSH_BIT, Uword *out, Bit *cf, Bit *vf);
-void step_BBC();
-void step_JAL();
-void step_JR();
-void set_flag(Bit cf, Bit vf, Bit nf, Bit zf);
-Bit chk_carry_flag(int ans);
-Bit chk_overflow_flag(Uword num1, Uword num2, int ans);
-Bit chk_negative_flag(int ans);
-Bit chk_zero_flag(char ans);
-Uword decrypt_operand_a(const Uword code);
-Uword decrypt_operand_b(const Uword code);
-Uword get_operand_b_value(const Uword OPERAND_B);
-Uword get_operand_a_value(const Uword OPERAND_A);
-void store_value_to_register(const Uword OPERAND_A, const Uword value);
-void unknown_instruction_code(const Uword code);
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+
+/* operations of alu() */
+#define ALU_ADD 0
+#define ALU_ADC 1
+#define ALU_SUB 2 /* CMP too */
+#define ALU_SBC 3
+#define ALU_OPS 4
+
+/* packed flags */
+#define ALU_C 0x01
+#define ALU_V 0x02
+#define ALU_Z 0x04
+#define ALU_N 0x08
+
+static void step_OUT(Cpub *cpub);
+static void step_IN(Cpub *cpub);
+static void step_RCF(Cpub *cpub);
+static void step_SCF(Cpub *cpub);
+static int step_ST(Cpub *cpub, const Uword IR);
+static void step_LD(Cpub *cpub, const Uword IR);
+static void step_ADD(Cpub *cpub, const Uword IR);
+static void step_ADC(Cpub *cpub, const Uword IR);
+static void step_SUB(Cpub *cpub, const Uword IR);
+static void step_SBC(Cpub *cpub, const Uword IR);
+static void step_CMP(Cpub *cpub, const Uword IR);
+static inline Uword alu(Cpub *cpub, int op, Uword a, Uword b);
+static Uword alu_reference(int op, Uword a, Uword b, Bit carry, Uword *flags);
+static void step_AND(Cpub *cpub, const Uword IR);
+static void step_OR(Cpub *cpub, const Uword IR);
+static void step_EOR(Cpub *cpub, const Uword IR);
+static void step_SRSM(Cpub *cpub, const Uword IR);
+static void R_Rotate(const Uword VALUE, const Uword PUSH_BIT, Uword *out, Bit *cf, Bit *vf);
+static void L_Rotate(const Uword VALUE, const Uword PUSH_BIT, Uword *out, Bit *cf, Bit *vf);
+static void step_BBC(Cpub *cpub, const Uword IR);
+static void step_JAL(Cpub *cpub);
+static void step_JR(Cpub *cpub);
+static void set_flag(Cpub *cpub, Bit cf, Bit vf, Bit nf, Bit zf);
+static Bit chk_carry_flag(int ans);
+static Bit chk_overflow_flag(Uword num1, Uword num2, int ans);
+static Bit chk_negative_flag(int ans);
+static Bit chk_zero_flag(char ans);
+static Uword decrypt_operand_a(const Uword code);
+static Uword decrypt_operand_b(const Uword code);
+static Uword get_operand_b_value(Cpub *cpub, const Uword OPERAND_B);
+static Uword get_operand_a_value(Cpub *cpub, const Uword OPERAND_A);
+static void store_value_to_register(Cpub *cpub, const Uword OPERAND_A, const Uword value);
+static void unknown_instruction_code(const Uword code);
 void bad_oprand_B(const Uword code);
+static void chk_watch(Cpub *cpub, const Addr addr, const Uword kind);
+static inline Uword read_data(Cpub *cpub, const Uword offset);
+static inline void write_data(Cpub *cpub, const Uword offset, const Uword value);
 
-Uword MAR;
-Uword IR;
-
-Cpub *cpub;
-
-int step(Cpub *cpub_) {
-    cpub = cpub_;
+_Thread_local volatile sig_atomic_t step_pc = -1;
 
+/*
+ *   All the state of a simulation is in the Cpub passed to step(), and the
+ *   instruction register (IR) and the memory address register (MAR) are
+ *   local to an instruction, so boards may be stepped on any threads.
+ */
+int step(Cpub *cpub) {
     int return_status = RUN_STEP;
+    MetricsCounters *m = metrics_counters();
+    Uword MAR;
+    Uword IR;
 
     const Uword MASK = 0xf0;
 
     MAR = cpub->pc;
+    step_pc = MAR;
     IR = cpub->mem[0x000 + MAR];
     const Uword INSTRUCTION_CODE = IR & MASK;
     cpub->pc++;
 
+    /* one branch for both hooks on the path of every instruction */
+    if (((uintptr_t)cpub->watch | (uintptr_t)cpub->mmio) != 0) {
+        if (cpub->watch) cpub->watch->hit = 0;
+        if (cpub->mmio) cpub->mmio->clock(cpub, IR);
+    }
+    if (m) {
+        METRICS_INC(m, steps);
+        METRICS_INC(m, opcode[IR]);
+    }
+
     switch (INSTRUCTION_CODE) {
         case 0x00:
             /*
@@ -101,11 +105,12 @@ int step(Cpub *cpub_) {
             if ((IR & 0xf8) == NOP) {
                 return_status = RUN_STEP;
             } else if (((IR & 0xfc) | 0x03) == HLT) {
+                if (m) METRICS_INC(m, halts);
                 return_status = RUN_HALT;
             } else if (IR == JAL) {
-                step_JAL();
+                step_JAL(cpub);
             } else if (IR == JR) {
-                step_JR();
+                step_JR(cpub);
             } else {
                 unknown_instruction_code(IR);
                 return_status = RUN_HALT;
@@ -116,9 +121,9 @@ int step(Cpub *cpub_) {
              * OUT + IN
              */
             if ((IR & 0xf8) == OUT) {
-                step_OUT();
+                step_OUT(cpub);
             } else {
-                step_IN();
+                step_IN(cpub);
             }
             break;
         case 0x20:
@@ -126,46 +131,54 @@ int step(Cpub *cpub_) {
              * RCF + SCF
              */
             if ((IR & 0xf8) == RCF) {
-                step_RCF();
+                step_RCF(cpub);
             } else {
-                step_SCF();
+                step_SCF(cpub);
             }
             break;
         case LD:
-            step_LD();
+            step_LD(cpub, IR);
             break;
         case ST:
-            return_status = step_ST();
+            return_status = step_ST(cpub, IR);
             break;
         case ADD:
-            step_ADD();
+            step_ADD(cpub, IR);
             break;
         case ADC:
-            step_ADC();
+            step_ADC(cpub, IR);
             break;
         case SUB:
-            step_SUB();
+            step_SUB(cpub, IR);
             break;
         case SBC:
-            step_SBC();
+            step_SBC(cpub, IR);
             break;
         case CMP:
-            step_CMP();
+            step_CMP(cpub, IR);
             break;
         case AND:
-            step_AND();
+            step_AND(cpub, IR);
             break;
         case OR:
-            step_OR();
+            step_OR(cpub, IR);
             break;
         case EOR:
-            step_EOR();
+            step_EOR(cpub, IR);
             break;
         case SRSM:
-            step_SRSM();
+            step_SRSM(cpub, IR);
             break;
         case BBC:
-            step_BBC();
+            step_BBC(cpub, IR);
+            break;
+        case BNK:
+            if (cpub->xmem != NULL && (IR & 0x07) == 0) {
+                set_bank(cpub, get_operand_a_value(cpub, decrypt_operand_a(IR)));
+            } else {
+                unknown_instruction_code(IR);
+                return_status = RUN_HALT;
+            }
             break;
         default:
             unknown_instruction_code(IR);
@@ -173,54 +186,76 @@ int step(Cpub *cpub_) {
             break;
     }
 
+    if (cpub->watch && cpub->watch->hit && return_status == RUN_STEP) {
+        return_status = RUN_BREAK;
+    }
+
+    step_pc = -1;
     return return_status;
 }
 
-void step_OUT() {
+/*
+ *   Step until the board halts, hits a watchpoint or has executed max_steps
+ *   instructions.  The number of executed instructions goes to *n_steps.
+ */
+int step_n(Cpub *cpub, long max_steps, long *n_steps) {
+    int status = RUN_STEP;
+    long n = 0;
+
+    while (n < max_steps && status == RUN_STEP) {
+        status = step(cpub);
+        n++;
+    }
+    if (n_steps) *n_steps = n;
+    return status;
+}
+
+static void step_OUT(Cpub *cpub) {
     cpub->obuf.buf = cpub->acc;
     cpub->obuf.flag = 1;
     return;
 }
 
-void step_IN() {
+static void step_IN(Cpub *cpub) {
     cpub->acc = cpub->ibuf->buf;
     cpub->ibuf->flag = 0;
     return;
 }
 
-void step_RCF() {
+static void step_RCF(Cpub *cpub) {
     cpub->cf = 0;
     return;
 }
 
-void step_SCF() {
+static void step_SCF(Cpub *cpub) {
     cpub->cf = 1;
     return;
 }
 
-void step_LD() {
+static void step_LD(Cpub *cpub, const Uword IR) {
     const Uword OPERAND_A = decrypt_operand_a(IR);
     const Uword OPERAND_B = decrypt_operand_b(IR);
 
     Uword operand_b_value;
 
-    operand_b_value = get_operand_b_value(OPERAND_B);
+    operand_b_value = get_operand_b_value(cpub, OPERAND_B);
 
-    store_value_to_register(OPERAND_A, operand_b_value);
+    store_value_to_register(cpub, OPERAND_A, operand_b_value);
 
     return;
 }
 
-int step_ST() {
+static int step_ST(Cpub *cpub, const Uword IR) {
     int return_status = RUN_STEP;
 
     const Uword OPERAND_A = decrypt_operand_a(IR);
     const Uword OPERAND_B = decrypt_operand_b(IR);
 
+    Uword MAR;
     Uword operand_a_value;
     Uword second_word;
 
-    operand_a_value = get_operand_a_value(OPERAND_A);
+    operand_a_value = get_operand_a_value(cpub, OPERAND_A);
 
     MAR = cpub->pc;
     cpub->pc++;
@@ -244,213 +279,316 @@ int step_ST() {
             cpub->mem[0x000 + second_word] = operand_a_value;
             break;
         case ABSOLUTE_DATA_ADDRESS:
-            cpub->mem[0x100 + second_word] = operand_a_value;
+            if (cpub->watch) chk_watch(cpub, 0x100 + second_word, WATCH_WRITE);
+            write_data(cpub, second_word, operand_a_value);
             break;
         case IX_MODIFICATION_PROGRAM_ADDRESS:
-            cpub->mem[0x000 + cpub->ix + second_word] = operand_a_value;
+            cpub->mem[0x000 + (Uword)(cpub->ix + second_word)] = operand_a_value;
             break;
         case IX_MODIFICATION_DATA_ADDRESS:
-            cpub->mem[0x100 + cpub->ix + second_word] = operand_a_value;
+            if (cpub->watch)
+                chk_watch(cpub, 0x100 + (Uword)(cpub->ix + second_word),
+                          WATCH_WRITE);
+            write_data(cpub, (Uword)(cpub->ix + second_word), operand_a_value);
             break;
     }
 
+    if (return_status == RUN_HALT) {
+        MetricsCounters *m = metrics_counters();
+        if (m) METRICS_INC(m, st_faults);
+    }
+
     return return_status;
 }
 
-void step_ADD() {
+static void step_ADD(Cpub *cpub, const Uword IR) {
     const Uword OPERAND_A = decrypt_operand_a(IR);
     const Uword OPERAND_B = decrypt_operand_b(IR);
 
     Uword operand_a_value;
     Uword operand_b_value;
 
-    operand_a_value = get_operand_a_value(OPERAND_A);
+    operand_a_value = get_operand_a_value(cpub, OPERAND_A);
 
-    operand_b_value = get_operand_b_value(OPERAND_B);
+    operand_b_value = get_operand_b_value(cpub, OPERAND_B);
 
-    int sum = operand_a_value + operand_b_value;
-    Bit cf = chk_carry_flag(sum);
-    Bit vf = chk_overflow_flag(operand_a_value, operand_b_value, sum);
-    Bit nf = chk_negative_flag(sum);
-    Bit zf = chk_zero_flag(sum & 0xff);
-    /* ADDはCFを使わない carryが出たらそれはoverflowである */
-    set_flag(cpub->cf, cf | vf, nf, zf);
-
-    store_value_to_register(OPERAND_A, sum & 0xff);
+    store_value_to_register(cpub, OPERAND_A,
+                            alu(cpub, ALU_ADD, operand_a_value, operand_b_value));
 
     return;
 }
 
-void step_ADC() {
+static void step_ADC(Cpub *cpub, const Uword IR) {
     const Uword OPERAND_A = decrypt_operand_a(IR);
     const Uword OPERAND_B = decrypt_operand_b(IR);
 
     Uword operand_a_value;
     Uword operand_b_value;
 
-    operand_a_value = get_operand_a_value(OPERAND_A);
-
-    operand_b_value = get_operand_b_value(OPERAND_B);
+    operand_a_value = get_operand_a_value(cpub, OPERAND_A);
 
-    int carry = cpub->cf;
-    int sum = operand_a_value + operand_b_value + carry;
-    Bit cf = chk_carry_flag(sum);
-    Bit vf = chk_overflow_flag(operand_a_value, operand_b_value, sum);
-    Bit nf = chk_negative_flag(sum);
-    Bit zf = chk_zero_flag(sum & 0xff);
-    set_flag(cf, vf, nf, zf);
+    operand_b_value = get_operand_b_value(cpub, OPERAND_B);
 
-    store_value_to_register(OPERAND_A, sum & 0xff);
+    store_value_to_register(cpub, OPERAND_A,
+                            alu(cpub, ALU_ADC, operand_a_value, operand_b_value));
 
     return;
 }
 
-void step_SUB() {
+static void step_SUB(Cpub *cpub, const Uword IR) {
     const Uword OPERAND_A = decrypt_operand_a(IR);
     const Uword OPERAND_B = decrypt_operand_b(IR);
 
     Uword operand_a_value;
     Uword operand_b_value;
 
-    operand_a_value = get_operand_a_value(OPERAND_A);
+    operand_a_value = get_operand_a_value(cpub, OPERAND_A);
 
-    operand_b_value = get_operand_b_value(OPERAND_B);
-    operand_b_value = (~operand_b_value) + 1;
+    operand_b_value = get_operand_b_value(cpub, OPERAND_B);
 
-    int sum = operand_a_value + operand_b_value;
-    Bit cf = cpub->cf;
-    Bit vf = chk_overflow_flag(operand_a_value, operand_b_value, sum);
-    Bit nf = chk_negative_flag(sum);
-    Bit zf = chk_zero_flag(sum & 0xff);
-
-    set_flag(cf, vf, nf, zf);
-
-    store_value_to_register(OPERAND_A, sum & 0xff);
+    store_value_to_register(cpub, OPERAND_A,
+                            alu(cpub, ALU_SUB, operand_a_value, operand_b_value));
 
     return;
 }
 
-void step_SBC() {
+static void step_SBC(Cpub *cpub, const Uword IR) {
     const Uword OPERAND_A = decrypt_operand_a(IR);
     const Uword OPERAND_B = decrypt_operand_b(IR);
 
     Uword operand_a_value;
     Uword operand_b_value;
 
-    operand_a_value = get_operand_a_value(OPERAND_A);
-
-    operand_b_value = get_operand_b_value(OPERAND_B);
-    operand_b_value = (~operand_b_value) + 1;
-
-    int borrow = cpub->cf;
-    int sum = operand_a_value + operand_b_value - borrow;
-    Bit cf = !chk_carry_flag(sum);
-    Bit vf = chk_overflow_flag(operand_a_value, operand_b_value, sum);
-    Bit nf = chk_negative_flag(sum);
-    Bit zf = chk_zero_flag(sum & 0xff);
+    operand_a_value = get_operand_a_value(cpub, OPERAND_A);
 
-    set_flag(cf, vf, nf, zf);
+    operand_b_value = get_operand_b_value(cpub, OPERAND_B);
 
-    store_value_to_register(OPERAND_A, sum & 0xff);
+    store_value_to_register(cpub, OPERAND_A,
+                            alu(cpub, ALU_SBC, operand_a_value, operand_b_value));
 
     return;
 }
 
-void step_CMP() {
+static void step_CMP(Cpub *cpub, const Uword IR) {
     const Uword OPERAND_A = decrypt_operand_a(IR);
     const Uword OPERAND_B = decrypt_operand_b(IR);
 
     Uword operand_a_value;
     Uword operand_b_value;
 
-    operand_a_value = get_operand_a_value(OPERAND_A);
+    operand_a_value = get_operand_a_value(cpub, OPERAND_A);
 
     // SUB命令と同じ処理
     // ZFが立っていたらA=Bであることがわかる
-    operand_b_value = get_operand_b_value(OPERAND_B);
-    operand_b_value = (~operand_b_value) + 1;
+    operand_b_value = get_operand_b_value(cpub, OPERAND_B);
 
-    int sum = operand_a_value + operand_b_value;
-    Bit cf = cpub->cf;
-    Bit vf = chk_overflow_flag(operand_a_value, operand_b_value, sum);
-    Bit nf = chk_negative_flag(sum);
-    Bit zf = chk_zero_flag(sum & 0xff);
-
-    set_flag(cf, vf, nf, zf);
+    alu(cpub, ALU_SUB, operand_a_value, operand_b_value);
 
     return;
 }
 
-void step_AND() {
+/*=============================================================================
+ *   Adder: Flag Table and Reference
+ *===========================================================================*/
+/*
+ *   alu_flags[op] is indexed by the carry in, the signs of the operands
+ *   (B negated for SUB and SBC) and the 9-bit sum, and holds the packed
+ *   flags that op leaves.  All of it (16 KB) stays in the L1 cache, and an
+ *   operation is one addition and one load instead of the chk_* helpers.
+ *   It is filled from alu_reference() before main() runs; building with
+ *   -DCPUB_ALU_ARITH calls alu_reference() instead.
+ */
+#define ALU_INDEX(CF, A, NB, SUM) \
+    ((CF) << 11 | ((A) >> 7) << 10 | ((NB) >> 7) << 9 | ((SUM) & 0x1ff))
+
+static Uword alu_flags[ALU_OPS][1 << 12];
+
+static inline Uword alu(Cpub *cpub, int op, Uword a, Uword b) {
+    Uword flags, ans;
+
+#ifdef CPUB_ALU_ARITH
+    ans = alu_reference(op, a, b, cpub->cf, &flags);
+#else
+    const Uword NB = op >= ALU_SUB ? (Uword)(~b + 1) : b;
+    const int SUM = a + NB + (op == ALU_ADC ? cpub->cf : 0) -
+                    (op == ALU_SBC ? cpub->cf : 0);
+
+    flags = alu_flags[op][ALU_INDEX(cpub->cf != 0, a, NB, SUM)];
+    ans = SUM;
+#endif
+    cpub->cf = flags & ALU_C;
+    cpub->vf = (flags & ALU_V) != 0;
+    cpub->zf = (flags & ALU_Z) != 0;
+    cpub->nf = (flags & ALU_N) != 0;
+    return ans;
+}
+
+/*
+ *   The result and the packed flags of op as step_* computed them with the
+ *   chk_* helpers
+ */
+static Uword alu_reference(int op, Uword a, Uword b, Bit carry,
+                           Uword *flags) {
+    int sum;
+    Bit cf, vf;
+
+    switch (op) {
+        case ALU_ADD:
+            sum = a + b;
+            cf = chk_carry_flag(sum);
+            vf = chk_overflow_flag(a, b, sum);
+            /* ADDはCFを使わない carryが出たらそれはoverflowである */
+            vf = cf | vf;
+            cf = carry;
+            break;
+        case ALU_ADC:
+            sum = a + b + carry;
+            cf = chk_carry_flag(sum);
+            vf = chk_overflow_flag(a, b, sum);
+            break;
+        case ALU_SUB:
+            b = (~b) + 1;
+            sum = a + b;
+            cf = carry;
+            vf = chk_overflow_flag(a, b, sum);
+            break;
+        default: /* ALU_SBC */
+            b = (~b) + 1;
+            sum = a + b - carry;
+            cf = !chk_carry_flag(sum);
+            vf = chk_overflow_flag(a, b, sum);
+            break;
+    }
+    *flags = (cf ? ALU_C : 0) | (vf ? ALU_V : 0) |
+             (chk_zero_flag(sum & 0xff) ? ALU_Z : 0) |
+             (chk_negative_flag(sum) ? ALU_N : 0);
+    return sum & 0xff;
+}
+
+/*
+ *   CF is not always 0 or 1 (BC stores its operand in it), and ADC and SBC
+ *   add all of it, as the helpers did; only whether it is set goes into the
+ *   index.  The flags depend on nothing but the signs and the 9-bit sum, so
+ *   B (negated for SUB and SBC) takes the lowest and the highest value of
+ *   each sign, which with every A gives every sum of the signs.
+ */
+__attribute__((constructor)) static void init_alu(void) {
+    static const Uword NBS[] = {0x00, 0x7f, 0x80, 0xff};
+    int op, a, i, carry;
+    Uword flags;
+
+    for (op = 0; op < ALU_OPS; op++)
+        for (carry = 0; carry < (op == ALU_ADC || op == ALU_SBC ? 256 : 2);
+             carry++)
+            for (a = 0; a < 256; a++)
+                for (i = 0; i < 4; i++) {
+                    const Uword NB = NBS[i];
+                    const Uword B = op >= ALU_SUB ? (Uword)(~NB + 1) : NB;
+                    const int SUM = a + NB + (op == ALU_ADC ? carry : 0) -
+                                    (op == ALU_SBC ? carry : 0);
+
+                    alu_reference(op, a, B, carry, &flags);
+                    alu_flags[op][ALU_INDEX(carry != 0, a, NB, SUM)] = flags;
+                }
+}
+
+/*
+ *   Every CF from 0 to 0xff is tried, not only 0 and 1.  CMP is checked as
+ *   the SUB it is.
+ */
+long alu_verify(void) {
+    static const int OPS[] = {ALU_ADD, ALU_ADC, ALU_SUB, ALU_SBC, ALU_SUB};
+    Cpub cpub;
+    Uword flags, ans;
+    int k, a, b, carry;
+    long bad = 0;
+
+    for (k = 0; k < (int)(sizeof(OPS) / sizeof(OPS[0])); k++)
+        for (carry = 0; carry < 256; carry++)
+            for (a = 0; a < 256; a++)
+                for (b = 0; b < 256; b++) {
+                    ans = alu_reference(OPS[k], a, b, carry, &flags);
+                    cpub.cf = carry;
+                    if (alu(&cpub, OPS[k], a, b) != ans ||
+                        cpub.cf != ((flags & ALU_C) != 0) ||
+                        cpub.vf != ((flags & ALU_V) != 0) ||
+                        cpub.zf != ((flags & ALU_Z) != 0) ||
+                        cpub.nf != ((flags & ALU_N) != 0))
+                        bad++;
+                }
+    return bad;
+}
+
+static void step_AND(Cpub *cpub, const Uword IR) {
     const Uword OPERAND_A = decrypt_operand_a(IR);
     const Uword OPERAND_B = decrypt_operand_b(IR);
 
     Uword operand_a_value;
     Uword operand_b_value;
 
-    operand_a_value = get_operand_a_value(OPERAND_A);
+    operand_a_value = get_operand_a_value(cpub, OPERAND_A);
 
-    operand_b_value = get_operand_b_value(OPERAND_B);
+    operand_b_value = get_operand_b_value(cpub, OPERAND_B);
 
     Uword ans = operand_a_value & operand_b_value;
     Bit cf = cpub->cf;
     Bit vf = 0;
     Bit nf = chk_negative_flag(ans);
     Bit zf = chk_zero_flag(ans);
-    set_flag(cf, vf, nf, zf);
+    set_flag(cpub, cf, vf, nf, zf);
 
-    store_value_to_register(OPERAND_A, ans);
+    store_value_to_register(cpub, OPERAND_A, ans);
 
     return;
 }
 
-void step_OR() {
+static void step_OR(Cpub *cpub, const Uword IR) {
     const Uword OPERAND_A = decrypt_operand_a(IR);
     const Uword OPERAND_B = decrypt_operand_b(IR);
 
     Uword operand_a_value;
     Uword operand_b_value;
 
-    operand_a_value = get_operand_a_value(OPERAND_A);
+    operand_a_value = get_operand_a_value(cpub, OPERAND_A);
 
-    operand_b_value = get_operand_b_value(OPERAND_B);
+    operand_b_value = get_operand_b_value(cpub, OPERAND_B);
 
     Uword ans = operand_a_value | operand_b_value;
     Bit cf = cpub->cf;
     Bit vf = 0;
     Bit nf = chk_negative_flag(ans);
     Bit zf = chk_zero_flag(ans);
-    set_flag(cf, vf, nf, zf);
+    set_flag(cpub, cf, vf, nf, zf);
 
-    store_value_to_register(OPERAND_A, ans);
+    store_value_to_register(cpub, OPERAND_A, ans);
 
     return;
 }
 
-void step_EOR() {
+static void step_EOR(Cpub *cpub, const Uword IR) {
     const Uword OPERAND_A = decrypt_operand_a(IR);
     const Uword OPERAND_B = decrypt_operand_b(IR);
 
     Uword operand_a_value;
     Uword operand_b_value;
 
-    operand_a_value = get_operand_a_value(OPERAND_A);
+    operand_a_value = get_operand_a_value(cpub, OPERAND_A);
 
-    operand_b_value = get_operand_b_value(OPERAND_B);
+    operand_b_value = get_operand_b_value(cpub, OPERAND_B);
 
     Uword ans = operand_a_value ^ operand_b_value;
     Bit cf = cpub->cf;
     Bit vf = 0;
     Bit nf = chk_negative_flag(ans);
     Bit zf = chk_zero_flag(ans);
-    set_flag(cf, vf, nf, zf);
+    set_flag(cpub, cf, vf, nf, zf);
 
-    store_value_to_register(OPERAND_A, ans);
+    store_value_to_register(cpub, OPERAND_A, ans);
 
     return;
 }
 
-void step_SRSM() {
+static void step_SRSM(Cpub *cpub, const Uword IR) {
     enum Shift_Mode {
         SRA,
         SLA,
@@ -465,7 +603,7 @@ void step_SRSM() {
     const Uword OPERAND_A = decrypt_operand_a(IR);
     Uword operand_a_value;
 
-    operand_a_value = get_operand_a_value(OPERAND_A);
+    operand_a_value = get_operand_a_value(cpub, OPERAND_A);
 
     Uword ans;
     Bit cf, vf, nf, zf;
@@ -506,14 +644,14 @@ void step_SRSM() {
     nf = chk_negative_flag(ans);
     zf = chk_zero_flag(ans);
 
-    set_flag(cf, vf, nf, zf);
+    set_flag(cpub, cf, vf, nf, zf);
 
-    store_value_to_register(OPERAND_A, ans);
+    store_value_to_register(cpub, OPERAND_A, ans);
 
     return;
 }
 
-void R_Rotate(const Uword VALUE, const Uword PUSH_BIT, Uword *out, Bit *cf, Bit *vf) {
+static void R_Rotate(const Uword VALUE, const Uword PUSH_BIT, Uword *out, Bit *cf, Bit *vf) {
     Uword ans;
     ans = VALUE >> 1;
     // MSBへセットされるビット
@@ -525,7 +663,7 @@ void R_Rotate(const Uword VALUE, const Uword PUSH_BIT, Uword *out, Bit *cf, Bit
     return;
 }
 
-void L_Rotate(const Uword VALUE, const Uword PUSH_BIT, Uword *out, Bit *cf, Bit *vf) {
+static void L_Rotate(const Uword VALUE, const Uword PUSH_BIT, Uword *out, Bit *cf, Bit *vf) {
     Uword ans;
     ans = VALUE << 1;
     // LSBへセットされるビット
@@ -537,7 +675,7 @@ void L_Rotate(const Uword VALUE, const Uword PUSH_BIT, Uword *out, Bit *cf, Bit
     return;
 }
 
-void step_BBC() {
+static void step_BBC(Cpub *cpub, const Uword IR) {
     enum Branch {
         ALWAYS,
         NOT_ZERO,
@@ -559,6 +697,8 @@ void step_BBC() {
 
     const Uword MASK = 0x0f;
     const Uword BRANCH_CODE = IR & MASK;
+    MetricsCounters *m;
+    Uword MAR;
     Uword second_word;
 
     MAR = cpub->pc;
@@ -579,7 +719,10 @@ void step_BBC() {
             if (!(cpub->nf | cpub->zf)) cpub->pc = second_word;
             break;
         case NO_INPUT:
-            if (!cpub->ibuf->flag) cpub->pc = second_word;
+            if (!cpub->ibuf->flag) {
+                cpub->pc = second_word;
+                if ((m = metrics_counters())) METRICS_INC(m, io_waits);
+            }
             break;
         case NO_CARRY:
             if (!cpub->cf) cpub->pc = second_word;
@@ -603,7 +746,10 @@ void step_BBC() {
             if (cpub->nf | cpub->zf) cpub->pc = second_word;
             break;
         case NO_OUTPUT:
-            if (cpub->obuf.flag) cpub->pc = second_word;
+            if (cpub->obuf.flag) {
+                cpub->pc = second_word;
+                if ((m = metrics_counters())) METRICS_INC(m, io_waits);
+            }
             break;
         case CARRY:
             if (cpub->cf) cpub->cf = second_word;
@@ -619,7 +765,8 @@ void step_BBC() {
     return;
 }
 
-void step_JAL() {
+static void step_JAL(Cpub *cpub) {
+    Uword MAR;
     Uword operand_b_value;
 
     MAR = cpub->pc;
@@ -632,12 +779,12 @@ void step_JAL() {
     return;
 }
 
-void step_JR() {
+static void step_JR(Cpub *cpub) {
     cpub->pc = cpub->acc;
     return;
 }
 
-void set_flag(Bit cf, Bit vf, Bit nf, Bit zf) {
+static void set_flag(Cpub *cpub, Bit cf, Bit vf, Bit nf, Bit zf) {
     if (cf) {
         cpub->cf = 1;
     } else {
@@ -664,7 +811,7 @@ void set_flag(Bit cf, Bit vf, Bit nf, Bit zf) {
     return;
 }
 
-Bit chk_carry_flag(int ans) {
+static Bit chk_carry_flag(int ans) {
     if ((ans >> 8) & 1) {
         return 1;
     } else {
@@ -672,7 +819,7 @@ Bit chk_carry_flag(int ans) {
     }
 }
 
-Bit chk_overflow_flag(Uword num1, Uword num2, int ans) {
+static Bit chk_overflow_flag(Uword num1, Uword num2, int ans) {
     char MSB_A = (num1 >> 7) & 1;
     char MSB_B = (num2 >> 7) & 1;
     char MSB_C = (ans >> 7) & 1;
@@ -683,7 +830,7 @@ Bit chk_overflow_flag(Uword num1, Uword num2, int ans) {
     }
 }
 
-Bit chk_negative_flag(int ans) {
+static Bit chk_negative_flag(int ans) {
     if ((ans >> 7) & 1) {
         return 1;
     } else {
@@ -691,7 +838,7 @@ Bit chk_negative_flag(int ans) {
     }
 }
 
-Bit chk_zero_flag(char ans) {
+static Bit chk_zero_flag(char ans) {
     if (ans) {
         return 0;
     } else {
@@ -699,12 +846,12 @@ Bit chk_zero_flag(char ans) {
     }
 }
 
-Uword decrypt_operand_a(const Uword CODE) {
+static Uword decrypt_operand_a(const Uword CODE) {
     const Uword MASK = 0x08;
     return CODE & MASK;
 }
 
-Uword decrypt_operand_b(const Uword CODE) {
+static Uword decrypt_operand_b(const Uword CODE) {
     const Uword MASK = 0x07;
     Uword operand_b = CODE & MASK;
 
@@ -714,7 +861,7 @@ Uword decrypt_operand_b(const Uword CODE) {
     return operand_b;
 }
 
-Uword get_operand_a_value(const Uword OPERAND_A) {
+static Uword get_operand_a_value(Cpub *cpub, const Uword OPERAND_A) {
     Uword operand_a_value;
     if (OPERAND_A == ACC) {
         operand_a_value = cpub->acc;
@@ -725,8 +872,9 @@ Uword get_operand_a_value(const Uword OPERAND_A) {
     return operand_a_value;
 }
 
-Uword get_operand_b_value(const Uword OPERAND_B) {
-    Uword operand_b_value;
+static Uword get_operand_b_value(Cpub *cpub, const Uword OPERAND_B) {
+    Uword MAR;
+    Uword operand_b_value = 0;
     Uword second_word;
     switch (OPERAND_B) {
         case ACC:
@@ -751,25 +899,29 @@ Uword get_operand_b_value(const Uword OPERAND_B) {
             MAR = cpub->pc;
             cpub->pc++;
             second_word = cpub->mem[0x000 + MAR];
-            operand_b_value = cpub->mem[0x100 + second_word];
+            if (cpub->watch) chk_watch(cpub, 0x100 + second_word, WATCH_READ);
+            operand_b_value = read_data(cpub, second_word);
             break;
         case IX_MODIFICATION_PROGRAM_ADDRESS:
             MAR = cpub->pc;
             cpub->pc++;
             second_word = cpub->mem[0x000 + MAR];
-            operand_b_value = cpub->mem[0x000 + cpub->ix + second_word];
+            operand_b_value = cpub->mem[0x000 + (Uword)(cpub->ix + second_word)];
             break;
         case IX_MODIFICATION_DATA_ADDRESS:
             MAR = cpub->pc;
             cpub->pc++;
             second_word = cpub->mem[0x000 + MAR];
-            operand_b_value = cpub->mem[0x100 + cpub->ix + second_word];
+            if (cpub->watch)
+                chk_watch(cpub, 0x100 + (Uword)(cpub->ix + second_word),
+                          WATCH_READ);
+            operand_b_value = read_data(cpub, (Uword)(cpub->ix + second_word));
             break;
     }
     return operand_b_value;
 }
 
-void store_value_to_register(const Uword OPERAND_A, const Uword value) {
+static void store_value_to_register(Cpub *cpub, const Uword OPERAND_A, const Uword value) {
     if (OPERAND_A == ACC) {
         cpub->acc = value;
     } else {
@@ -778,10 +930,88 @@ void store_value_to_register(const Uword OPERAND_A, const Uword value) {
     return;
 }
 
-void unknown_instruction_code(const Uword code) {
+static void unknown_instruction_code(const Uword code) {
+    MetricsCounters *m = metrics_counters();
+
+    if (m) METRICS_INC(m, illegals);
     fprintf(stderr, "%#x is unknown or not implemented instruction code.\n", code);
 }
 
 void bad_oprand_B(const Uword code) {
     fprintf(stderr, "%#x is bad operand B.\n", code);
 }
+
+static void chk_watch(Cpub *cpub, const Addr addr, const Uword kind) {
+    const Uword *map = (kind == WATCH_READ) ? cpub->watch->read
+                                            : cpub->watch->write;
+    const Uword OFFSET = addr & 0xff;
+
+    if (map[OFFSET >> 3] & (1 << (OFFSET & 0x07))) {
+        cpub->watch->hit = kind;
+        cpub->watch->hit_addr = addr;
+    }
+}
+
+/*
+ *   Accesses to the data area.  Without devices the only cost is the test
+ *   of cpub->mmio, as for the watchpoints.
+ */
+static inline Uword read_data(Cpub *cpub, const Uword offset) {
+    if (cpub->mmio && mmio_mapped(cpub->mmio, offset))
+        return cpub->mmio->read(cpub, 0x100 + offset);
+    return cpub->mem[0x100 + offset];
+}
+
+static inline void write_data(Cpub *cpub, const Uword offset, const Uword value) {
+    if (cpub->mmio && mmio_mapped(cpub->mmio, offset))
+        cpub->mmio->write(cpub, 0x100 + offset, value);
+    else
+        cpub->mem[0x100 + offset] = value;
+}
+
+/*=============================================================================
+ *   Extended Memory Mode
+ *===========================================================================*/
+/*
+ *   The data area (0x100-0x1ff) is a window on one bank of the extended
+ *   memory: the bank in the window lives in mem, and set_bank() swaps the
+ *   pages.  Every access to the data area is therefore the same as in the
+ *   base mode, and only BNK costs more.  n_banks is a power of 2.
+ */
+int xmem_attach(Cpub *cpub, int n_banks) {
+    Uword *xmem;
+
+    if (n_banks < 2 || n_banks > MAX_BANKS || (n_banks & (n_banks - 1))) {
+        fprintf(stderr, "Invalid number of banks: %d\n", n_banks);
+        return -1;
+    }
+    if ((xmem = calloc(n_banks, IMEMORY_SIZE)) == NULL) {
+        fprintf(stderr, "Unable to allocate %d banks\n", n_banks);
+        return -1;
+    }
+    xmem_detach(cpub);
+    cpub->xmem = xmem;
+    cpub->n_banks = n_banks;
+    cpub->bank = 0;
+    return 0;
+}
+
+/*
+ *   Back to the base mode with bank 0 in the data area
+ */
+void xmem_detach(Cpub *cpub) {
+    if (cpub->xmem == NULL) return;
+    set_bank(cpub, 0);
+    free(cpub->xmem);
+    cpub->xmem = NULL;
+    cpub->n_banks = 0;
+}
+
+void set_bank(Cpub *cpub, Uword bank) {
+    bank &= cpub->n_banks - 1;
+    if (bank == cpub->bank) return;
+    memcpy(cpub->xmem + cpub->bank * IMEMORY_SIZE, cpub->mem + 0x100,
+           IMEMORY_SIZE);
+    memcpy(cpub->mem + 0x100, cpub->xmem + bank * IMEMORY_SIZE, IMEMORY_SIZE);
+    cpub->bank = bank;
+}
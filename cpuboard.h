@@ -6,6 +6,11 @@
  *	Descrioption:	resource definition of the educational computer board
  */
 
+#ifndef CPUBOARD_H
+#define CPUBOARD_H
+
+#include <signal.h>
+
 /*=============================================================================
  *   Architectural Data Types
  *===========================================================================*/
@@ -25,6 +30,35 @@ typedef struct iobuf {
     Uword buf;
 } IOBuf;
 
+/*
+ *   Data watchpoints: bitmaps over the data area (0x100-0x1ff)
+ */
+#define WATCH_READ 1
+#define WATCH_WRITE 2
+
+typedef struct watch {
+    Uword read[IMEMORY_SIZE / 8];
+    Uword write[IMEMORY_SIZE / 8];
+    Uword hit;     /* WATCH_READ or WATCH_WRITE when a watchpoint is hit */
+    Addr hit_addr;
+} Watch;
+
+/*
+ *   Memory-mapped devices: a bitmap of the data addresses (0x100-0x1ff)
+ *   that are device registers rather than memory, and the hooks of the
+ *   device layer (device.c).  clock is called before every instruction.
+ */
+struct cpuboard;
+
+typedef struct mmio {
+    Uword map[IMEMORY_SIZE / 8];
+    Uword (*read)(struct cpuboard *, Addr);
+    void (*write)(struct cpuboard *, Addr, Uword);
+    void (*clock)(struct cpuboard *, Uword);
+} Mmio;
+
+#define mmio_mapped(M, OFFSET) ((M)->map[(OFFSET) >> 3] & (1 << ((OFFSET)&0x07)))
+
 typedef struct cpuboard {
     Uword pc;
     Uword acc;
@@ -32,15 +66,94 @@ typedef struct cpuboard {
     Bit cf, vf, nf, zf;
     IOBuf *ibuf;
     IOBuf obuf;
+    Watch *watch; /* NULL unless a watchpoint is armed */
+    Mmio *mmio;   /* NULL unless devices are attached */
+    /*
+     *   Extended memory: n_banks pages of 256 words, one of which (bank) is
+     *   in the data area.  NULL in the base mode.
+     */
+    Uword *xmem;
+    int n_banks;
+    Uword bank;
     /*
      *   [ add here the other CPU resources if necessary ]
      */
     Uword mem[MEMORY_SIZE]; /* 0XX:Program, 1XX:Data */
 } Cpub;
 
+/*=============================================================================
+ *   Instruction Set
+ *===========================================================================*/
+enum Instruction_code {
+    NOP = 0x00,
+    HLT = 0x0f,
+    OUT = 0x10,
+    IN = 0x1f,
+    RCF = 0x20,
+    SCF = 0x2f,
+    LD = 0x60,
+    ST = 0x70,
+    ADD = 0xB0,
+    ADC = 0x90,
+    SUB = 0xa0,
+    SBC = 0x80,
+    CMP = 0xf0,
+    AND = 0xe0,
+    OR = 0xd0,
+    EOR = 0xC0,
+    SRSM = 0x40,
+    BBC = 0x30,
+    BNK = 0x50, /* extended memory mode only */
+    JAL = 0x0a,
+    JR = 0x0b
+};
+
+enum Operand_B_3bits {
+    ACC = 0x00,
+    IX = 0x01,
+    IMMEDIATE_ADDRESS = 0x02,
+    ABSOLUTE_PROGRAM_ADDRESS = 0x04,
+    ABSOLUTE_DATA_ADDRESS = 0x05,
+    IX_MODIFICATION_PROGRAM_ADDRESS = 0x06,
+    IX_MODIFICATION_DATA_ADDRESS = 0x07
+};
+
 /*=============================================================================
  *   Top Function of an Instruction Simulation
  *===========================================================================*/
 #define RUN_HALT 0
 #define RUN_STEP 1
+#define RUN_BREAK 2 /* a watchpoint was hit */
+
+/*
+ *   PC of the instruction that this thread is executing in step(), or -1;
+ *   read by the sampling profiler from its signal handler
+ */
+extern _Thread_local volatile sig_atomic_t step_pc;
+
+/*
+ *   Both functions touch nothing but the Cpub (and its IOBuf, Watch and
+ *   devices), so each thread may run its own boards at the same time.
+ */
 int step(Cpub *);
+int step_n(Cpub *, long max_steps, long *n_steps);
+
+/*=============================================================================
+ *   Extended Memory Mode
+ *===========================================================================*/
+#define MAX_BANKS 256
+
+int xmem_attach(Cpub *, int n_banks);
+void xmem_detach(Cpub *);
+void set_bank(Cpub *, Uword);
+
+/*=============================================================================
+ *   Adder (ADD, ADC, SUB, SBC and CMP)
+ *===========================================================================*/
+/*
+ *   Checks the flag table against the chk_* helpers over all 2^24 inputs
+ *   (A, B and CF) of each operation; returns the number of mismatches
+ */
+long alu_verify(void);
+
+#endif /* CPUBOARD_H */
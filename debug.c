@@ -0,0 +1,209 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	debug.c
+ *	Descrioption:	breakpoints, watchpoints and conditional breakpoints
+ */
+
+#include "debug.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BitTest(M, A) ((M)[(A) >> 3] & (1 << ((A)&0x07)))
+#define BitFlip(M, A) ((M)[(A) >> 3] ^= (1 << ((A)&0x07)))
+
+static void toggle_breakpoint(Debug *, char *);
+static void toggle_watchpoint(Debug *, Cpub *, char *, char *);
+static void toggle_condition(Debug *, Cpub *, char *, char *);
+static void update_watch(Debug *, Cpub *);
+static void clear_all(Debug *, Cpub *);
+static void list_all(Debug *);
+
+/*=============================================================================
+ *   Check after an Instruction
+ *===========================================================================*/
+/*
+ *   Returns nonzero (and reports the reason) if execution has to stop at
+ *   the current state.  Only called while debug_armed() is true.
+ */
+int debug_check(Debug *dbg, Cpub *cpub) {
+    int i;
+
+    if (dbg->n_bp && BitTest(dbg->bp, cpub->pc)) {
+        fprintf(stderr, "Breakpoint at 0x%02x.\n", cpub->pc);
+        return 1;
+    }
+    for (i = 0; i < dbg->n_cond; i++) {
+        if (*dbg->cond[i].reg == dbg->cond[i].value) {
+            fprintf(stderr, "Condition %s=0x%02x is met.\n", dbg->cond[i].name,
+                    dbg->cond[i].value);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ *   Report the result of step() other than RUN_STEP/RUN_HALT
+ */
+void debug_report(Debug *dbg, Cpub *cpub, int status) {
+    (void)cpub;
+    if (status == RUN_BREAK) {
+        fprintf(stderr, "Watchpoint: %s at 0x%03x.\n",
+                dbg->watch.hit == WATCH_READ ? "read" : "write",
+                dbg->watch.hit_addr);
+    }
+}
+
+/*=============================================================================
+ *   Setting from a Debugger Front End
+ *===========================================================================*/
+/*
+ *   Sets (on != 0) or clears the breakpoint at a program address
+ */
+void debug_set_break(Debug *dbg, Addr addr, int on) {
+    if (!BitTest(dbg->bp, addr) == !on) return;
+    BitFlip(dbg->bp, addr);
+    dbg->n_bp += on ? 1 : -1;
+}
+
+/*
+ *   Sets or clears watchpoints of the kinds (WATCH_READ|WATCH_WRITE) at a
+ *   data address (1XX)
+ */
+void debug_set_watch(Debug *dbg, Cpub *cpub, Addr addr, int kinds, int on) {
+    Uword *map[2] = {dbg->watch.read, dbg->watch.write};
+    int k;
+
+    addr &= 0xff;
+    for (k = 0; k < 2; k++)
+        if ((kinds & (WATCH_READ << k)) && !BitTest(map[k], addr) != !on)
+            BitFlip(map[k], addr);
+    update_watch(dbg, cpub);
+}
+
+/*=============================================================================
+ *   Command: Breakpoints
+ *===========================================================================*/
+/*
+ *   b                  list breakpoints
+ *   b addr             toggle a breakpoint at the program address
+ *   b r|w|rw addr      toggle a watchpoint at the data address (1XX)
+ *   b reg data         toggle a conditional breakpoint (reg == data)
+ *   b clear            clear all
+ */
+void break_command(Debug *dbg, Cpub *cpub, char *arg1, char *arg2) {
+    if (arg1 == NULL) {
+        list_all(dbg);
+    } else if (arg2 == NULL) {
+        if (!strcmp(arg1, "clear"))
+            clear_all(dbg, cpub);
+        else
+            toggle_breakpoint(dbg, arg1);
+    } else if (!strcmp(arg1, "r") || !strcmp(arg1, "w") ||
+               !strcmp(arg1, "rw")) {
+        toggle_watchpoint(dbg, cpub, arg1, arg2);
+    } else {
+        toggle_condition(dbg, cpub, arg1, arg2);
+    }
+}
+
+static void toggle_breakpoint(Debug *dbg, char *straddr) {
+    unsigned int addr;
+
+    if (sscanf(straddr, "%x", &addr) != 1 || addr >= IMEMORY_SIZE) {
+        fprintf(stderr, "Invalid address: %s\n", straddr);
+        return;
+    }
+    BitFlip(dbg->bp, addr);
+    dbg->n_bp += BitTest(dbg->bp, addr) ? 1 : -1;
+}
+
+static void toggle_watchpoint(Debug *dbg, Cpub *cpub, char *kind,
+                              char *straddr) {
+    unsigned int addr;
+
+    if (sscanf(straddr, "%x", &addr) != 1 || addr < 0x100 ||
+        addr >= MEMORY_SIZE) {
+        fprintf(stderr, "Invalid address (not in data area): %s\n", straddr);
+        return;
+    }
+    addr &= 0xff;
+    if (strchr(kind, 'r')) BitFlip(dbg->watch.read, addr);
+    if (strchr(kind, 'w')) BitFlip(dbg->watch.write, addr);
+    update_watch(dbg, cpub);
+}
+
+static void update_watch(Debug *dbg, Cpub *cpub) {
+    int i, n;
+
+    for (i = n = 0; i < IMEMORY_SIZE / 8; i++)
+        n |= dbg->watch.read[i] | dbg->watch.write[i];
+    dbg->n_watch = (n != 0);
+    cpub->watch = dbg->n_watch ? &dbg->watch : NULL;
+}
+
+static void toggle_condition(Debug *dbg, Cpub *cpub, char *regname,
+                             char *strval) {
+    static const char *const NAMES[] = {"acc", "ix", "cf", "vf", "nf", "zf",
+                                        "ibuf", "if", "obuf", "of"};
+    Uword *regs[] = {&cpub->acc, &cpub->ix,        &cpub->cf,
+                     &cpub->vf,  &cpub->nf,        &cpub->zf,
+                     &cpub->ibuf->buf, &cpub->ibuf->flag, &cpub->obuf.buf,
+                     &cpub->obuf.flag};
+    unsigned int value;
+    int i, r;
+
+    for (r = 0; r < (int)(sizeof(NAMES) / sizeof(NAMES[0])); r++) {
+        if (!strcmp(regname, NAMES[r])) break;
+    }
+    if (r == (int)(sizeof(NAMES) / sizeof(NAMES[0]))) {
+        fprintf(stderr, "Unknown register name: %s\n", regname);
+        return;
+    }
+    if (sscanf(strval, "%x", &value) != 1 || value > 0xff) {
+        fprintf(stderr, "Invalid value (out of range): %s\n", strval);
+        return;
+    }
+
+    for (i = 0; i < dbg->n_cond; i++) {
+        if (dbg->cond[i].reg == regs[r] && dbg->cond[i].value == value) {
+            dbg->cond[i] = dbg->cond[--dbg->n_cond];
+            return;
+        }
+    }
+    if (dbg->n_cond == MAX_CONDITIONS) {
+        fprintf(stderr, "Too many conditional breakpoints.\n");
+        return;
+    }
+    dbg->cond[dbg->n_cond].name = NAMES[r];
+    dbg->cond[dbg->n_cond].reg = regs[r];
+    dbg->cond[dbg->n_cond].value = value;
+    dbg->n_cond++;
+}
+
+static void clear_all(Debug *dbg, Cpub *cpub) {
+    memset(dbg, 0, sizeof(*dbg));
+    cpub->watch = NULL;
+}
+
+static void list_all(Debug *dbg) {
+    int addr, i;
+
+    for (addr = 0; addr < IMEMORY_SIZE; addr++) {
+        if (BitTest(dbg->bp, addr)) fprintf(stderr, "\tbreak 0x%02x\n", addr);
+    }
+    for (addr = 0; addr < IMEMORY_SIZE; addr++) {
+        const int R = BitTest(dbg->watch.read, addr) != 0;
+        const int W = BitTest(dbg->watch.write, addr) != 0;
+        if (R | W)
+            fprintf(stderr, "\twatch %s%s 0x%03x\n", R ? "r" : "", W ? "w" : "",
+                    0x100 | addr);
+    }
+    for (i = 0; i < dbg->n_cond; i++) {
+        fprintf(stderr, "\tbreak if %s=0x%02x\n", dbg->cond[i].name,
+                dbg->cond[i].value);
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	debug.h
+ *	Descrioption:	breakpoints, watchpoints and conditional breakpoints
+ */
+
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Debugger State of a CPU Board
+ *===========================================================================*/
+#define MAX_CONDITIONS 16
+
+typedef struct condition {
+    const char *name;
+    Uword *reg;
+    Uword value;
+} Condition;
+
+typedef struct debug {
+    Uword bp[IMEMORY_SIZE / 8]; /* PC breakpoint bitmap */
+    int n_bp;
+    Watch watch;
+    int n_watch;
+    Condition cond[MAX_CONDITIONS];
+    int n_cond;
+} Debug;
+
+/* nonzero if anything has to be checked while running */
+#define debug_armed(D) ((D)->n_bp | (D)->n_watch | (D)->n_cond)
+
+int debug_check(Debug *, Cpub *);
+void debug_report(Debug *, Cpub *, int);
+void break_command(Debug *, Cpub *, char *, char *);
+void debug_set_break(Debug *, Addr, int);
+void debug_set_watch(Debug *, Cpub *, Addr, int, int);
+
+#endif /* DEBUG_H */
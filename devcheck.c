@@ -0,0 +1,167 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	devcheck.c
+ *	Descrioption:	check of the idle skipping of the device layer
+ *
+ *	Usage:	devcheck [-c cases]
+ *
+ *	A program polls one of two reloading timers until it has expired a
+ *	number of times, writing the count of the other one to obuf at each
+ *	expiry.  Each case takes random periods and prescalers and runs the
+ *	program to HLT twice, with and without idle skipping.  The board, the
+ *	cycles, the steps and the timer registers must come out the same, and
+ *	the skipping run must have skipped something.  Returns 2 otherwise.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "asm.h"
+#include "cpuboard.h"
+#include "device.h"
+
+#define MAX_STEPS 100000000L
+#define TIMER_A 0x80 /* data offsets of the timers */
+#define TIMER_B 0x88
+
+/* periods and prescalers at 0xf0-0xf3, expiries of timer A at 0xf4 */
+static const char POLL[] =
+    "        LD   ACC,(0xf0)\n"
+    "        ST   ACC,(0x81)\n"
+    "        LD   ACC,(0xf1)\n"
+    "        ST   ACC,(0x82)\n"
+    "        LD   ACC,(0xf2)\n"
+    "        ST   ACC,(0x89)\n"
+    "        LD   ACC,(0xf3)\n"
+    "        ST   ACC,(0x8a)\n"
+    "        LD   ACC,3\n"
+    "        ST   ACC,(0x80)\n"
+    "        ST   ACC,(0x88)\n"
+    "wait:   LD   ACC,(0x83)\n"
+    "        CMP  ACC,0\n"
+    "        BZ   wait\n"
+    "        ST   ACC,(0x83)\n"
+    "        LD   ACC,(0x8c)\n"
+    "        OUT\n"
+    "        LD   ACC,(0x84)\n"
+    "        CMP  ACC,(0xf4)\n"
+    "        BNZ  wait\n"
+    "        HLT\n";
+
+typedef struct board {
+    Cpub cpub;
+    IOBuf ibuf;
+    Bus bus;
+    long steps;
+    int status;
+} Board;
+
+static int run_board(Board *, const Cpub *, int);
+static uint64_t mix64(uint64_t);
+
+int main(int argc, char *argv[]) {
+    static Cpub init;
+    static Board b[2];
+    IOBuf ibuf = {0, 0};
+    long n_cases = 64, n_diff = 0, n_idle = 0, c;
+    unsigned long long skipped = 0;
+    uint64_t x;
+    int opt, k, reg;
+
+    while ((opt = getopt(argc, argv, "c:")) != -1) {
+        switch (opt) {
+            case 'c':
+                n_cases = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-c cases]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (n_cases < 1) {
+        fprintf(stderr, "Invalid value (out of range)\n");
+        return 1;
+    }
+
+    init.ibuf = &ibuf;
+    if (assemble(&init, POLL, sizeof(POLL) - 1) < 0) return 1;
+
+    for (c = 0; c < n_cases; c++) {
+        x = mix64(c + 1);
+        init.mem[0x1f0] = (Uword)x;
+        init.mem[0x1f1] = (Uword)(x >> 8) & 0x0f;
+        init.mem[0x1f2] = (Uword)(x >> 16);
+        init.mem[0x1f3] = (Uword)(x >> 24) & 0x0f;
+        init.mem[0x1f4] = (Uword)(x >> 32) % 8 + 1;
+
+        for (k = 0; k < 2; k++) {
+            if (run_board(&b[k], &init, k) < 0) return 1;
+        }
+        b[0].cpub.ibuf = b[1].cpub.ibuf = NULL;
+        b[0].cpub.mmio = b[1].cpub.mmio = NULL;
+        if (b[0].status != RUN_HALT || b[1].status != RUN_HALT ||
+            b[0].steps > b[1].steps ||
+            memcmp(&b[0].cpub, &b[1].cpub, sizeof(Cpub)) ||
+            b[0].bus.now != b[1].bus.now || b[0].bus.steps != b[1].bus.steps)
+            n_diff++;
+        else {
+            for (reg = 0; reg < 2 * TIMER_SIZE; reg++) {
+                Device *dev = b[0].bus.devices[reg / TIMER_SIZE];
+                Device *ref = b[1].bus.devices[reg / TIMER_SIZE];
+                if (dev->read(&b[0].bus, dev, reg % TIMER_SIZE) !=
+                    ref->read(&b[1].bus, ref, reg % TIMER_SIZE))
+                    break;
+            }
+            if (reg < 2 * TIMER_SIZE) n_diff++;
+        }
+        n_idle += b[0].bus.idle_steps > 0;
+        skipped += b[0].bus.idle_steps;
+
+        for (k = 0; k < 2; k++) {
+            b[k].cpub.mmio = &b[k].bus.mmio;
+            bus_detach(&b[k].bus, &b[k].cpub);
+        }
+    }
+
+    printf("%ld cases of polling two timers\n", n_cases);
+    printf("\tresults: %ld cases differ without idle skipping\n", n_diff);
+    printf("\tskipped: %llu steps, in %ld cases\n", skipped, n_idle);
+    return n_diff || n_idle == 0 ? 2 : 0;
+}
+
+/*
+ *   Runs a copy of init with the two timers to HLT, skipping idle polls
+ *   unless no_skip
+ */
+static int run_board(Board *b, const Cpub *init, int no_skip) {
+    Device *dev;
+
+    memcpy(&b->cpub, init, sizeof(Cpub));
+    b->ibuf = *init->ibuf;
+    b->cpub.ibuf = &b->ibuf;
+    b->cpub.mmio = NULL;
+    if ((dev = timer_new(TIMER_A)) == NULL) return -1;
+    if (bus_add(&b->bus, &b->cpub, dev) < 0) {
+        free(dev);
+        return -1;
+    }
+    if ((dev = timer_new(TIMER_B)) == NULL) return -1;
+    if (bus_add(&b->bus, &b->cpub, dev) < 0) {
+        free(dev);
+        return -1;
+    }
+    b->bus.no_skip = no_skip;
+    b->status = step_n(&b->cpub, MAX_STEPS, &b->steps);
+    return 0;
+}
+
+static uint64_t mix64(uint64_t x) { /* splitmix64 finalizer */
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
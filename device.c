@@ -0,0 +1,383 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	device.c
+ *	Descrioption:	memory-mapped devices, the timer and the event queue
+ *
+ *	Time is counted in the cycles of the board (inst_cycles()), and each
+ *	device has at most one pending event.  A program that polls a device
+ *	register waiting for an event does not run the wait: when a register
+ *	is read from the same instruction in the same board state as before,
+ *	with no store, I/O, bank switch or event in between, the loop can only
+ *	repeat until the next event, so the time jumps to the first pass of
+ *	the loop at or after it.
+ */
+
+#include "device.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wcet.h"
+
+static Uword bus_read(Cpub *, Addr);
+static void bus_write(Cpub *, Addr, Uword);
+static void bus_clock(Cpub *, Uword);
+static void bus_fire(Bus *);
+static void skip_idle(Bus *);
+static void queue_up(Bus *, int);
+static void queue_down(Bus *, int);
+static Uword timer_read(Bus *, Device *, Uword);
+static void timer_write(Bus *, Device *, Uword, Uword);
+static void timer_event(Bus *, Device *);
+static void timer_show(const Device *, FILE *);
+
+/*=============================================================================
+ *   Bus of a CPU Board
+ *===========================================================================*/
+int bus_attach(Bus *bus, Cpub *cpub) {
+    int ir;
+
+    bus_detach(bus, cpub);
+    memset(bus, 0, sizeof(*bus));
+    bus->mmio.read = bus_read;
+    bus->mmio.write = bus_write;
+    bus->mmio.clock = bus_clock;
+    for (ir = 0; ir < 256; ir++) bus->cycles[ir] = inst_cycles(ir);
+    cpub->mmio = &bus->mmio;
+    return 0;
+}
+
+/*
+ *   Removes and frees all the devices
+ */
+void bus_detach(Bus *bus, Cpub *cpub) {
+    int i;
+
+    if (cpub->mmio != &bus->mmio) return;
+    for (i = 0; i < bus->n_devices; i++) free(bus->devices[i]);
+    bus->n_devices = 0;
+    bus->n_queue = 0;
+    cpub->mmio = NULL;
+}
+
+/*
+ *   The bus takes over a device allocated with malloc()
+ */
+int bus_add(Bus *bus, Cpub *cpub, Device *dev) {
+    int off;
+
+    if (cpub->mmio != &bus->mmio && bus_attach(bus, cpub) < 0) return -1;
+    if (bus->n_devices == BUS_MAX_DEVICES) {
+        fprintf(stderr, "Too many devices (max %d)\n", BUS_MAX_DEVICES);
+        return -1;
+    }
+    if (dev->base + dev->size > IMEMORY_SIZE) {
+        fprintf(stderr, "%s at 0x%03x does not fit in the data area\n",
+                dev->name, 0x100 + dev->base);
+        return -1;
+    }
+    for (off = dev->base; off < dev->base + dev->size; off++) {
+        if (bus->at[off] != NULL) {
+            fprintf(stderr, "0x%03x is already a register of %s\n",
+                    0x100 + off, bus->at[off]->name);
+            return -1;
+        }
+    }
+    for (off = dev->base; off < dev->base + dev->size; off++) {
+        bus->at[off] = dev;
+        bus->mmio.map[off >> 3] |= 1 << (off & 0x07);
+    }
+    dev->slot = -1;
+    bus->devices[bus->n_devices++] = dev;
+    return 0;
+}
+
+void bus_show(const Bus *bus, FILE *fp) {
+    int i;
+
+    fprintf(fp, "\tcycles=%llu steps=%lu (idle skipped: %llu cycles, %lu steps)\n",
+            bus->now, bus->steps, bus->idle_cycles, bus->idle_steps);
+    for (i = 0; i < bus->n_devices; i++) {
+        fprintf(fp, "\t%s at 0x%03x:", bus->devices[i]->name,
+                0x100 + bus->devices[i]->base);
+        bus->devices[i]->show(bus->devices[i], fp);
+        if (bus->devices[i]->slot >= 0)
+            fprintf(fp, "  event in %llu cycles",
+                    bus->devices[i]->when - bus->now);
+        fprintf(fp, "\n");
+    }
+}
+
+/*=============================================================================
+ *   Hooks Called by step()
+ *===========================================================================*/
+static Uword bus_read(Cpub *cpub, Addr addr) {
+    Bus *bus = (Bus *)cpub->mmio;
+    Device *dev = bus->at[addr & 0xff];
+    Poll *p = &bus->poll;
+    Poll cur;
+    Uword value;
+
+    cur.valid = 1;
+    cur.pc = step_pc;
+    cur.acc = cpub->acc;
+    cur.ix = cpub->ix;
+    cur.flags = cpub->cf | cpub->vf << 1 | cpub->nf << 2 | cpub->zf << 3 |
+                cpub->ibuf->flag << 4 | cpub->obuf.flag << 5;
+    cur.ibuf = cpub->ibuf->buf;
+    cur.obuf = cpub->obuf.buf;
+    cur.addr = addr;
+    cur.activity = bus->activity;
+    if (!bus->no_skip && p->valid && p->activity == cur.activity &&
+        p->pc == cur.pc && p->addr == cur.addr && p->acc == cur.acc &&
+        p->ix == cur.ix && p->flags == cur.flags && p->ibuf == cur.ibuf &&
+        p->obuf == cur.obuf)
+        skip_idle(bus);
+
+    value = dev->read(bus, dev, (addr & 0xff) - dev->base);
+
+    /*
+     *   Reads of other registers in between keep the snapshot: without any
+     *   activity they change nothing.
+     */
+    if (!p->valid || p->activity != bus->activity ||
+        (p->pc == cur.pc && p->addr == cur.addr)) {
+        *p = cur;
+        p->activity = bus->activity;
+        p->now = bus->now;
+        p->steps = bus->steps;
+    }
+    return value;
+}
+
+static void bus_write(Cpub *cpub, Addr addr, Uword value) {
+    Bus *bus = (Bus *)cpub->mmio;
+    Device *dev = bus->at[addr & 0xff];
+
+    dev->write(bus, dev, (addr & 0xff) - dev->base, value);
+}
+
+/*
+ *   Before each instruction: the time goes on to its end, and the events
+ *   due by then are fired, so that the instruction sees them
+ */
+static void bus_clock(Cpub *cpub, Uword IR) {
+    Bus *bus = (Bus *)cpub->mmio;
+
+    bus->now += bus->cycles[IR];
+    bus->steps++;
+    switch (IR & 0xf0) {
+        case ST:
+        case OUT: /* and IN */
+        case BNK:
+            bus->activity++;
+            break;
+    }
+    if (bus->n_queue && bus->queue[0]->when <= bus->now) bus_fire(bus);
+}
+
+static void bus_fire(Bus *bus) {
+    Device *dev;
+
+    while (bus->n_queue && bus->queue[0]->when <= bus->now) {
+        dev = bus->queue[0];
+        bus_cancel(bus, dev);
+        bus->activity++;
+        dev->event(bus, dev);
+    }
+}
+
+/*
+ *   The board is in the same state as at the last read, one pass of a loop
+ *   ago: the passes repeat exactly until the next event
+ */
+static void skip_idle(Bus *bus) {
+    const unsigned long long PERIOD = bus->now - bus->poll.now;
+    const unsigned long STEPS = bus->steps - bus->poll.steps;
+    unsigned long long k;
+
+    if (bus->n_queue == 0 || PERIOD == 0) return; /* waits forever */
+    if (bus->queue[0]->when <= bus->now) return;
+    k = (bus->queue[0]->when - bus->now + PERIOD - 1) / PERIOD;
+    bus->now += k * PERIOD;
+    bus->steps += k * STEPS;
+    bus->idle_cycles += k * PERIOD;
+    bus->idle_steps += k * STEPS;
+    bus_fire(bus);
+}
+
+/*=============================================================================
+ *   Event Queue
+ *===========================================================================*/
+/*
+ *   (Re)schedules the event of a device at the cycle when
+ */
+void bus_schedule(Bus *bus, Device *dev, unsigned long long when) {
+    bus_cancel(bus, dev);
+    dev->when = when;
+    dev->slot = bus->n_queue++;
+    bus->queue[dev->slot] = dev;
+    queue_up(bus, dev->slot);
+}
+
+void bus_cancel(Bus *bus, Device *dev) {
+    const int SLOT = dev->slot;
+    Device *last;
+
+    if (SLOT < 0) return;
+    dev->slot = -1;
+    last = bus->queue[--bus->n_queue];
+    if (last == dev) return;
+    bus->queue[SLOT] = last;
+    last->slot = SLOT;
+    queue_up(bus, SLOT);
+    queue_down(bus, last->slot);
+}
+
+static void queue_up(Bus *bus, int i) {
+    Device *dev = bus->queue[i];
+
+    while (i > 0 && bus->queue[(i - 1) / 2]->when > dev->when) {
+        bus->queue[i] = bus->queue[(i - 1) / 2];
+        bus->queue[i]->slot = i;
+        i = (i - 1) / 2;
+    }
+    bus->queue[i] = dev;
+    dev->slot = i;
+}
+
+static void queue_down(Bus *bus, int i) {
+    Device *dev = bus->queue[i];
+    int c;
+
+    while ((c = 2 * i + 1) < bus->n_queue) {
+        if (c + 1 < bus->n_queue && bus->queue[c + 1]->when < bus->queue[c]->when)
+            c++;
+        if (bus->queue[c]->when >= dev->when) break;
+        bus->queue[i] = bus->queue[c];
+        bus->queue[i]->slot = i;
+        i = c;
+    }
+    bus->queue[i] = dev;
+    dev->slot = i;
+}
+
+/*=============================================================================
+ *   Timer
+ *===========================================================================*/
+/*
+ *   Counts PERIOD ticks of PRESCALE + 1 cycles from a write of CTRL with the
+ *   enable bit, then sets STATUS and counts up COUNT.  Changes of PERIOD
+ *   and PRESCALE take effect at the next start or reload.
+ */
+typedef struct timer {
+    Device dev; /* first */
+    Uword reg[TIMER_SIZE];
+} Timer;
+
+#define TimerCycles(T)                                                  \
+    ((unsigned long long)((T)->reg[TIMER_PERIOD] ? (T)->reg[TIMER_PERIOD]  \
+                                                 : 256) *               \
+     ((T)->reg[TIMER_PRESCALE] + 1))
+
+Device *timer_new(Uword base) {
+    Timer *t = calloc(1, sizeof(Timer));
+
+    if (t == NULL) {
+        fprintf(stderr, "Unable to allocate a timer\n");
+        return NULL;
+    }
+    t->dev.name = "timer";
+    t->dev.base = base;
+    t->dev.size = TIMER_SIZE;
+    t->dev.read = timer_read;
+    t->dev.write = timer_write;
+    t->dev.event = timer_event;
+    t->dev.show = timer_show;
+    t->dev.slot = -1;
+    return &t->dev;
+}
+
+static Uword timer_read(Bus *bus, Device *dev, Uword reg) {
+    (void)bus;
+    return ((Timer *)dev)->reg[reg];
+}
+
+static void timer_write(Bus *bus, Device *dev, Uword reg, Uword value) {
+    Timer *t = (Timer *)dev;
+
+    switch (reg) {
+        case TIMER_CTRL:
+            t->reg[TIMER_CTRL] = value & (TIMER_ENABLE | TIMER_RELOAD);
+            if (value & TIMER_ENABLE)
+                bus_schedule(bus, dev, bus->now + TimerCycles(t));
+            else
+                bus_cancel(bus, dev);
+            break;
+        case TIMER_PERIOD:
+        case TIMER_PRESCALE:
+            t->reg[reg] = value;
+            break;
+        case TIMER_STATUS:
+            t->reg[TIMER_STATUS] = 0;
+            break;
+        default: /* COUNT is read only */
+            break;
+    }
+}
+
+static void timer_event(Bus *bus, Device *dev) {
+    Timer *t = (Timer *)dev;
+
+    t->reg[TIMER_STATUS] = 1;
+    t->reg[TIMER_COUNT]++;
+    if (t->reg[TIMER_CTRL] & TIMER_RELOAD)
+        bus_schedule(bus, dev, dev->when + TimerCycles(t));
+    else
+        t->reg[TIMER_CTRL] &= ~TIMER_ENABLE;
+}
+
+static void timer_show(const Device *dev, FILE *fp) {
+    const Timer *t = (const Timer *)dev;
+
+    fprintf(fp, " ctrl=%x period=0x%02x prescale=0x%02x status=%x count=0x%02x",
+            t->reg[TIMER_CTRL], t->reg[TIMER_PERIOD], t->reg[TIMER_PRESCALE],
+            t->reg[TIMER_STATUS], t->reg[TIMER_COUNT]);
+}
+
+/*=============================================================================
+ *   Command: Devices
+ *===========================================================================*/
+void device_command(Bus *bus, Cpub *cpub, char *strop, char *straddr) {
+    unsigned int addr;
+    Device *dev;
+
+    if (strop == NULL) {
+        if (cpub->mmio != &bus->mmio)
+            fprintf(stderr, "\tno devices\n");
+        else
+            bus_show(bus, stderr);
+        return;
+    }
+    if (!strcmp(strop, "clear") && straddr == NULL) {
+        bus_detach(bus, cpub);
+        return;
+    }
+    if (strcmp(strop, "timer") || straddr == NULL ||
+        sscanf(straddr, "%x", &addr) != 1) {
+        fprintf(stderr, "Command syntax error. Type \'h\' for help.\n");
+        return;
+    }
+    if (addr < 0x100 || addr >= 0x100 + IMEMORY_SIZE) {
+        fprintf(stderr, "Invalid address (not in the data area): 0x%x\n", addr);
+        return;
+    }
+    if ((dev = timer_new(addr - 0x100)) == NULL) return;
+    if (bus_add(bus, cpub, dev) < 0) {
+        free(dev);
+        return;
+    }
+    bus_show(bus, stderr);
+}
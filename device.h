@@ -0,0 +1,101 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	device.h
+ *	Descrioption:	memory-mapped devices, the timer and the event queue
+ */
+
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <stdio.h>
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Devices
+ *===========================================================================*/
+typedef struct bus Bus;
+typedef struct device Device;
+
+/*
+ *   A device owns the data offsets base..base+size-1.  read must not change
+ *   the device (or it must count the change in bus->activity), so that
+ *   polling it can be skipped.  event is called when the time given to
+ *   bus_schedule() has come.
+ */
+struct device {
+    const char *name;
+    Uword base, size;
+    Uword (*read)(Bus *, Device *, Uword);
+    void (*write)(Bus *, Device *, Uword, Uword);
+    void (*event)(Bus *, Device *);
+    void (*show)(const Device *, FILE *);
+    unsigned long long when; /* of the pending event */
+    int slot;                /* in the event queue, or -1 */
+};
+
+/*=============================================================================
+ *   Bus of a CPU Board
+ *===========================================================================*/
+#define BUS_MAX_DEVICES 8
+
+/*
+ *   The last read of a device register, and the state of the board then
+ */
+typedef struct poll {
+    int valid;
+    Uword pc, acc, ix, flags, ibuf, obuf;
+    Addr addr;
+    unsigned long activity;
+    unsigned long long now;
+    unsigned long steps;
+} Poll;
+
+struct bus {
+    Mmio mmio; /* first: cpub->mmio points here */
+    Device *at[IMEMORY_SIZE];
+    Device *devices[BUS_MAX_DEVICES];
+    int n_devices;
+    Device *queue[BUS_MAX_DEVICES]; /* binary heap by when */
+    int n_queue;
+    Uword cycles[256];       /* of each instruction code */
+    unsigned long long now;  /* simulated cycles */
+    unsigned long steps;     /* executed instructions */
+    unsigned long activity;  /* ST, IN, OUT, BNK and events so far */
+    Poll poll;
+    int no_skip;                    /* run the waits (to check skipping) */
+    unsigned long long idle_cycles; /* skipped */
+    unsigned long idle_steps;
+};
+
+int bus_attach(Bus *, Cpub *);
+void bus_detach(Bus *, Cpub *);
+int bus_add(Bus *, Cpub *, Device *);
+void bus_schedule(Bus *, Device *, unsigned long long);
+void bus_cancel(Bus *, Device *);
+void bus_show(const Bus *, FILE *);
+
+/*=============================================================================
+ *   Timer
+ *===========================================================================*/
+/* registers */
+#define TIMER_CTRL 0     /* bit 0: enable, bit 1: reload on expiry */
+#define TIMER_PERIOD 1   /* ticks to expiry (0: 256) */
+#define TIMER_PRESCALE 2 /* cycles of a tick - 1 */
+#define TIMER_STATUS 3   /* bit 0: expired; any write clears it */
+#define TIMER_COUNT 4    /* expiries (mod 256) */
+#define TIMER_SIZE 5
+
+#define TIMER_ENABLE 0x01
+#define TIMER_RELOAD 0x02
+
+Device *timer_new(Uword);
+
+/*=============================================================================
+ *   Command
+ *===========================================================================*/
+void device_command(Bus *, Cpub *, char *, char *);
+
+#endif /* DEVICE_H */
@@ -0,0 +1,154 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	diffcheck.c
+ *	Descrioption:	differential check of the engines against step()
+ *
+ *	Usage:	diffcheck [-c cases] [-n steps]
+ *
+ *	diffcheck.s, compiled in by cpubgen, uses every IX-modified mode with
+ *	IX+n wrapping in both areas.  Each case starts it from a random data
+ *	area and random registers, and runs it
+ *	    - by run_script() and by the compiled gen_run() with the same
+ *	      random inputs: the stop reason, the steps, the inputs taken, the
+ *	      outputs and the board must be the same;
+ *	    - by step_n() and by packed_step_n() for the same steps: the
+ *	      unpacked board must be the same (CF as 0 or 1).
+ *	Returns 2 if any case differs.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpubgen.h"
+#include "packed.h"
+#include "run.h"
+
+#define MAX_IN 16
+#define MAX_OUT 256
+
+static int same_run(const Cpub *, long);
+static int same_packed(const Cpub *, long);
+static uint64_t mix64(uint64_t);
+
+int main(int argc, char *argv[]) {
+    static Cpub init;
+    IOBuf ibuf = {0, 0};
+    long n_cases = 4096, steps = 20000, c;
+    long n_run = 0, n_packed = 0;
+    uint64_t x;
+    int opt, j;
+
+    while ((opt = getopt(argc, argv, "c:n:")) != -1) {
+        switch (opt) {
+            case 'c':
+                n_cases = atol(optarg);
+                break;
+            case 'n':
+                steps = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-c cases] [-n steps]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (n_cases < 1 || steps < 1) {
+        fprintf(stderr, "Invalid value (out of range)\n");
+        return 1;
+    }
+
+    for (c = 0; c < n_cases; c++) {
+        x = mix64(c + 1);
+        memcpy(init.mem, gen_image, MEMORY_SIZE);
+        for (j = 0; j < IMEMORY_SIZE; j++)
+            init.mem[0x100 + j] = (Uword)(x = mix64(x));
+        init.pc = 0;
+        init.acc = (Uword)(x >> 8);
+        init.ix = (Uword)(x >> 16);
+        init.cf = (x >> 24) & 1;
+        init.vf = (x >> 25) & 1;
+        init.nf = (x >> 26) & 1;
+        init.zf = (x >> 27) & 1;
+        ibuf.flag = (x >> 28) & 1;
+        ibuf.buf = (Uword)(x >> 32);
+        init.ibuf = &ibuf;
+
+        n_run += !same_run(&init, steps);
+        n_packed += !same_packed(&init, steps);
+    }
+
+    printf("%ld cases of up to %ld steps\n", n_cases, steps);
+    printf("\tcpubgen: %ld cases differ from run_script\n", n_run);
+    printf("\tpacked_step: %ld cases differ from step\n", n_packed);
+    return n_run || n_packed ? 2 : 0;
+}
+
+/*
+ *   run_script() against the compiled program, with random inputs
+ */
+static int same_run(const Cpub *init, long steps) {
+    static Cpub c[2];
+    static Uword out[2][MAX_OUT];
+    Uword in[MAX_IN];
+    IOBuf ibuf[2];
+    RunScript rs[2];
+    int status[2], k;
+    uint64_t x = mix64(init->mem[0x1ff] ^ (uint64_t)init->acc << 8);
+
+    for (k = 0; k < MAX_IN; k++) in[k] = (Uword)(x = mix64(x));
+    for (k = 0; k < 2; k++) {
+        memcpy(&c[k], init, sizeof(Cpub));
+        ibuf[k] = *init->ibuf;
+        c[k].ibuf = &ibuf[k];
+        memset(&rs[k], 0, sizeof(RunScript));
+        rs[k].in = in;
+        rs[k].n_in = x % (MAX_IN + 1);
+        rs[k].out = out[k];
+        rs[k].max_out = MAX_OUT;
+        rs[k].stop_out = MAX_OUT;
+    }
+    status[0] = run_script(&c[0], &rs[0], steps);
+    status[1] = gen_run(&c[1], &rs[1], steps);
+
+    if (status[0] != status[1] || rs[0].steps != rs[1].steps ||
+        rs[0].in_pos != rs[1].in_pos || rs[0].n_out != rs[1].n_out ||
+        memcmp(out[0], out[1], rs[0].n_out < MAX_OUT ? rs[0].n_out : MAX_OUT) ||
+        memcmp(&ibuf[0], &ibuf[1], sizeof(IOBuf)))
+        return 0;
+    c[0].ibuf = c[1].ibuf = NULL;
+    return !memcmp(&c[0], &c[1], sizeof(Cpub));
+}
+
+/*
+ *   step_n() against packed_step_n() for the same steps
+ */
+static int same_packed(const Cpub *init, long steps) {
+    static Cpub c, u;
+    static PackedCpub p;
+    IOBuf ibuf = *init->ibuf, b;
+    long done;
+
+    memcpy(&c, init, sizeof(Cpub));
+    c.ibuf = &ibuf;
+    pack_cpub(&p, &c);
+    step_n(&c, steps, &done);
+    packed_step_n(&p, steps, &done);
+
+    u.ibuf = &b;
+    unpack_cpub(&u, &p);
+    return u.pc == c.pc && u.acc == c.acc && u.ix == c.ix &&
+           u.cf == (c.cf != 0) && u.vf == c.vf && u.nf == c.nf &&
+           u.zf == c.zf && b.flag == ibuf.flag && b.buf == ibuf.buf &&
+           u.obuf.flag == c.obuf.flag && u.obuf.buf == c.obuf.buf &&
+           !memcmp(u.mem, c.mem, MEMORY_SIZE);
+}
+
+static uint64_t mix64(uint64_t x) { /* splitmix64 finalizer */
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
@@ -0,0 +1,33 @@
+; Program of the differential check (diffcheck.c): every IX-modified mode,
+; with IX from the data so that IX+n wraps in both areas.  Runs until the
+; counter at (0xfd) expires, then stores into the program area past the
+; code and starts again.
+loop:   BNI  noin
+        IN
+        ST   ACC,(0xfe)
+noin:   LD   IX,(0xfe)
+        LD   ACC,(IX+0xc8)
+        ADD  ACC,[IX+0x9d]
+        ST   ACC,(IX+0x80)
+        SBC  ACC,(IX+0x41)
+        EOR  ACC,[IX+0x10]
+        ADC  ACC,(IX+0xf7)
+        CMP  ACC,[IX+0xe0]
+        BGT  skip
+        OR   ACC,(IX+0x33)
+skip:   SUB  ACC,(IX+0xa0)
+        BC   carry
+        RRA  ACC
+carry:  AND  ACC,[IX+0x7f]
+        ST   ACC,(0xfe)
+        OUT
+        LD   ACC,(0xfd)
+        SUB  ACC,1
+        ST   ACC,(0xfd)
+        BNZ  loop
+        LD   IX,(0xfe)
+        AND  IX,0x1f
+        OR   IX,0x80
+        LD   ACC,(0xfc)
+        ST   ACC,[IX+0xf0]
+        BA   loop
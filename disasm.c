@@ -0,0 +1,213 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	disasm.c
+ *	Descrioption:	table-driven disassembler of the instruction set
+ */
+
+#include "disasm.h"
+
+#include <stdio.h>
+
+/*
+ *   Mnemonics of the sub-modes, in the order of their codes
+ *   (same as enum Shift_Mode and enum Branch in cpuboard.c)
+ */
+static const char *const SHIFT_MNEMONIC[8] = {"SRA", "SLA", "SRL", "SLL",
+                                              "RRA", "RLA", "RRL", "RLL"};
+static const char *const BRANCH_MNEMONIC[16] = {
+    "BA", "BNZ", "BZP", "BP", "BNI", "BNC", "BGE", "BGT",
+    "BVF", "BZ", "BN", "BZN", "BNO", "BC", "BLT", "BLE"};
+
+Decoded decode_table[256];
+
+/*
+ *   Formatted text cache (per thread): one entry per program address, valid
+ *   while the instruction words at that address are unchanged
+ */
+typedef struct disasm_cache {
+    Uword valid;
+    Uword word1;
+    Uword word2;
+    char text[DISASM_TEXT_SIZE];
+} DisasmCache;
+
+static _Thread_local DisasmCache disasm_cache[IMEMORY_SIZE];
+
+static void set_decoded(Uword code, const char *mnemonic, Uword format);
+static void format_operand_b(char *, int, Uword opb, Uword second_word);
+
+/*=============================================================================
+ *   Build the Decode Table (once at startup)
+ *===========================================================================*/
+void init_disasm(void) {
+    int code;
+
+    for (code = 0; code < 256; code++) {
+        const Uword IR = code;
+
+        switch (IR & 0xf0) {
+            case 0x00:
+                if ((IR & 0xf8) == NOP) {
+                    set_decoded(IR, "NOP", FMT_NONE);
+                } else if (((IR & 0xfc) | 0x03) == HLT) {
+                    set_decoded(IR, "HLT", FMT_NONE);
+                } else if (IR == JAL) {
+                    set_decoded(IR, "JAL", FMT_ADDR);
+                } else if (IR == JR) {
+                    set_decoded(IR, "JR", FMT_NONE);
+                } else {
+                    set_decoded(IR, "???", FMT_UNKNOWN);
+                }
+                break;
+            case 0x10:
+                set_decoded(IR, (IR & 0xf8) == OUT ? "OUT" : "IN", FMT_NONE);
+                break;
+            case 0x20:
+                set_decoded(IR, (IR & 0xf8) == RCF ? "RCF" : "SCF", FMT_NONE);
+                break;
+            case LD:
+                set_decoded(IR, "LD", FMT_AB);
+                break;
+            case ST:
+                set_decoded(IR, "ST", FMT_AB);
+                /* ST always fetches the second word */
+                decode_table[IR].length = 2;
+                break;
+            case ADD:
+                set_decoded(IR, "ADD", FMT_AB);
+                break;
+            case ADC:
+                set_decoded(IR, "ADC", FMT_AB);
+                break;
+            case SUB:
+                set_decoded(IR, "SUB", FMT_AB);
+                break;
+            case SBC:
+                set_decoded(IR, "SBC", FMT_AB);
+                break;
+            case CMP:
+                set_decoded(IR, "CMP", FMT_AB);
+                break;
+            case AND:
+                set_decoded(IR, "AND", FMT_AB);
+                break;
+            case OR:
+                set_decoded(IR, "OR", FMT_AB);
+                break;
+            case EOR:
+                set_decoded(IR, "EOR", FMT_AB);
+                break;
+            case SRSM:
+                set_decoded(IR, SHIFT_MNEMONIC[IR & 0x07], FMT_A);
+                break;
+            case BBC:
+                set_decoded(IR, BRANCH_MNEMONIC[IR & 0x0f], FMT_ADDR);
+                break;
+            case BNK:
+                if ((IR & 0x07) == 0)
+                    set_decoded(IR, "BNK", FMT_A);
+                else
+                    set_decoded(IR, "???", FMT_UNKNOWN);
+                break;
+            default:
+                set_decoded(IR, "???", FMT_UNKNOWN);
+                break;
+        }
+    }
+}
+
+static void set_decoded(Uword code, const char *mnemonic, Uword format) {
+    Decoded *d = &decode_table[code];
+    Uword opb = code & 0x07;
+
+    if (opb == 0x03) opb = IMMEDIATE_ADDRESS;
+
+    d->mnemonic = mnemonic;
+    d->format = format;
+    d->opa = code & 0x08;
+    d->opb = opb;
+    switch (format) {
+        case FMT_AB:
+            d->length = (opb == ACC || opb == IX) ? 1 : 2;
+            break;
+        case FMT_ADDR:
+            d->length = 2;
+            break;
+        default:
+            d->length = 1;
+            break;
+    }
+}
+
+/*=============================================================================
+ *   Disassemble an Instruction at a Program Address
+ *===========================================================================*/
+/*
+ *   Returns the number of words of the instruction and sets *text to its
+ *   mnemonic form.  The text is cached per address, so it is formatted only
+ *   when the instruction words have changed since the last call.
+ */
+int disasm(Cpub *cpub, Addr addr, const char **text) {
+    const Uword WORD1 = cpub->mem[addr & 0xff];
+    const Uword WORD2 = cpub->mem[(addr + 1) & 0xff];
+    const Decoded *d = &decode_table[WORD1];
+    DisasmCache *c = &disasm_cache[addr & 0xff];
+    const char *opa;
+    int n;
+
+    *text = c->text;
+    if (c->valid && c->word1 == WORD1 &&
+        (d->length == 1 || c->word2 == WORD2))
+        return d->length;
+
+    opa = (d->opa == ACC) ? "ACC" : "IX";
+    switch (d->format) {
+        case FMT_A:
+            snprintf(c->text, DISASM_TEXT_SIZE, "%s %s", d->mnemonic, opa);
+            break;
+        case FMT_AB:
+            n = snprintf(c->text, DISASM_TEXT_SIZE, "%s %s,", d->mnemonic, opa);
+            format_operand_b(c->text + n, DISASM_TEXT_SIZE - n, d->opb, WORD2);
+            break;
+        case FMT_ADDR:
+            snprintf(c->text, DISASM_TEXT_SIZE, "%s 0x%02x", d->mnemonic,
+                     WORD2);
+            break;
+        default:
+            snprintf(c->text, DISASM_TEXT_SIZE, "%s", d->mnemonic);
+            break;
+    }
+    c->word1 = WORD1;
+    c->word2 = WORD2;
+    c->valid = 1;
+
+    return d->length;
+}
+
+static void format_operand_b(char *buf, int size, Uword opb, Uword second_word) {
+    switch (opb) {
+        case ACC:
+            snprintf(buf, size, "ACC");
+            break;
+        case IX:
+            snprintf(buf, size, "IX");
+            break;
+        case IMMEDIATE_ADDRESS:
+            snprintf(buf, size, "0x%02x", second_word);
+            break;
+        case ABSOLUTE_PROGRAM_ADDRESS:
+            snprintf(buf, size, "[0x%02x]", second_word);
+            break;
+        case ABSOLUTE_DATA_ADDRESS:
+            snprintf(buf, size, "(0x%02x)", second_word);
+            break;
+        case IX_MODIFICATION_PROGRAM_ADDRESS:
+            snprintf(buf, size, "[IX+0x%02x]", second_word);
+            break;
+        case IX_MODIFICATION_DATA_ADDRESS:
+            snprintf(buf, size, "(IX+0x%02x)", second_word);
+            break;
+    }
+}
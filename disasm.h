@@ -0,0 +1,44 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	disasm.h
+ *	Descrioption:	table-driven disassembler of the instruction set
+ */
+
+#ifndef DISASM_H
+#define DISASM_H
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Decode Table
+ *===========================================================================*/
+enum Operand_format {
+    FMT_NONE,    /* NOP, HLT, OUT, IN, RCF, SCF, JR */
+    FMT_A,       /* SRSM, BNK: operand A only */
+    FMT_AB,      /* LD, ST, ALU: operand A and operand B */
+    FMT_ADDR,    /* BBC, JAL: branch address in the second word */
+    FMT_UNKNOWN  /* not an instruction code */
+};
+
+typedef struct decoded {
+    const char *mnemonic;
+    Uword format;  /* enum Operand_format */
+    Uword length;  /* number of words (1 or 2) */
+    Uword opa;     /* operand A (ACC or IX) */
+    Uword opb;     /* operand B (enum Operand_B_3bits) */
+} Decoded;
+
+extern Decoded decode_table[256];
+
+void init_disasm(void);
+
+/*=============================================================================
+ *   Disassembly
+ *===========================================================================*/
+#define DISASM_TEXT_SIZE 24
+
+int disasm(Cpub *, Addr, const char **);
+
+#endif /* DISASM_H */
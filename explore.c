@@ -0,0 +1,627 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	explore.c
+ *	Descrioption:	exhaustive state-space exploration over all inputs
+ *
+ *	The environment is free to deliver any ibuf value at any time, so IN has
+ *	256 successors and BNI has two; every other instruction is executed by
+ *	step() as usual.  A state is (pc, acc, ix, flags, obuf, memory).
+ *
+ *	Memory contents are interned as images identified by a Zobrist hash,
+ *	which is updated incrementally for the one word that an ST changes.
+ *	A frontier state is then 12 bytes, and the visited set holds only a
+ *	48-bit hash (and the BFS level) per state in a lock-free table, so tens
+ *	of millions of states fit in a few hundred megabytes as long as the
+ *	stores make few distinct memory contents.  Each new image costs 520
+ *	bytes and a turn of the one image lock, so a program that stores its
+ *	inputs or counters needs much more memory and scales worse across the
+ *	threads.  Each BFS level is expanded by a pool of threads.
+ *
+ *	The images, the frontiers and the states found by each worker are
+ *	allocated from arenas: a frontier is freed as a whole when the level
+ *	after the next one starts, and each worker has an arena of its own.
+ */
+
+#include "explore.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "disasm.h"
+
+/* memory images per chunk, which fills a slab */
+#define XCHUNK_IMAGES ((ARENA_SLAB_SIZE - ARENA_ALIGN) / sizeof(XImage))
+#define XCHUNK_MAX 65536
+#define XWORK_GRAIN 256 /* frontier states taken at once by a worker */
+#define XDEPTH_MAX 0xffff
+#define MAX_XTHREADS 64
+
+#define BitSet(M, A) ((M)[(A) >> 3] |= (1 << ((A)&0x07)))
+
+/*
+ *   Compact state in a frontier
+ */
+typedef struct xstate {
+    Uword pc;
+    Uword acc;
+    Uword ix;
+    Uword flags; /* cf | vf<<1 | nf<<2 | zf<<3 | obuf.flag<<4 */
+    Uword obuf;
+    Uword pad[3];
+    unsigned int image; /* memory image id */
+} XState;
+
+typedef struct ximage {
+    uint64_t hash;
+    Uword mem[MEMORY_SIZE];
+} XImage;
+
+typedef struct explorer Explorer;
+
+typedef struct xworker {
+    Explorer *ex;
+    pthread_t thread;
+    Arena arena;  /* of next, reset at each level */
+    XState *next; /* states found for the next level */
+    long n_next;
+    long cap_next;
+    ExploreResult res; /* outcomes found by this worker */
+    Uword pc_edge[IMEMORY_SIZE][IMEMORY_SIZE / 8]; /* transitions taken */
+} XWorker;
+
+struct explorer {
+    /* visited set: 48-bit key << 16 | level, 0 is empty */
+    _Atomic uint64_t *visited;
+    uint64_t mask;
+    long max_states;
+    atomic_long n_states;
+    atomic_int full;
+
+    /* memory images */
+    pthread_mutex_t image_lock;
+    Arena image_arena;
+    XImage *chunk[XCHUNK_MAX];
+    unsigned int n_images;
+    unsigned int *image_map; /* open addressing by hash, id + 1 */
+    unsigned int image_mask;
+
+    /* current level */
+    const XState *cur;
+    long n_cur;
+    atomic_long pos;
+    unsigned int depth;
+
+    /* pool: the workers wait for a level, the caller for the workers */
+    pthread_mutex_t pool_lock;
+    pthread_cond_t pool_start;
+    pthread_cond_t pool_done;
+    unsigned long n_levels; /* started on the pool */
+    int n_busy;
+    int stop;
+};
+
+static uint64_t zobrist[MEMORY_SIZE][256];
+static pthread_once_t zobrist_once = PTHREAD_ONCE_INIT;
+
+static void init_zobrist(void);
+static uint64_t mix64(uint64_t);
+static uint64_t state_hash(Explorer *, const XState *);
+static int visit(Explorer *, uint64_t, unsigned int, unsigned int *);
+static long intern_image(Explorer *, uint64_t, const Uword *);
+static int grow_image_map(Explorer *);
+static XImage *image_at(Explorer *, unsigned int);
+static void *pool_worker(void *);
+static void expand_level(XWorker *);
+static void expand(XWorker *, const XState *);
+static void emit(XWorker *, const XState *, Cpub *, unsigned int);
+static void save_state(XState *, const Cpub *);
+static void merge_result(ExploreResult *, const ExploreResult *);
+static void find_loops(Uword (*)[IMEMORY_SIZE / 8], const Cpub *, int,
+                       ExploreResult *);
+static void dfs_loops(Uword (*)[IMEMORY_SIZE / 8], int, Uword *,
+                      ExploreResult *);
+
+/*=============================================================================
+ *   Explore All States Reachable from the Initial States
+ *===========================================================================*/
+int explore(const Cpub *init, int n_init, long max_states, int n_threads,
+            ExploreResult *res) {
+    Explorer *ex;
+    XWorker *w;
+    Arena level[2] = {ARENA_INIT, ARENA_INIT}; /* frontiers, by depth & 1 */
+    XState *frontier, s;
+    long n_frontier, i, slots;
+    unsigned int depth;
+    int t, n_workers = 0, status = -1;
+
+    pthread_once(&zobrist_once, init_zobrist);
+    memset(res, 0, sizeof(*res));
+    if (n_threads <= 0) n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads <= 0) n_threads = 1;
+    if (n_threads > MAX_XTHREADS) n_threads = MAX_XTHREADS;
+
+    /* the visited set is kept at most 3/4 full */
+    for (slots = 1024; slots < max_states + max_states / 3; slots <<= 1)
+        ;
+    ex = calloc(1, sizeof(Explorer));
+    w = calloc(n_threads, sizeof(XWorker));
+    frontier =
+        arena_alloc(&level[0], sizeof(XState) * (n_init > 0 ? n_init : 1));
+    if (ex == NULL || w == NULL || frontier == NULL) goto out;
+    ex->visited = calloc(slots, sizeof(uint64_t));
+    ex->image_mask = 1023;
+    ex->image_map = calloc(ex->image_mask + 1, sizeof(unsigned int));
+    if (ex->visited == NULL || ex->image_map == NULL) goto out;
+    ex->mask = slots - 1;
+    ex->max_states = max_states;
+    pthread_mutex_init(&ex->image_lock, NULL);
+    pthread_mutex_init(&ex->pool_lock, NULL);
+    pthread_cond_init(&ex->pool_start, NULL);
+    pthread_cond_init(&ex->pool_done, NULL);
+    for (t = 0; t < n_threads; t++) w[t].ex = ex;
+
+    /*
+     *   Level 0: the initial states
+     */
+    n_frontier = 0;
+    for (i = 0; i < n_init; i++) {
+        uint64_t h = 0;
+        int a;
+        long id;
+
+        for (a = 0; a < MEMORY_SIZE; a++) h ^= zobrist[a][init[i].mem[a]];
+        if ((id = intern_image(ex, h, init[i].mem)) < 0) goto out;
+        save_state(&s, &init[i]);
+        s.image = id;
+        if (visit(ex, state_hash(ex, &s), 0, NULL))
+            frontier[n_frontier++] = s;
+    }
+
+    /*
+     *   Expand level by level.  The threads are started once and wait for
+     *   each level; a level of one grain is expanded by the caller alone,
+     *   as deep and narrow spaces have thousands of them.
+     */
+    for (; n_workers < n_threads; n_workers++) {
+        if (pthread_create(&w[n_workers].thread, NULL, pool_worker,
+                           &w[n_workers]) != 0)
+            break;
+    }
+    for (depth = 0; n_frontier > 0; depth++) {
+        ex->cur = frontier;
+        ex->n_cur = n_frontier;
+        ex->depth = depth;
+        atomic_store(&ex->pos, 0);
+        for (t = 0; t < n_threads; t++) {
+            w[t].n_next = 0;
+            w[t].cap_next = 0;
+            arena_reset(&w[t].arena);
+        }
+        if (n_frontier <= XWORK_GRAIN || n_workers == 0) {
+            expand_level(&w[0]); /* the pool is waiting */
+        } else {
+            pthread_mutex_lock(&ex->pool_lock);
+            ex->n_levels++;
+            ex->n_busy = n_workers;
+            pthread_cond_broadcast(&ex->pool_start);
+            while (ex->n_busy > 0)
+                pthread_cond_wait(&ex->pool_done, &ex->pool_lock);
+            pthread_mutex_unlock(&ex->pool_lock);
+        }
+        n_frontier = 0;
+        for (t = 0; t < n_threads; t++) n_frontier += w[t].n_next;
+        arena_reset(&level[(depth + 1) & 1]);
+        frontier = arena_alloc(&level[(depth + 1) & 1],
+                               sizeof(XState) * (n_frontier + 1));
+        if (frontier == NULL) goto out;
+        for (t = 0, i = 0; t < n_threads; t++) {
+            memcpy(frontier + i, w[t].next, sizeof(XState) * w[t].n_next);
+            i += w[t].n_next;
+        }
+        if (atomic_load(&ex->full)) break;
+    }
+
+    for (t = 0; t < n_threads; t++) {
+        merge_result(res, &w[t].res);
+        for (i = 0; i < IMEMORY_SIZE * IMEMORY_SIZE / 8; i++)
+            (&w[0].pc_edge[0][0])[i] |= (&w[t].pc_edge[0][0])[i];
+    }
+    find_loops(w[0].pc_edge, init, n_init, res);
+    res->states = atomic_load(&ex->n_states);
+    res->depth = depth;
+    res->full = atomic_load(&ex->full);
+    status = 0;
+
+out:
+    if (n_workers > 0) {
+        pthread_mutex_lock(&ex->pool_lock);
+        ex->stop = 1;
+        pthread_cond_broadcast(&ex->pool_start);
+        pthread_mutex_unlock(&ex->pool_lock);
+        for (t = 0; t < n_workers; t++) pthread_join(w[t].thread, NULL);
+    }
+    if (ex != NULL) {
+        arena_destroy(&ex->image_arena);
+        free(ex->image_map);
+        free((void *)ex->visited);
+        free(ex);
+    }
+    if (w != NULL) {
+        for (t = 0; t < n_threads; t++) arena_destroy(&w[t].arena);
+        free(w);
+    }
+    arena_destroy(&level[0]);
+    arena_destroy(&level[1]);
+    return status;
+}
+
+/*=============================================================================
+ *   Worker: Expand States of the Current Level
+ *===========================================================================*/
+static void *pool_worker(void *arg) {
+    XWorker *w = arg;
+    Explorer *ex = w->ex;
+    unsigned long n_levels = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&ex->pool_lock);
+        while (ex->n_levels == n_levels && !ex->stop)
+            pthread_cond_wait(&ex->pool_start, &ex->pool_lock);
+        if (ex->stop) {
+            pthread_mutex_unlock(&ex->pool_lock);
+            return NULL;
+        }
+        n_levels = ex->n_levels;
+        pthread_mutex_unlock(&ex->pool_lock);
+
+        expand_level(w);
+
+        pthread_mutex_lock(&ex->pool_lock);
+        if (--ex->n_busy == 0) pthread_cond_signal(&ex->pool_done);
+        pthread_mutex_unlock(&ex->pool_lock);
+    }
+}
+
+static void expand_level(XWorker *w) {
+    Explorer *ex = w->ex;
+    long i, begin;
+
+    while ((begin = atomic_fetch_add(&ex->pos, XWORK_GRAIN)) < ex->n_cur) {
+        for (i = begin; i < begin + XWORK_GRAIN && i < ex->n_cur; i++) {
+            if (atomic_load_explicit(&ex->full, memory_order_relaxed))
+                return;
+            expand(w, &ex->cur[i]);
+        }
+    }
+}
+
+static void expand(XWorker *w, const XState *s) {
+    Explorer *ex = w->ex;
+    const XImage *img = image_at(ex, s->image);
+    const Uword PC = s->pc;
+    const Uword IR = img->mem[PC];
+    const Uword SECOND_WORD = img->mem[(PC + 1) & 0xff];
+    const Decoded *d = &decode_table[IR];
+    IOBuf ibuf = {0, 0};
+    Cpub c;
+    Addr ea = 0;
+    Uword old;
+    int v;
+
+    /*
+     *   Outcomes that stop a path
+     */
+    if (((IR & 0xfc) | 0x03) == HLT) {
+        w->res.halts++;
+        BitSet(w->res.halt_pc, PC);
+        return;
+    }
+    /* BNK too: the explored board has no extended memory */
+    if (d->format == FMT_UNKNOWN || (IR & 0xf0) == BNK ||
+        ((IR & 0xf0) == ST && d->opb < ABSOLUTE_PROGRAM_ADDRESS)) {
+        w->res.illegals++;
+        BitSet(w->res.illegal_pc, PC);
+        return;
+    }
+
+    c.pc = PC;
+    c.acc = s->acc;
+    c.ix = s->ix;
+    c.cf = s->flags & 1;
+    c.vf = (s->flags >> 1) & 1;
+    c.nf = (s->flags >> 2) & 1;
+    c.zf = (s->flags >> 3) & 1;
+    c.obuf.flag = (s->flags >> 4) & 1;
+    c.obuf.buf = s->obuf;
+    c.ibuf = &ibuf;
+    c.watch = NULL;
+    c.mmio = NULL;
+    c.xmem = NULL;
+    memcpy(c.mem, img->mem, MEMORY_SIZE);
+
+    if ((IR & 0xf8) == 0x18) { /* IN: any input value */
+        for (v = 0; v < 256; v++) {
+            c.pc = PC;
+            ibuf.buf = v;
+            ibuf.flag = 1;
+            step(&c);
+            emit(w, s, &c, s->image);
+        }
+        return;
+    }
+    if (IR == (BBC | 0x04)) { /* BNI: with and without an input */
+        for (v = 0; v < 2; v++) {
+            c.pc = PC;
+            ibuf.flag = v;
+            step(&c);
+            emit(w, s, &c, s->image);
+        }
+        return;
+    }
+    if ((IR & 0xf0) != ST) {
+        step(&c);
+        emit(w, s, &c, s->image);
+        return;
+    }
+
+    /*
+     *   ST: update the memory hash for the stored word only
+     */
+    switch (d->opb) {
+        case ABSOLUTE_PROGRAM_ADDRESS:
+            ea = SECOND_WORD;
+            break;
+        case ABSOLUTE_DATA_ADDRESS:
+            ea = 0x100 + SECOND_WORD;
+            break;
+        case IX_MODIFICATION_PROGRAM_ADDRESS:
+            ea = (Uword)(s->ix + SECOND_WORD);
+            break;
+        case IX_MODIFICATION_DATA_ADDRESS:
+            ea = 0x100 + (Uword)(s->ix + SECOND_WORD);
+            break;
+    }
+    old = c.mem[ea];
+    step(&c);
+    if (c.mem[ea] == old) {
+        emit(w, s, &c, s->image);
+    } else {
+        const uint64_t H =
+            img->hash ^ zobrist[ea][old] ^ zobrist[ea][c.mem[ea]];
+        const long ID = intern_image(ex, H, c.mem);
+        if (ID < 0) {
+            atomic_store(&ex->full, 1);
+            return;
+        }
+        emit(w, s, &c, ID);
+    }
+}
+
+static void emit(XWorker *w, const XState *from, Cpub *c, unsigned int image) {
+    Explorer *ex = w->ex;
+    XState s;
+
+    save_state(&s, c);
+    s.image = image;
+    w->res.transitions++;
+    BitSet(w->pc_edge[from->pc], s.pc);
+
+    if (!visit(ex, state_hash(ex, &s), ex->depth + 1, NULL)) return;
+
+    if (w->n_next == w->cap_next) {
+        /* the old array is freed with the arena */
+        long cap = w->cap_next ? w->cap_next * 2 : 4096;
+        XState *next = arena_alloc(&w->arena, sizeof(XState) * cap);
+        if (next == NULL) {
+            atomic_store(&ex->full, 1);
+            return;
+        }
+        if (w->n_next) memcpy(next, w->next, sizeof(XState) * w->n_next);
+        w->next = next;
+        w->cap_next = cap;
+    }
+    w->next[w->n_next++] = s;
+}
+
+/*=============================================================================
+ *   Visited Set (lock-free)
+ *===========================================================================*/
+/*
+ *   Returns 1 if the state is new.  Otherwise returns 0 and sets *depth to
+ *   the level at which the state was found first.
+ */
+static int visit(Explorer *ex, uint64_t h, unsigned int depth,
+                 unsigned int *found) {
+    uint64_t key = h >> 16;
+    uint64_t i, e, entry;
+
+    if (key == 0) key = 1;
+    if (depth > XDEPTH_MAX) depth = XDEPTH_MAX;
+    entry = (key << 16) | depth;
+
+    for (i = h & ex->mask;; i = (i + 1) & ex->mask) {
+        e = atomic_load_explicit(&ex->visited[i], memory_order_relaxed);
+        while (e == 0) {
+            if (atomic_fetch_add(&ex->n_states, 1) >= ex->max_states) {
+                atomic_fetch_sub(&ex->n_states, 1);
+                atomic_store(&ex->full, 1);
+                return 0;
+            }
+            if (atomic_compare_exchange_weak(&ex->visited[i], &e, entry))
+                return 1;
+            atomic_fetch_sub(&ex->n_states, 1);
+        }
+        if ((e >> 16) == key) {
+            if (found != NULL) *found = e & 0xffff;
+            return 0;
+        }
+    }
+}
+
+static uint64_t state_hash(Explorer *ex, const XState *s) {
+    const uint64_t REGS = (uint64_t)s->pc | (uint64_t)s->acc << 8 |
+                          (uint64_t)s->ix << 16 | (uint64_t)s->flags << 24 |
+                          (uint64_t)s->obuf << 32;
+    return mix64(REGS ^ image_at(ex, s->image)->hash);
+}
+
+/*=============================================================================
+ *   Memory Images
+ *===========================================================================*/
+/*
+ *   Returns the id of the image with the given contents, adding it if new.
+ */
+static long intern_image(Explorer *ex, uint64_t hash, const Uword *mem) {
+    unsigned int i, id;
+    XImage *img;
+
+    pthread_mutex_lock(&ex->image_lock);
+    for (i = hash & ex->image_mask; ex->image_map[i];
+         i = (i + 1) & ex->image_mask) {
+        img = image_at(ex, ex->image_map[i] - 1);
+        if (img->hash == hash && !memcmp(img->mem, mem, MEMORY_SIZE)) {
+            pthread_mutex_unlock(&ex->image_lock);
+            return ex->image_map[i] - 1;
+        }
+    }
+
+    /* keep the map at most half full, or the probes above may not end */
+    if ((ex->n_images + 1) * 2 > ex->image_mask) {
+        if (grow_image_map(ex) < 0) goto error;
+        for (i = hash & ex->image_mask; ex->image_map[i];
+             i = (i + 1) & ex->image_mask)
+            ;
+    }
+
+    id = ex->n_images;
+    if (id % XCHUNK_IMAGES == 0) {
+        if (id / XCHUNK_IMAGES == XCHUNK_MAX ||
+            (ex->chunk[id / XCHUNK_IMAGES] = arena_alloc(
+                 &ex->image_arena, sizeof(XImage) * XCHUNK_IMAGES)) == NULL)
+            goto error;
+    }
+    img = image_at(ex, id);
+    img->hash = hash;
+    memcpy(img->mem, mem, MEMORY_SIZE);
+    ex->n_images++;
+    ex->image_map[i] = id + 1;
+    pthread_mutex_unlock(&ex->image_lock);
+    return id;
+
+error:
+    pthread_mutex_unlock(&ex->image_lock);
+    return -1;
+}
+
+/*
+ *   Doubles the image map; returns 0, or -1 if out of memory
+ */
+static int grow_image_map(Explorer *ex) {
+    const unsigned int MASK = ex->image_mask * 2 + 1;
+    unsigned int *map, j, k;
+
+    if (MASK < ex->image_mask ||
+        (map = calloc((size_t)MASK + 1, sizeof(unsigned int))) == NULL)
+        return -1;
+    for (j = 0; j <= ex->image_mask; j++) {
+        if (!ex->image_map[j]) continue;
+        k = image_at(ex, ex->image_map[j] - 1)->hash & MASK;
+        while (map[k]) k = (k + 1) & MASK;
+        map[k] = ex->image_map[j];
+    }
+    free(ex->image_map);
+    ex->image_map = map;
+    ex->image_mask = MASK;
+    return 0;
+}
+
+static XImage *image_at(Explorer *ex, unsigned int id) {
+    return &ex->chunk[id / XCHUNK_IMAGES][id % XCHUNK_IMAGES];
+}
+
+/*=============================================================================
+ *   Helpers
+ *===========================================================================*/
+static void init_zobrist(void) {
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    int a, v;
+
+    for (a = 0; a < MEMORY_SIZE; a++) {
+        for (v = 0; v < 256; v++) zobrist[a][v] = mix64(x += 0x9e3779b97f4a7c15ULL);
+    }
+}
+
+static uint64_t mix64(uint64_t x) { /* splitmix64 finalizer */
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static void save_state(XState *s, const Cpub *c) {
+    s->pc = c->pc;
+    s->acc = c->acc;
+    s->ix = c->ix;
+    s->flags = (c->cf != 0) | (c->vf != 0) << 1 | (c->nf != 0) << 2 |
+               (c->zf != 0) << 3 | (c->obuf.flag != 0) << 4;
+    s->obuf = c->obuf.buf;
+    s->pad[0] = s->pad[1] = s->pad[2] = 0;
+}
+
+static void merge_result(ExploreResult *res, const ExploreResult *w) {
+    int i;
+
+    res->transitions += w->transitions;
+    res->halts += w->halts;
+    res->illegals += w->illegals;
+    for (i = 0; i < IMEMORY_SIZE / 8; i++) {
+        res->halt_pc[i] |= w->halt_pc[i];
+        res->illegal_pc[i] |= w->illegal_pc[i];
+    }
+}
+
+/*=============================================================================
+ *   Loops of the Control Flow
+ *===========================================================================*/
+/*
+ *   A depth-first search over the PC transitions taken from the initial
+ *   PCs.  An edge to a PC on the search stack closes a cycle, so only the
+ *   edges of real loops are reported; a path that merely joins a state
+ *   found earlier is not one.
+ */
+#define DFS_NEW 0
+#define DFS_ON_STACK 1
+#define DFS_DONE 2
+
+static void find_loops(Uword (*edge)[IMEMORY_SIZE / 8], const Cpub *init,
+                       int n_init, ExploreResult *res) {
+    Uword mark[IMEMORY_SIZE];
+    int i;
+
+    memset(mark, DFS_NEW, sizeof(mark));
+    for (i = 0; i < n_init; i++)
+        if (mark[init[i].pc] == DFS_NEW) dfs_loops(edge, init[i].pc, mark, res);
+}
+
+static void dfs_loops(Uword (*edge)[IMEMORY_SIZE / 8], int pc, Uword *mark,
+                      ExploreResult *res) {
+    int to;
+
+    mark[pc] = DFS_ON_STACK;
+    for (to = 0; to < IMEMORY_SIZE; to++) {
+        if (!(edge[pc][to >> 3] & (1 << (to & 0x07)))) continue;
+        if (mark[to] == DFS_ON_STACK) {
+            res->loops++;
+            BitSet(res->loop_edge[pc], to);
+        } else if (mark[to] == DFS_NEW) {
+            dfs_loops(edge, to, mark, res);
+        }
+    }
+    mark[pc] = DFS_DONE;
+}
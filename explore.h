@@ -0,0 +1,32 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	explore.h
+ *	Descrioption:	exhaustive state-space exploration over all inputs
+ */
+
+#ifndef EXPLORE_H
+#define EXPLORE_H
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Result of an Exploration
+ *===========================================================================*/
+typedef struct explore_result {
+    long states;      /* distinct reachable states */
+    long transitions; /* executed transitions */
+    int depth;        /* number of BFS levels */
+    int full;         /* stopped at the state limit */
+    long halts;       /* states at HLT */
+    long illegals;    /* states at an illegal instruction */
+    long loops;       /* back edges of the loops in the control flow */
+    Uword halt_pc[IMEMORY_SIZE / 8];    /* PC bitmaps of the outcomes */
+    Uword illegal_pc[IMEMORY_SIZE / 8];
+    Uword loop_edge[IMEMORY_SIZE][IMEMORY_SIZE / 8]; /* from PC -> to PC */
+} ExploreResult;
+
+int explore(const Cpub *, int, long, int, ExploreResult *);
+
+#endif /* EXPLORE_H */
@@ -0,0 +1,326 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	fuzz.c
+ *	Descrioption:	coverage-guided fuzzing of inputs and data
+ *
+ *	Every execution starts from a packed snapshot of the board, with the data
+ *	area and the input stream of a test case, and runs on packed_step().
+ *	Each step records its (prev_pc, pc) edge into a 64K map of hit counts;
+ *	as PCs are 8 bits the edge is the index itself, so no two edges collide.
+ *	The counts are bucketed as AFL does (1, 2, 3, 4-7, 8-15, 16-31, 32-127,
+ *	128-) and a case is kept when it reaches a bucket never seen before.
+ *	Only the entries touched by a run are examined and cleared, so a short
+ *	run does not pay for the whole map.
+ */
+
+#include "fuzz.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "disasm.h"
+#include "packed.h"
+
+#define FUZZ_MAX_CORPUS 16384
+#define FUZZ_HAVOC 256 /* mutated cases per pick of the corpus */
+
+/* outcomes of an execution */
+#define FUZZ_HALT 0
+#define FUZZ_FAULT 1
+#define FUZZ_WAIT 2
+#define FUZZ_HANG 3
+
+typedef struct fuzzer {
+    PackedCpub base; /* the board as the fuzzing started */
+    PackedCpub run;
+    uint8_t trace[FUZZ_MAP_SIZE];  /* hit counts of the current run */
+    uint8_t virgin[FUZZ_MAP_SIZE]; /* buckets never seen so far */
+    uint16_t touched[FUZZ_MAP_SIZE];
+    int n_touched;
+    FuzzCase *corpus[FUZZ_MAX_CORPUS];
+    int n_corpus;
+    Uword addr[IMEMORY_SIZE]; /* data addresses named by the program */
+    int n_addr;
+    Uword dict[IMEMORY_SIZE]; /* immediate operands of the program */
+    int n_dict;
+    uint64_t rng;
+} Fuzzer;
+
+static void scan_program(Fuzzer *);
+static int execute(Fuzzer *, const FuzzCase *, long, Uword *);
+static int new_coverage(Fuzzer *, int *);
+static void mutate(Fuzzer *, FuzzCase *);
+static unsigned int rnd(Fuzzer *, unsigned int);
+
+static uint8_t bucket[256];
+
+/*=============================================================================
+ *   Fuzzing Loop
+ *===========================================================================*/
+/*
+ *   Runs execs mutated cases of at most max_steps steps each.  Returns -1 if
+ *   the memory of the fuzzer cannot be allocated.
+ */
+int fuzz(const Cpub *cpub, long execs, long max_steps, unsigned long seed,
+         FuzzResult *res) {
+    Arena arena = ARENA_INIT;
+    struct timespec t0, t1;
+    FuzzCase tc;
+    Fuzzer *f;
+    Uword pc;
+    int i, k, outcome, cycle;
+
+    f = arena_alloc(&arena, sizeof(Fuzzer));
+    if (f == NULL) return -1;
+    for (i = 1; i < 256; i++)
+        bucket[i] = i < 4 ? 1 << (i - 1) : i < 8 ? 8 : i < 16 ? 16
+                  : i < 32 ? 32 : i < 128 ? 64 : 128;
+    memset(res, 0, sizeof(*res));
+    memset(f->trace, 0, sizeof(f->trace));
+    memset(f->virgin, 0xff, sizeof(f->virgin));
+    f->rng = seed * 0x9e3779b97f4a7c15ULL + 1;
+    pack_cpub(&f->base, cpub);
+    f->base.quiet = 1;
+    scan_program(f);
+
+    /* the seed: the data as it is, and no input */
+    f->corpus[0] = arena_alloc(&arena, sizeof(FuzzCase));
+    if (f->corpus[0] == NULL) {
+        arena_destroy(&arena);
+        return -1;
+    }
+    f->corpus[0]->n_in = 0;
+    memcpy(f->corpus[0]->data, cpub->mem + IMEMORY_SIZE, IMEMORY_SIZE);
+    f->n_corpus = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (cycle = 0; res->execs < execs; cycle++) {
+        const FuzzCase *PICK = f->corpus[cycle % f->n_corpus];
+
+        for (k = 0; k < FUZZ_HAVOC && res->execs < execs; k++) {
+            tc = *PICK;
+            if (res->execs) mutate(f, &tc);
+            outcome = execute(f, &tc, max_steps, &pc);
+            res->execs++;
+            if (outcome == FUZZ_HALT) res->halts++;
+            if (outcome == FUZZ_WAIT) res->waits++;
+            if (outcome == FUZZ_HANG) res->hangs++;
+            if (outcome == FUZZ_FAULT) {
+                res->faults++;
+                if (!(res->fault_pc[pc >> 3] & (1 << (pc & 7)))) {
+                    res->fault_pc[pc >> 3] |= 1 << (pc & 7);
+                    res->fault[pc] = tc;
+                }
+            }
+            if (new_coverage(f, &res->edges) && outcome != FUZZ_FAULT &&
+                f->n_corpus < FUZZ_MAX_CORPUS) {
+                FuzzCase *keep = arena_alloc(&arena, sizeof(FuzzCase));
+
+                if (keep == NULL) break;
+                *keep = tc;
+                f->corpus[f->n_corpus++] = keep;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    res->seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    res->corpus = f->n_corpus;
+    for (i = 0; i < FUZZ_MAP_SIZE; i++)
+        if (f->virgin[i] != 0xff) res->reached[i >> 11] |= 1 << ((i >> 8) & 7);
+    arena_destroy(&arena);
+    return 0;
+}
+
+/*
+ *   Addresses and values that the program itself names are tried more
+ *   often than the others, as CMP #d and LD (d) are what guard a branch.
+ */
+static void scan_program(Fuzzer *f) {
+    Uword seen_addr[IMEMORY_SIZE / 8], seen_dict[IMEMORY_SIZE / 8];
+    const Uword *mem = f->base.mem;
+    int pc;
+
+    memset(seen_addr, 0, sizeof(seen_addr));
+    memset(seen_dict, 0, sizeof(seen_dict));
+    f->n_addr = f->n_dict = 0;
+    for (pc = 0; pc < IMEMORY_SIZE; pc += decode_table[mem[pc]].length) {
+        const Decoded *d = &decode_table[mem[pc]];
+        const Uword D = mem[(pc + 1) & 0xff];
+
+        if (d->format != FMT_AB) continue;
+        if ((d->opb & ~1) == IMMEDIATE_ADDRESS) {
+            if (!(seen_dict[D >> 3] & (1 << (D & 7)))) {
+                seen_dict[D >> 3] |= 1 << (D & 7);
+                f->dict[f->n_dict++] = D;
+            }
+        } else if (d->opb == ABSOLUTE_DATA_ADDRESS ||
+                   d->opb == IX_MODIFICATION_DATA_ADDRESS) {
+            if (!(seen_addr[D >> 3] & (1 << (D & 7)))) {
+                seen_addr[D >> 3] |= 1 << (D & 7);
+                f->addr[f->n_addr++] = D;
+            }
+        }
+    }
+}
+
+/*=============================================================================
+ *   One Execution
+ *===========================================================================*/
+/*
+ *   As run_script does, an input is put into ibuf whenever it is empty and
+ *   every output is taken.  A run ends at HLT, at an illegal instruction
+ *   (its PC into *fault_pc), at the step limit, or when a BNI loops back
+ *   with no input left, as nothing could ever change after that.
+ */
+static int execute(Fuzzer *f, const FuzzCase *tc, long max_steps,
+                   Uword *fault_pc) {
+    PackedCpub *p = &f->run;
+    int in_pos = 0, status = RUN_STEP;
+    Uword prev, c;
+    long n;
+
+    memcpy(p, &f->base, offsetof(PackedCpub, mem) + IMEMORY_SIZE);
+    memcpy(p->mem + IMEMORY_SIZE, tc->data, IMEMORY_SIZE);
+    f->n_touched = 0;
+
+    for (n = 0; n < max_steps; n++) {
+        if (!p->ibuf.flag && in_pos < tc->n_in) {
+            p->ibuf.buf = tc->in[in_pos++];
+            p->ibuf.flag = 1;
+        }
+        prev = p->pc;
+        status = packed_step(p);
+        p->obuf.flag = 0;
+
+        {
+            const uint16_t EDGE = prev << 8 | p->pc;
+
+            c = f->trace[EDGE];
+            if (c == 0) f->touched[f->n_touched++] = EDGE;
+            f->trace[EDGE] = c + (c != 0xff);
+        }
+
+        if (status != RUN_STEP) {
+            c = p->mem[prev];
+            if (((c & 0xfc) | 0x03) == HLT) return FUZZ_HALT;
+            *fault_pc = prev;
+            return FUZZ_FAULT;
+        }
+        if (p->pc <= prev && !p->ibuf.flag && in_pos == tc->n_in &&
+            p->mem[prev] == (BBC | 0x4))
+            return FUZZ_WAIT;
+    }
+    return FUZZ_HANG;
+}
+
+/*
+ *   Merges the trace of the run into the coverage and clears it.  Returns
+ *   nonzero if a bucket of an edge is new; *edges counts new edges.
+ */
+static int new_coverage(Fuzzer *f, int *edges) {
+    int i, found = 0;
+
+    for (i = 0; i < f->n_touched; i++) {
+        const uint16_t EDGE = f->touched[i];
+        const uint8_t B = bucket[f->trace[EDGE]];
+
+        f->trace[EDGE] = 0;
+        if (f->virgin[EDGE] & B) {
+            if (f->virgin[EDGE] == 0xff) (*edges)++;
+            f->virgin[EDGE] &= ~B;
+            found = 1;
+        }
+    }
+    return found;
+}
+
+/*=============================================================================
+ *   Mutation
+ *===========================================================================*/
+static Uword any_value(Fuzzer *f) {
+    static const Uword INTERESTING[] = {0x00, 0x01, 0x7f, 0x80, 0xff};
+
+    switch (rnd(f, 4)) {
+        case 0:
+            return INTERESTING[rnd(f, sizeof(INTERESTING))];
+        case 1:
+            if (f->n_dict) return f->dict[rnd(f, f->n_dict)] + rnd(f, 3) - 1;
+            /* FALLTHROUGH */
+        default:
+            return rnd(f, 256);
+    }
+}
+
+static Uword any_addr(Fuzzer *f) {
+    if (f->n_addr && rnd(f, 4)) return f->addr[rnd(f, f->n_addr)];
+    return rnd(f, IMEMORY_SIZE);
+}
+
+/*
+ *   A stack of 2 to 16 changes to the data area and the input stream
+ */
+static void mutate(Fuzzer *f, FuzzCase *tc) {
+    int n = 2 << rnd(f, 4), i;
+
+    while (n--) {
+        switch (rnd(f, 8)) {
+            case 0:
+                tc->data[any_addr(f)] ^= 1 << rnd(f, 8);
+                break;
+            case 1:
+                tc->data[any_addr(f)] = any_value(f);
+                break;
+            case 2:
+                tc->data[any_addr(f)] += rnd(f, 2) ? 1 + rnd(f, 16)
+                                                   : -1 - rnd(f, 16);
+                break;
+            case 3:
+                if (tc->n_in) tc->in[rnd(f, tc->n_in)] = any_value(f);
+                break;
+            case 4:
+                if (tc->n_in) tc->in[rnd(f, tc->n_in)] ^= 1 << rnd(f, 8);
+                break;
+            case 5: /* insert an input */
+                if (tc->n_in < FUZZ_MAX_IN) {
+                    i = rnd(f, tc->n_in + 1);
+                    memmove(tc->in + i + 1, tc->in + i, tc->n_in - i);
+                    tc->in[i] = any_value(f);
+                    tc->n_in++;
+                }
+                break;
+            case 6: /* delete an input */
+                if (tc->n_in) {
+                    i = rnd(f, tc->n_in);
+                    memmove(tc->in + i, tc->in + i + 1, tc->n_in - i - 1);
+                    tc->n_in--;
+                }
+                break;
+            default: /* splice the inputs of another case */
+                if (f->n_corpus) {
+                    const FuzzCase *O = f->corpus[rnd(f, f->n_corpus)];
+
+                    i = rnd(f, tc->n_in + 1);
+                    if (i > O->n_in) i = O->n_in;
+                    memcpy(tc->in + i, O->in + i, O->n_in - i);
+                    tc->n_in = O->n_in;
+                }
+                break;
+        }
+    }
+}
+
+/*
+ *   xorshift64*: 0 <= rnd(f, n) < n
+ */
+static unsigned int rnd(Fuzzer *f, unsigned int n) {
+    f->rng ^= f->rng >> 12;
+    f->rng ^= f->rng << 25;
+    f->rng ^= f->rng >> 27;
+    return (unsigned int)((f->rng * 0x2545f4914f6cdd1dULL) >> 32) % n;
+}
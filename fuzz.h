@@ -0,0 +1,46 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	fuzz.h
+ *	Descrioption:	coverage-guided fuzzing of inputs and data
+ */
+
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Test Case: an Input Stream and the Data Area
+ *===========================================================================*/
+#define FUZZ_MAX_IN 64
+
+typedef struct fuzz_case {
+    int n_in;
+    Uword in[FUZZ_MAX_IN];      /* fed to ibuf whenever it is empty */
+    Uword data[IMEMORY_SIZE];   /* 0x100-0x1ff at the start */
+} FuzzCase;
+
+/*=============================================================================
+ *   Result of a Fuzzing Run
+ *===========================================================================*/
+#define FUZZ_MAP_SIZE (IMEMORY_SIZE * IMEMORY_SIZE) /* (prev_pc, pc) edges */
+
+typedef struct fuzz_result {
+    long execs;
+    long halts;       /* runs that ended at HLT */
+    long faults;      /* runs that ended at an illegal instruction */
+    long waits;       /* runs that polled for an input after the last one */
+    long hangs;       /* runs that reached the step limit */
+    double seconds;
+    int edges;        /* distinct edges covered */
+    int corpus;       /* cases kept for new coverage */
+    Uword reached[IMEMORY_SIZE / 8];   /* PC bitmaps */
+    Uword fault_pc[IMEMORY_SIZE / 8];
+    FuzzCase fault[IMEMORY_SIZE];      /* first case faulting at each PC */
+} FuzzResult;
+
+int fuzz(const Cpub *, long, long, unsigned long, FuzzResult *);
+
+#endif /* FUZZ_H */
@@ -0,0 +1,384 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	gdbstub.c
+ *	Descrioption:	GDB remote serial protocol server of a board
+ *
+ *	One client is served over TCP on 127.0.0.1 (where is a port number) or
+ *	a Unix-domain socket (where is a path) until it detaches, kills or
+ *	disconnects.  Breakpoints (Z0) and watchpoints (Z2-Z4) are those of
+ *	the 'b' command, and continuing stops where 'c' would, except that
+ *	there is no instruction limit: the client interrupts with ^C instead.
+ *
+ *	Stop replies: S05 after a step or at a breakpoint, T05watch/rwatch at
+ *	a watchpoint, S04 at an illegal instruction and W00 at HLT.
+ */
+
+#include "gdbstub.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define GDB_BUF 2048       /* an X packet of the whole memory fits */
+#define GDB_POLL_STEPS 4096 /* instructions between checks for ^C */
+
+typedef struct gdb_conn {
+    int fd;
+    int no_ack;
+    Uword in[GDB_BUF];
+    int n_in;
+    char pkt[GDB_BUF]; /* payload of the current packet */
+    int n_pkt;
+} GdbConn;
+
+static int open_listener(const char *);
+static int get_packet(GdbConn *);
+static int put_packet(GdbConn *, const char *, int);
+static int handle(GdbConn *, Cpub *, Debug *);
+static int resume(GdbConn *, Cpub *, Debug *, int, char *);
+static int interrupted(GdbConn *);
+static Uword *reg_of(Cpub *, int);
+static int hex(int);
+static int parse_hex(const char **, unsigned long *);
+
+/*=============================================================================
+ *   Server
+ *===========================================================================*/
+int gdb_serve(Cpub *cpub, Debug *dbg, const char *where) {
+    static GdbConn c;
+    int lfd, r;
+
+    if ((lfd = open_listener(where)) < 0) return -1;
+    fprintf(stderr, "Waiting for a GDB client on %s\n", where);
+    c.fd = accept(lfd, NULL, NULL);
+    close(lfd);
+    if (where[strspn(where, "0123456789")] != '\0') unlink(where);
+    if (c.fd < 0) {
+        perror("accept");
+        return -1;
+    }
+    c.no_ack = 0;
+    c.n_in = 0;
+
+    while ((r = get_packet(&c)) > 0 && handle(&c, cpub, dbg) > 0)
+        ;
+    close(c.fd);
+    fprintf(stderr, "GDB client %s\n", r > 0 ? "detached" : "disconnected");
+    return 0;
+}
+
+static int open_listener(const char *where) {
+    int fd;
+
+    if (where[strspn(where, "0123456789")] == '\0') {
+        struct sockaddr_in a;
+        const int ON = 1;
+
+        memset(&a, 0, sizeof(a));
+        a.sin_family = AF_INET;
+        a.sin_port = htons(atoi(where));
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &ON, sizeof(ON));
+        if (fd >= 0 && bind(fd, (struct sockaddr *)&a, sizeof(a)) == 0 &&
+            listen(fd, 1) == 0)
+            return fd;
+    } else {
+        struct sockaddr_un a;
+
+        if (strlen(where) >= sizeof(a.sun_path)) {
+            fprintf(stderr, "%s: path too long\n", where);
+            return -1;
+        }
+        memset(&a, 0, sizeof(a));
+        a.sun_family = AF_UNIX;
+        strcpy(a.sun_path, where);
+        unlink(where);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && bind(fd, (struct sockaddr *)&a, sizeof(a)) == 0 &&
+            listen(fd, 1) == 0)
+            return fd;
+    }
+    perror(where);
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+/*=============================================================================
+ *   Packets: $payload#checksum
+ *===========================================================================*/
+/*
+ *   Reads the next packet into c->pkt (acks and stray ^C are skipped).
+ *   Returns 0 if the client has gone.
+ */
+static int get_packet(GdbConn *c) {
+    int i, start, end, sum;
+    ssize_t n;
+
+    for (;;) {
+        /* a complete packet in the buffer? */
+        for (start = 0; start < c->n_in && c->in[start] != '$'; start++)
+            ;
+        for (end = start; end < c->n_in && c->in[end] != '#'; end++)
+            ;
+        if (end + 2 < c->n_in) {
+            for (i = start + 1, sum = 0, c->n_pkt = 0; i < end; i++) {
+                sum += c->in[i];
+                if (c->n_pkt < GDB_BUF - 1) c->pkt[c->n_pkt++] = c->in[i];
+            }
+            c->pkt[c->n_pkt] = '\0';
+            sum &= 0xff;
+            i = (hex(c->in[end + 1]) << 4) | hex(c->in[end + 2]);
+            memmove(c->in, c->in + end + 3, c->n_in - end - 3);
+            c->n_in -= end + 3;
+            if (c->no_ack) return 1;
+            if (send(c->fd, sum == i ? "+" : "-", 1, MSG_NOSIGNAL) != 1) return 0;
+            if (sum == i) return 1;
+            continue;
+        }
+        if (start > 0) { /* acks and ^C before the packet */
+            memmove(c->in, c->in + start, c->n_in - start);
+            c->n_in -= start;
+        }
+        if (c->n_in == GDB_BUF) c->n_in = 0; /* too long: drop it */
+        if ((n = read(c->fd, c->in + c->n_in, GDB_BUF - c->n_in)) <= 0)
+            return 0;
+        c->n_in += n;
+    }
+}
+
+static int put_packet(GdbConn *c, const char *payload, int len) {
+    static char buf[GDB_BUF + 4];
+    int i, sum = 0, n;
+
+    buf[0] = '$';
+    for (i = 0; i < len; i++) sum += (Uword)(buf[i + 1] = payload[i]);
+    n = len + 1;
+    n += sprintf(buf + n, "#%02x", sum & 0xff);
+    for (i = 0; i < n;) {
+        const ssize_t W = send(c->fd, buf + i, n - i, MSG_NOSIGNAL);
+        if (W <= 0) return 0;
+        i += W;
+    }
+    return 1;
+}
+
+/*=============================================================================
+ *   Commands
+ *===========================================================================*/
+/*
+ *   Returns 0 when the session is over
+ */
+static int handle(GdbConn *c, Cpub *cpub, Debug *dbg) {
+    static const char HEX[] = "0123456789abcdef";
+    static char out[GDB_BUF];
+    const char *p = c->pkt + 1;
+    unsigned long addr, len, type, value;
+    int n = 0, i;
+
+    switch (c->pkt[0]) {
+        case '?':
+            n = sprintf(out, "S05");
+            break;
+        case 'g':
+            for (i = 0; i < GDB_N_REGS; i++)
+                n += sprintf(out + n, "%02x", *reg_of(cpub, i));
+            break;
+        case 'G':
+            if (strlen(p) != 2 * GDB_N_REGS) goto error;
+            for (i = 0; i < GDB_N_REGS; i++) {
+                value = (hex(p[2 * i]) << 4) | hex(p[2 * i + 1]);
+                if (i >= 3 && value > 1) goto error; /* flags are 0 or 1 */
+                out[i] = value;
+            }
+            for (i = 0; i < GDB_N_REGS; i++) *reg_of(cpub, i) = (Uword)out[i];
+            n = sprintf(out, "OK");
+            break;
+        case 'p':
+            if (!parse_hex(&p, &addr) || addr >= GDB_N_REGS) goto error;
+            n = sprintf(out, "%02x", *reg_of(cpub, addr));
+            break;
+        case 'P':
+            if (!parse_hex(&p, &addr) || addr >= GDB_N_REGS || *p++ != '=' ||
+                !parse_hex(&p, &value) || value > (addr >= 3 ? 1u : 0xffu))
+                goto error;
+            *reg_of(cpub, addr) = value;
+            n = sprintf(out, "OK");
+            break;
+        case 'm': /* the whole range in one reply */
+            if (!parse_hex(&p, &addr) || *p++ != ',' || !parse_hex(&p, &len) ||
+                addr >= MEMORY_SIZE)
+                goto error;
+            if (len > MEMORY_SIZE - addr) len = MEMORY_SIZE - addr;
+            for (i = 0; i < (int)len; i++) {
+                out[n++] = HEX[cpub->mem[addr + i] >> 4];
+                out[n++] = HEX[cpub->mem[addr + i] & 0x0f];
+            }
+            break;
+        case 'M':
+        case 'X':
+            if (!parse_hex(&p, &addr) || *p++ != ',' || !parse_hex(&p, &len) ||
+                *p++ != ':' || addr > MEMORY_SIZE || len > MEMORY_SIZE - addr)
+                goto error;
+            for (i = 0; i < (int)len; i++) {
+                if (c->pkt[0] == 'M') {
+                    if (p[0] == '\0' || p[1] == '\0') goto error;
+                    value = (hex(p[0]) << 4) | hex(p[1]);
+                    p += 2;
+                } else {
+                    if (p >= c->pkt + c->n_pkt) goto error;
+                    value = (Uword)(*p == '}' ? p[1] ^ 0x20 : *p);
+                    p += *p == '}' ? 2 : 1;
+                }
+                cpub->mem[addr + i] = value;
+            }
+            n = sprintf(out, "OK");
+            break;
+        case 'Z':
+        case 'z':
+            if (!parse_hex(&p, &type) || *p++ != ',' || !parse_hex(&p, &addr))
+                goto error;
+            if (type <= 1 && addr < IMEMORY_SIZE)
+                debug_set_break(dbg, addr, c->pkt[0] == 'Z');
+            else if (type >= 2 && type <= 4 && addr >= IMEMORY_SIZE &&
+                     addr < MEMORY_SIZE)
+                debug_set_watch(dbg, cpub, addr,
+                                type == 2   ? WATCH_WRITE
+                                : type == 3 ? WATCH_READ
+                                            : WATCH_READ | WATCH_WRITE,
+                                c->pkt[0] == 'Z');
+            else
+                goto error;
+            n = sprintf(out, "OK");
+            break;
+        case 'c':
+        case 's':
+            if (*p != '\0') { /* resume at addr */
+                if (!parse_hex(&p, &addr) || addr >= IMEMORY_SIZE) goto error;
+                cpub->pc = addr;
+            }
+            return resume(c, cpub, dbg, c->pkt[0] == 's', out);
+        case 'v':
+            if (!strcmp(c->pkt, "vCont?")) {
+                n = sprintf(out, "vCont;c;C;s;S");
+            } else if (!strncmp(c->pkt, "vCont;", 6)) {
+                /* one thread: the first action is the one */
+                return resume(c, cpub, dbg, c->pkt[6] == 's' || c->pkt[6] == 'S',
+                              out);
+            }
+            break;
+        case 'q':
+            if (!strncmp(c->pkt, "qSupported", 10))
+                n = sprintf(out, "PacketSize=%x;QStartNoAckMode+;vContSupported+",
+                            GDB_BUF - 4);
+            else if (!strcmp(c->pkt, "qAttached"))
+                n = sprintf(out, "1");
+            else if (!strcmp(c->pkt, "qC"))
+                n = sprintf(out, "QC1");
+            else if (!strcmp(c->pkt, "qfThreadInfo"))
+                n = sprintf(out, "m1");
+            else if (!strcmp(c->pkt, "qsThreadInfo"))
+                n = sprintf(out, "l");
+            break;
+        case 'Q':
+            if (!strcmp(c->pkt, "QStartNoAckMode")) {
+                n = sprintf(out, "OK");
+                if (!put_packet(c, out, n)) return 0;
+                c->no_ack = 1;
+                return 1;
+            }
+            break;
+        case 'H':
+        case 'T':
+            n = sprintf(out, "OK");
+            break;
+        case 'D':
+            put_packet(c, "OK", 2);
+            return 0;
+        case 'k':
+            return 0;
+    }
+    return put_packet(c, out, n);
+
+error:
+    return put_packet(c, "E01", 3);
+}
+
+/*
+ *   Steps once or runs until a stop, then sends the stop reply
+ */
+static int resume(GdbConn *c, Cpub *cpub, Debug *dbg, int single, char *out) {
+    long count;
+    int status, n;
+    Uword ir;
+
+    for (count = 1;; count++) {
+        ir = cpub->mem[cpub->pc];
+        if ((status = step(cpub)) != RUN_STEP) break;
+        if (single || (debug_armed(dbg) && debug_check(dbg, cpub))) break;
+        if (count % GDB_POLL_STEPS == 0 && interrupted(c)) {
+            return put_packet(c, "S02", 3);
+        }
+    }
+
+    if (status == RUN_HALT)
+        n = ((ir & 0xfc) | 0x03) == HLT ? sprintf(out, "W00")
+                                          : sprintf(out, "S04");
+    else if (status == RUN_BREAK)
+        n = sprintf(out, "T05%s:%x;",
+                    cpub->watch->hit == WATCH_READ ? "rwatch" : "watch",
+                    IMEMORY_SIZE + (cpub->watch->hit_addr & 0xff));
+    else
+        n = sprintf(out, "S05");
+    return put_packet(c, out, n);
+}
+
+/*
+ *   ^C from the client while running
+ */
+static int interrupted(GdbConn *c) {
+    struct pollfd pfd = {c->fd, POLLIN, 0};
+    Uword b;
+
+    while (poll(&pfd, 1, 0) > 0) {
+        if (read(c->fd, &b, 1) != 1) return 1; /* gone: stop anyway */
+        if (b == 0x03) return 1;
+        if (c->n_in < GDB_BUF) c->in[c->n_in++] = b;
+    }
+    return 0;
+}
+
+/*=============================================================================
+ *   Helpers
+ *===========================================================================*/
+static Uword *reg_of(Cpub *cpub, int r) {
+    Uword *const REGS[GDB_N_REGS] = {&cpub->pc, &cpub->acc, &cpub->ix,
+                                     &cpub->cf, &cpub->vf,  &cpub->nf,
+                                     &cpub->zf};
+    return REGS[r];
+}
+
+static int hex(int ch) {
+    return ch >= '0' && ch <= '9'   ? ch - '0'
+           : ch >= 'a' && ch <= 'f' ? ch - 'a' + 10
+           : ch >= 'A' && ch <= 'F' ? ch - 'A' + 10
+                                    : 0;
+}
+
+/*
+ *   Reads hex digits at *p; returns 0 if there are none
+ */
+static int parse_hex(const char **p, unsigned long *value) {
+    const char *s = *p;
+
+    *value = strtoul(s, (char **)p, 16);
+    return *p != s;
+}
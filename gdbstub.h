@@ -0,0 +1,26 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	gdbstub.h
+ *	Descrioption:	GDB remote serial protocol server of a board
+ */
+
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include "cpuboard.h"
+#include "debug.h"
+
+/*=============================================================================
+ *   Remote Debugging
+ *===========================================================================*/
+/*
+ *   Registers (in this order, 8 bits each): pc acc ix cf vf nf zf.
+ *   Memory: 000-0ff program, 100-1ff data.
+ */
+#define GDB_N_REGS 7
+
+int gdb_serve(Cpub *, Debug *, const char *);
+
+#endif /* GDBSTUB_H */
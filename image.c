@@ -0,0 +1,102 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	image.c
+ *	Descrioption:	loader/writer of program (memory image) files
+ */
+
+#include "image.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*=============================================================================
+ *   Read a Program File
+ *===========================================================================*/
+void read_mem_file(Cpub *cpub, char *file) {
+#define TOKENSIZE 160
+    FILE *fp;
+    unsigned int addr, word;
+    Addr area;
+    char token[TOKENSIZE];
+
+    if ((fp = fopen(file, "r")) == NULL) {
+        fprintf(stderr, "Unable to open %s\n", file);
+        return;
+    }
+
+    addr = 0; /* default initial address */
+    while (fscanf(fp, "%s", token) == 1) {
+        if (token[0] == '.') { /* directive */
+            /*
+             *   Check the directive type
+             */
+            if (!strcmp(token + 1, "text")) {
+                area = 0x000;
+            } else if (!strcmp(token + 1, "data")) {
+                area = 0x100;
+            } else {
+                fprintf(stderr, "Unknown directive: %s\n", token);
+                goto error;
+            }
+
+            /*
+             *   Change the current address
+             */
+            fscanf(fp, "%x", &addr);
+            if (addr > 0xff) {
+                fprintf(stderr, "Invalid address: %s %x\n", token, addr);
+                goto error;
+            }
+            addr |= area;
+        } else { /* instruction word or data */
+            sscanf(token, "%x", &word);
+            if (word > 0xff) {
+                fprintf(stderr,
+                        "Invalid value at addr=0x%03x: "
+                        "0x%x\n",
+                        addr, word);
+                goto error;
+            }
+            cpub->mem[addr++] = word;
+        }
+    }
+
+error:
+    fclose(fp);
+}
+
+/*=============================================================================
+ *   Write a Program File
+ *===========================================================================*/
+/*
+ *   Both areas up to their last nonzero word, in the format read above.
+ *   Returns 0, or -1 if the file cannot be written.
+ */
+int write_mem_file(const Cpub *cpub, char *file) {
+    static const char *const AREA[] = {".text", ".data"};
+    FILE *fp;
+    int area, addr, last;
+
+    if ((fp = fopen(file, "w")) == NULL) {
+        fprintf(stderr, "Unable to open %s\n", file);
+        return -1;
+    }
+    for (area = 0; area < 2; area++) {
+        const Uword *mem = cpub->mem + area * IMEMORY_SIZE;
+
+        for (last = IMEMORY_SIZE - 1; last >= 0 && mem[last] == 0; last--)
+            ;
+        if (last < 0) continue;
+        fprintf(fp, "%s 00\n", AREA[area]);
+        for (addr = 0; addr <= last; addr++)
+            fprintf(fp, "%02X%c", mem[addr],
+                    addr % 8 == 7 || addr == last ? '\n' : ' ');
+    }
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Unable to write %s\n", file);
+        return -1;
+    }
+    return 0;
+}
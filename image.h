@@ -0,0 +1,20 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	image.h
+ *	Descrioption:	loader/writer of program (memory image) files
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Program File
+ *===========================================================================*/
+void read_mem_file(Cpub *, char *);
+int write_mem_file(const Cpub *, char *);
+
+#endif /* IMAGE_H */
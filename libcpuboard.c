@@ -0,0 +1,164 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	libcpuboard.c
+ *	Descrioption:	C API of the simulator library (libcpuboard.a/.so)
+ *
+ *	A board wraps a Cpub and the ibuf it points to.  Runs call step()
+ *	exactly as the command interpreter does, with no watchpoints and
+ *	without the extended memory.
+ */
+
+#include "libcpuboard.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpuboard.h"
+
+struct cpub_board {
+    Cpub cpub;
+    IOBuf ibuf;
+};
+
+/*=============================================================================
+ *   Boards
+ *===========================================================================*/
+int cpub_api_version(void) {
+    return CPUB_API_VERSION;
+}
+
+size_t cpub_board_size(void) {
+    return sizeof(CpubBoard);
+}
+
+/*
+ *   Makes a cleared board in storage of cpub_board_size() bytes, aligned
+ *   for any type
+ */
+CpubBoard *cpub_init(void *storage) {
+    CpubBoard *b = storage;
+
+    if (b == NULL) return NULL;
+    memset(b, 0, sizeof(*b));
+    b->cpub.ibuf = &b->ibuf;
+    return b;
+}
+
+CpubBoard *cpub_create(void) {
+    return cpub_init(malloc(sizeof(CpubBoard)));
+}
+
+void cpub_destroy(CpubBoard *b) {
+    free(b);
+}
+
+int cpub_load(CpubBoard *b, const uint8_t *image, size_t len) {
+    if (b == NULL || (image == NULL && len > 0) || len > MEMORY_SIZE)
+        return CPUB_EINVAL;
+    cpub_init(b);
+    if (len > 0) memcpy(b->cpub.mem, image, len);
+    return 0;
+}
+
+/*=============================================================================
+ *   State in Bulk
+ *===========================================================================*/
+void cpub_get_state(const CpubBoard *b, CpubState *s) {
+    const Cpub *c = &b->cpub;
+
+    s->pc = c->pc;
+    s->acc = c->acc;
+    s->ix = c->ix;
+    s->cf = c->cf;
+    s->vf = c->vf;
+    s->nf = c->nf;
+    s->zf = c->zf;
+    s->ibuf = b->ibuf.buf;
+    s->ibuf_flag = b->ibuf.flag;
+    s->obuf = c->obuf.buf;
+    s->obuf_flag = c->obuf.flag;
+    memset(s->reserved, 0, sizeof(s->reserved));
+    memcpy(s->mem, c->mem, MEMORY_SIZE);
+}
+
+/*
+ *   Flags are 0 or 1, as the 's' command requires
+ */
+int cpub_set_state(CpubBoard *b, const CpubState *s) {
+    Cpub *c = &b->cpub;
+
+    if ((s->cf | s->vf | s->nf | s->zf | s->ibuf_flag | s->obuf_flag) > 1)
+        return CPUB_EINVAL;
+    c->pc = s->pc;
+    c->acc = s->acc;
+    c->ix = s->ix;
+    c->cf = s->cf;
+    c->vf = s->vf;
+    c->nf = s->nf;
+    c->zf = s->zf;
+    b->ibuf.buf = s->ibuf;
+    b->ibuf.flag = s->ibuf_flag;
+    c->obuf.buf = s->obuf;
+    c->obuf.flag = s->obuf_flag;
+    memcpy(c->mem, s->mem, MEMORY_SIZE);
+    return 0;
+}
+
+int cpub_read_mem(const CpubBoard *b, unsigned addr, uint8_t *buf,
+                  size_t len) {
+    if (addr > MEMORY_SIZE || len > MEMORY_SIZE - addr) return CPUB_EINVAL;
+    memcpy(buf, b->cpub.mem + addr, len);
+    return 0;
+}
+
+int cpub_write_mem(CpubBoard *b, unsigned addr, const uint8_t *buf,
+                   size_t len) {
+    if (addr > MEMORY_SIZE || len > MEMORY_SIZE - addr) return CPUB_EINVAL;
+    memcpy(b->cpub.mem + addr, buf, len);
+    return 0;
+}
+
+/*=============================================================================
+ *   Runs
+ *===========================================================================*/
+/*
+ *   Runs up to max_steps instructions (CPUB_TO_HALT: until HLT).  With io,
+ *   an empty ibuf is filled before each instruction and obuf is emptied
+ *   after it.
+ */
+int cpub_run(CpubBoard *b, long max_steps, CpubIO *io, long *steps) {
+    Cpub *c = &b->cpub;
+    long n;
+    int status = CPUB_LIMIT;
+
+    for (n = 0; max_steps < 0 || n < max_steps; n++) {
+        if (io != NULL && !b->ibuf.flag && io->in_pos < io->n_in) {
+            b->ibuf.buf = io->in[io->in_pos++];
+            b->ibuf.flag = 1;
+        }
+        if (step(c) == RUN_HALT) status = CPUB_HALT;
+        if (io != NULL && c->obuf.flag) {
+            if (io->n_out < io->max_out) io->out[io->n_out] = c->obuf.buf;
+            io->n_out++;
+            c->obuf.flag = 0;
+        }
+        if (status == CPUB_HALT) {
+            n++;
+            break;
+        }
+    }
+    if (steps != NULL) *steps = n;
+    return status;
+}
+
+int cpub_run_batch(CpubBoard *const *boards, size_t n, long max_steps,
+                   CpubIO *io, int *status, long *steps) {
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        status[i] = cpub_run(boards[i], max_steps, io ? &io[i] : NULL,
+                             steps ? &steps[i] : NULL);
+    return 0;
+}
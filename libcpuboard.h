@@ -0,0 +1,102 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	libcpuboard.h
+ *	Descrioption:	C API of the simulator library (libcpuboard.a/.so)
+ *
+ *	A board is opaque; its state goes in and out in bulk as a CpubState.
+ *	No call allocates except cpub_create(): a board can also live in
+ *	storage of cpub_board_size() bytes given by the caller.  Different
+ *	boards may be run on different threads at the same time.
+ *
+ *	This header does not include the simulator headers, so the layout of
+ *	the boards can change without breaking programs built against it.
+ */
+
+#ifndef LIBCPUBOARD_H
+#define LIBCPUBOARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CPUB_API_VERSION 1
+
+#if defined(__GNUC__)
+#define CPUB_API __attribute__((visibility("default")))
+#else
+#define CPUB_API
+#endif
+
+/*=============================================================================
+ *   Boards
+ *===========================================================================*/
+#define CPUB_MEMORY_SIZE 512 /* 000-0ff program, 100-1ff data */
+
+typedef struct cpub_board CpubBoard;
+
+typedef struct cpub_state {
+    uint8_t pc, acc, ix;
+    uint8_t cf, vf, nf, zf; /* 0 or 1 */
+    uint8_t ibuf, ibuf_flag;
+    uint8_t obuf, obuf_flag;
+    uint8_t reserved[5];
+    uint8_t mem[CPUB_MEMORY_SIZE];
+} CpubState;
+
+CPUB_API int cpub_api_version(void);
+CPUB_API size_t cpub_board_size(void);
+CPUB_API CpubBoard *cpub_init(void *);
+CPUB_API CpubBoard *cpub_create(void);
+CPUB_API void cpub_destroy(CpubBoard *);
+
+/*
+ *   Loading an image clears the registers and the rest of the memory
+ */
+CPUB_API int cpub_load(CpubBoard *, const uint8_t *, size_t);
+
+CPUB_API void cpub_get_state(const CpubBoard *, CpubState *);
+CPUB_API int cpub_set_state(CpubBoard *, const CpubState *);
+CPUB_API int cpub_read_mem(const CpubBoard *, unsigned, uint8_t *, size_t);
+CPUB_API int cpub_write_mem(CpubBoard *, unsigned, const uint8_t *, size_t);
+
+/*=============================================================================
+ *   Runs
+ *===========================================================================*/
+/* results */
+#define CPUB_HALT 0   /* HLT or an illegal instruction */
+#define CPUB_LIMIT 1  /* the steps are done */
+#define CPUB_EINVAL -1
+
+#define CPUB_TO_HALT -1 /* max_steps: no limit */
+
+/*
+ *   Inputs fed to ibuf whenever it is empty, and outputs taken from obuf
+ */
+typedef struct cpub_io {
+    const uint8_t *in;
+    size_t n_in;
+    size_t in_pos;  /* next input */
+    uint8_t *out;
+    size_t max_out; /* size of out */
+    size_t n_out;   /* outputs (may exceed max_out) */
+} CpubIO;
+
+CPUB_API int cpub_run(CpubBoard *, long, CpubIO *, long *);
+
+/*
+ *   Runs each of n boards for up to max_steps with io[i] (io may be NULL),
+ *   storing the result and the steps of each (steps may be NULL)
+ */
+CPUB_API int cpub_run_batch(CpubBoard *const *, size_t, long, CpubIO *, int *,
+                            long *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCPUBOARD_H */
@@ -0,0 +1,88 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	loop.c
+ *	Descrioption:	detection of infinite loops in a run
+ */
+
+#include "loop.h"
+
+#include <string.h>
+
+static int same_state(const LoopDetector *, const Cpub *, long);
+
+/*=============================================================================
+ *   Loop Detection
+ *===========================================================================*/
+void loop_reset(LoopDetector *ld) {
+    ld->power = 1;
+    ld->lam = 0;
+    ld->period = 0;
+    ld->saved_count = -1; /* nothing saved yet */
+}
+
+/*
+ *   Called at a loop head (after a jump to a lower or equal address) with
+ *   the number of executed instructions and a tag for any state outside the
+ *   board.  Returns 1 if the board is in the same state as at an earlier
+ *   loop head, and therefore runs forever; ld->period is then set.
+ *
+ *   A state is saved only when the number of loop heads since the last save
+ *   reaches a power of 2 (Brent's method), so the cost at most loop heads
+ *   is a few register compares.
+ */
+int loop_head(LoopDetector *ld, const Cpub *cpub, long count, long tag) {
+    if (cpub->xmem != NULL) return 0; /* the other banks are not compared */
+    if (cpub->mmio != NULL) return 0; /* nor the devices and the time */
+    if (ld->saved_count >= 0 && same_state(ld, cpub, tag)) {
+        ld->period = count - ld->saved_count;
+        return 1;
+    }
+
+    if (++ld->lam >= ld->power || ld->saved_count < 0) {
+        ld->saved = *cpub;
+        ld->saved_ibuf = *cpub->ibuf;
+        ld->saved_tag = tag;
+        ld->saved_count = count;
+        ld->power *= 2;
+        ld->lam = 0;
+    }
+    return 0;
+}
+
+/*
+ *   Executes one period of a detected loop on a copy of the board and sets
+ *   a bitmap of the PCs in the loop.  Returns the number of the PCs.
+ */
+int loop_pcs(long period, const Cpub *cpub, Uword *pcs) {
+    Cpub c = *cpub;
+    IOBuf ibuf = *cpub->ibuf;
+    long i;
+    int n = 0;
+
+    memset(pcs, 0, IMEMORY_SIZE / 8);
+    c.ibuf = &ibuf;
+    c.watch = NULL;
+    c.mmio = NULL;
+    for (i = 0; i < period; i++) {
+        if (!(pcs[c.pc >> 3] & (1 << (c.pc & 0x07)))) {
+            pcs[c.pc >> 3] |= 1 << (c.pc & 0x07);
+            n++;
+        }
+        step(&c);
+    }
+    return n;
+}
+
+static int same_state(const LoopDetector *ld, const Cpub *cpub, long tag) {
+    const Cpub *s = &ld->saved;
+
+    return s->pc == cpub->pc && s->acc == cpub->acc && s->ix == cpub->ix &&
+           s->cf == cpub->cf && s->vf == cpub->vf && s->nf == cpub->nf &&
+           s->zf == cpub->zf && s->obuf.flag == cpub->obuf.flag &&
+           s->obuf.buf == cpub->obuf.buf &&
+           ld->saved_ibuf.flag == cpub->ibuf->flag &&
+           ld->saved_ibuf.buf == cpub->ibuf->buf && ld->saved_tag == tag &&
+           !memcmp(s->mem, cpub->mem, MEMORY_SIZE);
+}
@@ -0,0 +1,31 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	loop.h
+ *	Descrioption:	detection of infinite loops in a run
+ */
+
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Loop Detector (Brent's method over the states at loop heads)
+ *===========================================================================*/
+typedef struct loop_detector {
+    Cpub saved; /* the state compared with (tortoise) */
+    IOBuf saved_ibuf;
+    long saved_tag;
+    long saved_count;
+    long power;
+    long lam;
+    long period; /* instructions per iteration of a detected loop */
+} LoopDetector;
+
+void loop_reset(LoopDetector *);
+int loop_head(LoopDetector *, const Cpub *, long, long);
+int loop_pcs(long, const Cpub *, Uword *);
+
+#endif /* LOOP_H */
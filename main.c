@@ -4,24 +4,63 @@
  *	Program:	instruction set simulator of the Educational CPU Board
  *	File Name:	main.c
  *	Descrioption:	main profram (command interpreter)
+ *
+ *	Usage:	main [-v] [script-file]
+ *
+ *	With a script file the commands in it are run without the prompts,
+ *	and 's' and 'w' do not display what they changed unless -v is given.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "asm.h"
 #include "cpuboard.h"
+#include "debug.h"
+#include "device.h"
+#include "disasm.h"
+#include "explore.h"
+#include "fuzz.h"
+#include "gdbstub.h"
+#include "image.h"
+#include "loop.h"
+#include "memo.h"
+#include "metrics.h"
+#include "opt.h"
+#include "profile.h"
+#include "run.h"
+#include "statediff.h"
+#include "wcet.h"
 
 void help(void);
 int init_cpub(void);
-void cont(Cpub *, char *);
+int command(int, int, char *, char *, char *);
+int run_script_file(int, const char *);
+void cont(Cpub *, Debug *, char *);
+void cont_to(Cpub *, Debug *, Addr);
+void run_with_input(Cpub *, char *, char *);
+void explore_states(Cpub *, char *);
+void fuzz_command(Cpub *, char *, char *);
+void wcet_command(Cpub *, long *, char *, char *);
+void optimize_command(Cpub *, char *, char *);
+int parse_inputs(char *, Uword *, int);
+void display_loop(Cpub *, long);
 void display_regs(Cpub *);
 void set_reg(Cpub *, char *, char *);
+int find_reg(const char *);
+void set_reg_value(Cpub *, int, unsigned int);
 void display_mem(Cpub *, char *);
 void display_mem_line(Cpub *, Addr);
 void display_mem_all(Cpub *);
+void display_disasm(Cpub *, char *, char *);
 void set_mem(Cpub *, char *, char *);
-void read_mem_file(Cpub *, char *);
+void write_mem(Cpub *, Addr, Uword);
+void diff_snapshot(Cpub *, int, char *);
+void profile_command(Cpub *, char *, char *);
+void bank_command(Cpub *, char *);
 void cmd_syntax_error(void);
 void unknown_command(void);
 
@@ -29,6 +68,19 @@ void unknown_command(void);
  *   CPU Board States
  *===========================================================================*/
 Cpub cpuboard[2]; /* CPU board state */
+Debug debugger[2]; /* breakpoints of each CPU board */
+Bus devices[2];    /* memory-mapped devices of each CPU board */
+long loop_bounds[2][IMEMORY_SIZE]; /* WCET loop bounds by header address */
+
+typedef struct snapshot {
+    int valid;
+    Cpub cpub;
+    IOBuf ibuf; /* cpub.ibuf points here */
+} Snapshot;
+
+Snapshot snapshot[2]; /* saved by 'v save', compared by 'v' */
+
+int verbose = 1; /* 's' and 'w' display what they changed */
 
 /*=============================================================================
  *   Command: Display a Help Menu
@@ -40,20 +92,70 @@ void help(void) {
     fprintf(stderr,
             "   c [addr]\t--- continue(start) execution "
             "[to address(hex)]\n");
+    fprintf(stderr,
+            "   b [addr]\t--- list breakpoints or toggle one "
+            "at address(hex)\n"
+            "   b r|w addr\t--- toggle a read/write(rw) watchpoint "
+            "at data address(hex)\n"
+            "   b reg data\t--- toggle a breakpoint on reg == data(hex)\n"
+            "   b clear\t--- clear all breakpoints\n");
+    fprintf(stderr,
+            "   g port|path\t--- serve a GDB client (remote protocol) "
+            "on a TCP port or a Unix socket\n");
+    fprintf(stderr,
+            "   x [in [n]]\t--- execute feeding inputs(hex,hex,..) "
+            "[until n outputs]\n");
+    fprintf(stderr,
+            "   e [max]\t--- explore all states reachable over all inputs "
+            "[up to max states]\n");
+    fprintf(stderr,
+            "   f [n [steps]]\t--- fuzz inputs and data for coverage "
+            "[n runs of up to steps]\n");
+    fprintf(stderr,
+            "   l\t\t--- worst-case cycles (WCET) from PC and the path\n"
+            "   l addr n\t--- bound the loop at address(hex) to n passes "
+            "(0: none)\n"
+            "   l check [in]\t--- compare the WCET with a run feeding "
+            "inputs(hex,hex,..)\n");
+    fprintf(stderr,
+            "   o file [in/..]\t--- optimize the program into file if runs "
+            "feeding inputs(hex,hex,..) match\n");
+    fprintf(stderr,
+            "   p start [hz]\t--- start sampling the PC (profiling)\n"
+            "   p stop\t--- stop sampling\n"
+            "   p\t\t--- display the flat profile\n"
+            "   p fold file\t--- write the profile as folded stacks "
+            "(flamegraph)\n");
     fprintf(stderr, "   d\t\t--- display the contents of registers\n");
     fprintf(stderr,
             "   s reg data\t--- set data(hex) to the register\n"
             "\t\t\treg: pc,acc,ix,cf,vf,nf,zf,"
-            "ibuf,if,obuf,of\n");
+            "ibuf,if,obuf,of,bank\n");
+    fprintf(stderr,
+            "   k [banks]\t--- show or set the number of memory banks "
+            "(0: no banks)\n");
+    fprintf(stderr,
+            "   n [timer addr]\t--- show the devices and the cycles "
+            "[add a timer at data address(hex)]\n"
+            "   n clear\t--- remove all devices\n");
     fprintf(stderr,
             "   m [addr]\t--- dump memory or display data "
             "at memory address(hex)\n");
+    fprintf(stderr,
+            "   u [addr end]\t--- disassemble instructions "
+            "[from address(hex) [to address(hex)]]\n");
     fprintf(stderr,
             "   w addr data\t--- write data(hex) "
             "at memory address(hex)\n");
+    fprintf(stderr,
+            "   v [save]\t--- show what changed since the snapshot "
+            "[save a snapshot]\n");
     fprintf(stderr,
             "   r file\t--- load a program into the main memory "
             "from the file\n");
+    fprintf(stderr,
+            "   a file\t--- assemble a program into the main memory "
+            "from the file\n");
     fprintf(stderr, "   t\t\t--- toggle current computer(context)\n");
     fprintf(stderr, "   h\t\t--- help (this menu)\n");
     fprintf(stderr, "   ?\t\t--- help (this menu)\n");
@@ -72,19 +174,36 @@ int init_cpub(void) {
 /*=============================================================================
  *   Main Routine: Command Interpreter
  *===========================================================================*/
-int main() {
+int main(int argc, char *argv[]) {
 #define CLSIZE 160
     char cmdline[CLSIZE]; /* command line buffer */
     char cmd[CLSIZE], arg1[CLSIZE], arg2[CLSIZE], dummy[CLSIZE];
-    Cpub *cpub;  /* current CPU board state */
     int cpub_id; /* current CPU board ID */
-    int n;
+    int n, opt, echo = 0;
 
     /*
      *   Initialize the CPU board state
      */
     cpub_id = init_cpub();
-    cpub = &(cpuboard[cpub_id]);
+    init_disasm();
+    if (getenv(MEMO_ENV) != NULL) memo_open(getenv(MEMO_ENV), MEMO_SLOTS);
+    if (getenv(METRICS_ENV) != NULL && metrics_open(getenv(METRICS_ENV)) == 0)
+        atexit(metrics_close);
+
+    /*
+     *   A script file is run without the prompts
+     */
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        if (opt != 'v') {
+            fprintf(stderr, "usage: %s [-v] [script-file]\n", argv[0]);
+            return 1;
+        }
+        echo = 1;
+    }
+    if (optind < argc) {
+        verbose = echo;
+        return run_script_file(cpub_id, argv[optind]);
+    }
 
     /*
      *   Interpret commands
@@ -93,7 +212,7 @@ int main() {
         /*
          *   Prompt
          */
-        fprintf(stderr, "CPU%d,PC=0x%x> ", cpub_id, cpub->pc);
+        fprintf(stderr, "CPU%d,PC=0x%x> ", cpub_id, cpuboard[cpub_id].pc);
         /* fflush(stderr); */
 
         /*
@@ -106,89 +225,269 @@ int main() {
         /*
          *   Interpet a command
          */
-        if (cmd[1] != '\0') {
-            unknown_command();
-            continue;
-        }
-        switch (cmd[0]) {
-            case 'i':
-                if (step(cpub) == RUN_HALT) {
+        if ((cpub_id = command(cpub_id, n, cmd, arg1, arg2)) < 0)
+            return 0; /* exiting */
+    }
+    /* never reach here */
+}
+
+/*=============================================================================
+ *   Interpretation of a Command
+ *===========================================================================*/
+/*
+ *   Runs a command line of n words on the board cpub_id.  Returns the board
+ *   of the next command, or -1 to quit.
+ */
+int command(int cpub_id, int n, char *cmd, char *arg1, char *arg2) {
+    Cpub *cpub = &(cpuboard[cpub_id]); /* current CPU board state */
+
+    if (cmd[1] != '\0') {
+        unknown_command();
+        return cpub_id;
+    }
+    switch (cmd[0]) {
+        case 'i':
+            switch (n = step(cpub)) {
+                case RUN_HALT:
                     fprintf(stderr, "Program Halted.\n");
-                }
-                break;
-            case 'c':
-                switch (n) {
-                    case 1:
-                        cont(cpub, NULL);
-                        break;
-                    case 2:
-                        cont(cpub, arg1);
-                        break;
-                    default:
-                        goto syntaxerr;
-                }
-                break;
-            case 'd':
-                if (n != 1) goto syntaxerr;
-                display_regs(cpub);
-                break;
-            case 's':
-                if (n != 3) goto syntaxerr;
-                set_reg(cpub, arg1, arg2);
-                break;
-            case 'm':
-                switch (n) {
-                    case 1:
-                        display_mem_all(cpub);
-                        break;
-                    case 2:
-                        display_mem(cpub, arg1);
-                        break;
-                    default:
-                        goto syntaxerr;
-                }
-                break;
-            case 'w':
-                if (n != 3) goto syntaxerr;
-                set_mem(cpub, arg1, arg2);
-                break;
-            case 'r':
-                if (n != 2) goto syntaxerr;
-                read_mem_file(cpub, arg1);
-                break;
-            case 't':
-                cpub_id ^= 1;
-                cpub = &(cpuboard[cpub_id]);
-                break;
-            case 'h':
-            case '?':
-                help();
-                break;
-            case 'q':
-                if (n != 1)
+                    break;
+                case RUN_STEP:
+                    break;
+                default:
+                    debug_report(&debugger[cpub_id], cpub, n);
+                    break;
+            }
+            break;
+        case 'c':
+            switch (n) {
+                case 1:
+                    cont(cpub, &debugger[cpub_id], NULL);
+                    break;
+                case 2:
+                    cont(cpub, &debugger[cpub_id], arg1);
+                    break;
+                default:
                     goto syntaxerr;
-                else
-                    return 0; /* exiting */
-                break;        /* never reach here */
-            default:
-                unknown_command();
-                break;
-            syntaxerr:
-                cmd_syntax_error();
-                break;
-        }
+            }
+            break;
+        case 'x':
+            switch (n) {
+                case 1:
+                    run_with_input(cpub, NULL, NULL);
+                    break;
+                case 2:
+                    run_with_input(cpub, arg1, NULL);
+                    break;
+                case 3:
+                    run_with_input(cpub, arg1, arg2);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'e':
+            switch (n) {
+                case 1:
+                    explore_states(cpub, NULL);
+                    break;
+                case 2:
+                    explore_states(cpub, arg1);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'b':
+            switch (n) {
+                case 1:
+                    break_command(&debugger[cpub_id], cpub, NULL, NULL);
+                    break;
+                case 2:
+                    break_command(&debugger[cpub_id], cpub, arg1, NULL);
+                    break;
+                case 3:
+                    break_command(&debugger[cpub_id], cpub, arg1, arg2);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'd':
+            if (n != 1) goto syntaxerr;
+            display_regs(cpub);
+            break;
+        case 's':
+            if (n != 3) goto syntaxerr;
+            set_reg(cpub, arg1, arg2);
+            break;
+        case 'm':
+            switch (n) {
+                case 1:
+                    display_mem_all(cpub);
+                    break;
+                case 2:
+                    display_mem(cpub, arg1);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'u':
+            switch (n) {
+                case 1:
+                    display_disasm(cpub, NULL, NULL);
+                    break;
+                case 2:
+                    display_disasm(cpub, arg1, NULL);
+                    break;
+                case 3:
+                    display_disasm(cpub, arg1, arg2);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'w':
+            if (n != 3) goto syntaxerr;
+            set_mem(cpub, arg1, arg2);
+            break;
+        case 'p':
+            switch (n) {
+                case 1:
+                    profile_command(cpub, NULL, NULL);
+                    break;
+                case 2:
+                    profile_command(cpub, arg1, NULL);
+                    break;
+                case 3:
+                    profile_command(cpub, arg1, arg2);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'f':
+            switch (n) {
+                case 1:
+                    fuzz_command(cpub, NULL, NULL);
+                    break;
+                case 2:
+                    fuzz_command(cpub, arg1, NULL);
+                    break;
+                case 3:
+                    fuzz_command(cpub, arg1, arg2);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'l':
+            switch (n) {
+                case 1:
+                    wcet_command(cpub, loop_bounds[cpub_id], NULL, NULL);
+                    break;
+                case 2:
+                    wcet_command(cpub, loop_bounds[cpub_id], arg1, NULL);
+                    break;
+                case 3:
+                    wcet_command(cpub, loop_bounds[cpub_id], arg1, arg2);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'g':
+            if (n != 2) goto syntaxerr;
+            gdb_serve(cpub, &debugger[cpub_id], arg1);
+            break;
+        case 'o':
+            switch (n) {
+                case 2:
+                    optimize_command(cpub, arg1, NULL);
+                    break;
+                case 3:
+                    optimize_command(cpub, arg1, arg2);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'k':
+            switch (n) {
+                case 1:
+                    bank_command(cpub, NULL);
+                    break;
+                case 2:
+                    bank_command(cpub, arg1);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'n':
+            switch (n) {
+                case 1:
+                    device_command(&devices[cpub_id], cpub, NULL, NULL);
+                    break;
+                case 2:
+                    device_command(&devices[cpub_id], cpub, arg1, NULL);
+                    break;
+                case 3:
+                    device_command(&devices[cpub_id], cpub, arg1, arg2);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'v':
+            switch (n) {
+                case 1:
+                    diff_snapshot(cpub, cpub_id, NULL);
+                    break;
+                case 2:
+                    diff_snapshot(cpub, cpub_id, arg1);
+                    break;
+                default:
+                    goto syntaxerr;
+            }
+            break;
+        case 'r':
+            if (n != 2) goto syntaxerr;
+            read_mem_file(cpub, arg1);
+            break;
+        case 'a':
+            if (n != 2) goto syntaxerr;
+            assemble_file(cpub, arg1);
+            break;
+        case 't':
+            cpub_id ^= 1;
+            break;
+        case 'h':
+        case '?':
+            help();
+            break;
+        case 'q':
+            if (n != 1)
+                goto syntaxerr;
+            else
+                return -1; /* exiting */
+            break;         /* never reach here */
+        default:
+            unknown_command();
+            break;
+        syntaxerr:
+            cmd_syntax_error();
+            break;
     }
-    /* never reach here */
+    return cpub_id;
 }
 
 /*=============================================================================
  *   Command: Continue(Start) Execution
  *===========================================================================*/
-void cont(Cpub *cpub, char *straddr) {
-#define MAX_EXEC_COUNT 500
+void cont(Cpub *cpub, Debug *dbg, char *straddr) {
     int addr;
     Addr breakp;
-    int count;
 
     /*
      *   Check and set a break-point address
@@ -203,23 +502,337 @@ void cont(Cpub *cpub, char *straddr) {
         }
         breakp = addr;
     }
+    cont_to(cpub, dbg, breakp);
+}
+
+void cont_to(Cpub *cpub, Debug *dbg, Addr breakp) {
+#define MAX_EXEC_COUNT 500
+    int count;
+    int status;
+    const int ARMED = debug_armed(dbg);
+    LoopDetector ld;
+    Uword prev_pc;
 
     /*
      *   Execute a program
      */
     count = 1;
+    loop_reset(&ld);
     do {
-        if (step(cpub) == RUN_HALT) {
-            fprintf(stderr, "Program Halted.\n");
+        prev_pc = cpub->pc;
+        if ((status = step(cpub)) != RUN_STEP) {
+            if (status == RUN_HALT)
+                fprintf(stderr, "Program Halted.\n");
+            else
+                debug_report(dbg, cpub, status);
             return;
         }
         if (count++ > MAX_EXEC_COUNT) {
             fprintf(stderr, "Too Many Instructions are Executed.\n");
             return;
         }
+        /* breakpoints cost nothing unless armed */
+        if (ARMED && debug_check(dbg, cpub)) return;
+        /* an endless loop stops the run at once */
+        if (cpub->pc <= prev_pc && loop_head(&ld, cpub, count, 0)) {
+            display_loop(cpub, ld.period);
+            return;
+        }
     } while (cpub->pc != breakp);
 }
 
+void display_loop(Cpub *cpub, long period) {
+    Uword pcs[IMEMORY_SIZE / 8];
+    int pc;
+
+    loop_pcs(period, cpub, pcs);
+    fprintf(stderr, "Endless Loop Detected (period %ld):", period);
+    for (pc = 0; pc < IMEMORY_SIZE; pc++)
+        if (pcs[pc >> 3] & (1 << (pc & 7))) fprintf(stderr, " %02x", pc);
+    fprintf(stderr, "\n");
+}
+
+/*=============================================================================
+ *   Command: Execute with Scripted Input
+ *===========================================================================*/
+void run_with_input(Cpub *cpub, char *strin, char *strcount) {
+#define MAX_SCRIPT_EXEC_COUNT 10000000
+#define MAX_SCRIPT_IO 256
+    static const char *const REASON[] = {
+        "Program Halted.", "Output Count Reached.",
+        "Too Many Instructions are Executed.", "Watchpoint Hit.", NULL};
+    Uword in[MAX_SCRIPT_IO], out[MAX_SCRIPT_IO];
+    RunScript rs = {0};
+    int i, status;
+
+    /*
+     *   Parse the input bytes ("-" for none) and the output count
+     */
+    rs.in = in;
+    if ((rs.n_in = parse_inputs(strin, in, MAX_SCRIPT_IO)) < 0) return;
+    rs.out = out;
+    rs.max_out = MAX_SCRIPT_IO;
+    if (strcount != NULL) sscanf(strcount, "%x", &rs.stop_out);
+
+    status = memo_run(cpub, &rs, MAX_SCRIPT_EXEC_COUNT);
+
+    if (status == SCRIPT_LOOP)
+        display_loop(cpub, rs.loop_period);
+    else
+        fprintf(stderr, "%s\n", REASON[status]);
+    fprintf(stderr, "\tsteps=%ld inputs=%d/%d\n", rs.steps, rs.in_pos,
+            rs.n_in);
+    fprintf(stderr, "\toutput:");
+    for (i = 0; i < rs.n_out && i < rs.max_out; i++)
+        fprintf(stderr, " %02x", out[i]);
+    fprintf(stderr, "\n");
+}
+
+/*
+ *   Input bytes "hex,hex,.." ("-" or NULL for none).  Returns the number of
+ *   bytes, or -1 after a message.
+ */
+int parse_inputs(char *strin, Uword *in, int max) {
+    unsigned int value;
+    char *p;
+    int n = 0;
+
+    if (strin == NULL || strcmp(strin, "-") == 0) return 0;
+    for (p = strtok(strin, ","); p != NULL; p = strtok(NULL, ",")) {
+        if (sscanf(p, "%x", &value) != 1 || value > 0xff) {
+            fprintf(stderr, "Invalid value (out of range): %s\n", p);
+            return -1;
+        }
+        if (n == max) {
+            fprintf(stderr, "Too many inputs.\n");
+            return -1;
+        }
+        in[n++] = value;
+    }
+    return n;
+}
+
+/*=============================================================================
+ *   Command: Explore the State Space
+ *===========================================================================*/
+void explore_states(Cpub *cpub, char *strmax) {
+#define DEFAULT_MAX_STATES 1000000
+    static ExploreResult res;
+    long max = DEFAULT_MAX_STATES;
+    int from, to;
+
+    if (strmax != NULL && (sscanf(strmax, "%li", &max) != 1 || max <= 0)) {
+        fprintf(stderr, "Invalid number of states: %s\n", strmax);
+        return;
+    }
+    if (cpub->mmio != NULL) {
+        fprintf(stderr, "Unable to explore with devices attached\n");
+        return;
+    }
+    if (explore(cpub, 1, max, 0, &res) < 0) {
+        fprintf(stderr, "Unable to allocate memory for %ld states\n", max);
+        return;
+    }
+
+    fprintf(stderr, "Explored %ld states, %ld transitions, %d levels%s\n",
+            res.states, res.transitions, res.depth,
+            res.full ? " (state limit reached)" : "");
+    fprintf(stderr, "\thalt: %ld states at", res.halts);
+    for (from = 0; from < IMEMORY_SIZE; from++)
+        if (res.halt_pc[from >> 3] & (1 << (from & 7)))
+            fprintf(stderr, " %02x", from);
+    fprintf(stderr, "\n\tillegal: %ld states at", res.illegals);
+    for (from = 0; from < IMEMORY_SIZE; from++)
+        if (res.illegal_pc[from >> 3] & (1 << (from & 7)))
+            fprintf(stderr, " %02x", from);
+    fprintf(stderr, "\n\tloop: %ld back edges", res.loops);
+    for (from = 0; from < IMEMORY_SIZE; from++)
+        for (to = 0; to < IMEMORY_SIZE; to++)
+            if (res.loop_edge[from][to >> 3] & (1 << (to & 7)))
+                fprintf(stderr, " %02x->%02x", from, to);
+    fprintf(stderr, "\n");
+}
+
+/*=============================================================================
+ *   Command: Fuzz the Inputs and the Data for Coverage
+ *===========================================================================*/
+void fuzz_command(Cpub *cpub, char *strexecs, char *strsteps) {
+#define DEFAULT_FUZZ_EXECS 1000000
+#define DEFAULT_FUZZ_STEPS 1000
+    static FuzzResult res;
+    long execs = DEFAULT_FUZZ_EXECS, steps = DEFAULT_FUZZ_STEPS;
+    const char *text;
+    int pc, last, i;
+
+    if (strexecs != NULL &&
+        (sscanf(strexecs, "%li", &execs) != 1 || execs <= 0)) {
+        fprintf(stderr, "Invalid number of runs: %s\n", strexecs);
+        return;
+    }
+    if (strsteps != NULL &&
+        (sscanf(strsteps, "%li", &steps) != 1 || steps <= 0)) {
+        fprintf(stderr, "Invalid number of steps: %s\n", strsteps);
+        return;
+    }
+    if (cpub->xmem != NULL) {
+        fprintf(stderr, "Unable to fuzz in the extended memory mode\n");
+        return;
+    }
+    if (cpub->mmio != NULL) {
+        fprintf(stderr, "Unable to fuzz with devices attached\n");
+        return;
+    }
+    if (fuzz(cpub, execs, steps, (unsigned long)time(NULL), &res) < 0) {
+        fprintf(stderr, "Unable to allocate memory for fuzzing\n");
+        return;
+    }
+
+    fprintf(stderr, "Fuzzed %ld runs in %.2f s (%.0f runs/s), %d edges, "
+                    "%d cases kept\n",
+            res.execs, res.seconds, res.execs / res.seconds, res.edges,
+            res.corpus);
+    fprintf(stderr, "\thalt: %ld  fault: %ld  wait: %ld  hang: %ld\n",
+            res.halts, res.faults, res.waits, res.hangs);
+
+    for (pc = 0, last = 0; pc < IMEMORY_SIZE; pc++)
+        if (res.reached[pc >> 3] & (1 << (pc & 7))) last = pc;
+    fprintf(stderr, "\tunreached:");
+    for (pc = 0; pc <= last; pc += disasm(cpub, pc, &text))
+        if (!(res.reached[pc >> 3] & (1 << (pc & 7))))
+            fprintf(stderr, " %02x", pc);
+    fprintf(stderr, "\n");
+
+    for (pc = 0; pc < IMEMORY_SIZE; pc++) {
+        const FuzzCase *tc = &res.fault[pc];
+
+        if (!(res.fault_pc[pc >> 3] & (1 << (pc & 7)))) continue;
+        disasm(cpub, pc, &text);
+        fprintf(stderr, "\tfault at %02x (%s): in=", pc, text);
+        for (i = 0; i < tc->n_in; i++)
+            fprintf(stderr, "%s%02x", i ? "," : "", tc->in[i]);
+        fprintf(stderr, " data");
+        for (i = 0; i < IMEMORY_SIZE; i++)
+            if (tc->data[i] != cpub->mem[IMEMORY_SIZE + i])
+                fprintf(stderr, " %03x=%02x", IMEMORY_SIZE + i, tc->data[i]);
+        fprintf(stderr, "\n");
+    }
+}
+
+/*=============================================================================
+ *   Command: Worst-Case Execution Time
+ *===========================================================================*/
+void wcet_command(Cpub *cpub, long *bounds, char *strop, char *strarg) {
+#define MAX_WCET_CHECK_STEPS 10000000
+    Uword in[MAX_SCRIPT_IO];
+    unsigned int addr;
+    long bound, measured;
+    int n_in, halted;
+
+    if (strop != NULL && strcmp(strop, "check") != 0) {
+        if (strarg == NULL || sscanf(strop, "%x", &addr) != 1 ||
+            sscanf(strarg, "%li", &bound) != 1 || bound < 0) {
+            cmd_syntax_error();
+            return;
+        }
+        if (addr >= IMEMORY_SIZE) {
+            fprintf(stderr, "Invalid address (out of range): 0x%x\n", addr);
+            return;
+        }
+        bounds[addr] = bound;
+        return;
+    }
+
+    bound = wcet(cpub, cpub->pc, bounds, stderr);
+    if (strop == NULL || bound < 0) return;
+
+    if (cpub->xmem != NULL) {
+        fprintf(stderr, "Unable to run a copy in the extended memory mode\n");
+        return;
+    }
+    if (cpub->mmio != NULL) {
+        fprintf(stderr, "Unable to run a copy with devices attached\n");
+        return;
+    }
+    if ((n_in = parse_inputs(strarg, in, MAX_SCRIPT_IO)) < 0) return;
+    measured = wcet_measure(cpub, in, n_in, MAX_WCET_CHECK_STEPS, &halted);
+    if (!halted)
+        fprintf(stderr, "\tmeasured: no HLT within %d steps\n",
+                MAX_WCET_CHECK_STEPS);
+    else if (measured <= bound)
+        fprintf(stderr, "\tmeasured: %ld cycles, within the bound (%ld%%)\n",
+                measured, measured * 100 / bound);
+    else
+        fprintf(stderr, "\tmeasured: %ld cycles, OVER the bound by %ld\n",
+                measured, measured - bound);
+}
+
+/*=============================================================================
+ *   Command: Peephole Optimization
+ *===========================================================================*/
+void optimize_command(Cpub *cpub, char *file, char *strruns) {
+#define MAX_OPT_RUNS 16
+    static const char *const END[] = {"halt", "output", "limit", "break",
+                                      "loop"};
+    static Cpub opt;
+    Uword in[MAX_SCRIPT_IO];
+    char *runs[MAX_OPT_RUNS], *p;
+    int n_runs = 0, n_in, k, equal = 1;
+    OptStats st;
+    OptRun r;
+
+    if (cpub->xmem != NULL) {
+        fprintf(stderr, "Unable to optimize in the extended memory mode\n");
+        return;
+    }
+    if (cpub->mmio != NULL) {
+        fprintf(stderr, "Unable to optimize with devices attached\n");
+        return;
+    }
+
+    /* runs "in/in/..", each a list of inputs; one run without any by default */
+    runs[n_runs++] = strruns;
+    for (p = strruns; p != NULL && (p = strchr(p, '/')) != NULL;) {
+        *p++ = '\0';
+        if (n_runs == MAX_OPT_RUNS) {
+            fprintf(stderr, "Too many runs.\n");
+            return;
+        }
+        runs[n_runs++] = p;
+    }
+
+    if (optimize(cpub, &opt, &st) < 0) return;
+    fprintf(stderr, "Optimized: %d -> %d instructions, %d -> %d words%s\n",
+            st.insts[0], st.insts[1], st.words[0], st.words[1],
+            st.fixed ? " (layout kept)" : "");
+    fprintf(stderr,
+            "\tthreaded: %d  branches: %d  dead flags: %d  dead loads: %d"
+            "  unreachable: %d\n",
+            st.threaded, st.branches, st.dead_flags, st.dead_loads,
+            st.unreachable);
+
+    for (k = 0; k < n_runs; k++) {
+        fprintf(stderr, "\trun %s: ", runs[k] != NULL ? runs[k] : "-");
+        if ((n_in = parse_inputs(runs[k], in, MAX_SCRIPT_IO)) < 0) return;
+        if (!opt_compare(cpub, &opt, &st, in, n_in, &r)) {
+            fprintf(stderr, "DIFFERENT (%s)\n", r.differ);
+            equal = 0;
+            continue;
+        }
+        fprintf(stderr, "%s, %ld -> %ld steps, %ld -> %ld cycles (-%ld%%)\n",
+                END[r.status[0]], r.steps[0], r.steps[1], r.cycles[0],
+                r.cycles[1],
+                r.cycles[0] ? (r.cycles[0] - r.cycles[1]) * 100 / r.cycles[0]
+                            : 0);
+    }
+
+    if (!equal) {
+        fprintf(stderr, "Not written: the runs differ\n");
+        return;
+    }
+    if (write_mem_file(&opt, file) == 0)
+        fprintf(stderr, "Written to %s\n", file);
+}
+
 /*=============================================================================
  *   Command: Display Registers and Flags
  *===========================================================================*/
@@ -234,58 +847,130 @@ void display_regs(Cpub *cpub) {
     fprintf(stderr, "\tibuf=%x:0x%02x(%d,%u)    obuf=%x:0x%02x(%d,%u)\n",
             cpub->ibuf->flag, DispRegVec(cpub->ibuf->buf), cpub->obuf.flag,
             DispRegVec(cpub->obuf.buf));
+    if (cpub->xmem != NULL)
+        fprintf(stderr, "\tbank=0x%02x (of %d)\n", cpub->bank, cpub->n_banks);
 }
 
 /*=============================================================================
  *   Command: Set a Register/Flag
  *===========================================================================*/
+enum Register_name {
+    REG_PC, REG_ACC, REG_IX, REG_CF, REG_VF, REG_NF, REG_ZF,
+    REG_IBUF, REG_IF, REG_OBUF, REG_OF, REG_BANK, N_REGS
+};
+
+const char *const REG_NAMES[N_REGS] = {"pc", "acc",  "ix", "cf",   "vf", "nf",
+                                       "zf", "ibuf", "if", "obuf", "of", "bank"};
+
 void set_reg(Cpub *cpub, char *regname, char *strval) {
-    unsigned int value, max;
-    unsigned char *reg;
+    const int REG = find_reg(regname);
+    unsigned int value;
 
     /*
      *   Check the register/flag name
      */
-    if (!strcmp(regname, "pc"))
-        reg = &(cpub->pc), max = 0xff;
-    else if (!strcmp(regname, "acc"))
-        reg = &(cpub->acc), max = 0xff;
-    else if (!strcmp(regname, "ix"))
-        reg = &(cpub->ix), max = 0xff;
-    else if (!strcmp(regname, "cf"))
-        reg = &(cpub->cf), max = 1;
-    else if (!strcmp(regname, "vf"))
-        reg = &(cpub->vf), max = 1;
-    else if (!strcmp(regname, "nf"))
-        reg = &(cpub->nf), max = 1;
-    else if (!strcmp(regname, "zf"))
-        reg = &(cpub->zf), max = 1;
-    else if (!strcmp(regname, "ibuf"))
-        reg = &(cpub->ibuf->buf), max = 0xff, cpub->ibuf->flag = 1;
-    else if (!strcmp(regname, "if"))
-        reg = &(cpub->ibuf->flag), max = 1;
-    else if (!strcmp(regname, "obuf"))
-        reg = &(cpub->obuf.buf), max = 0xff, cpub->obuf.flag = 1;
-    else if (!strcmp(regname, "of"))
-        reg = &(cpub->obuf.flag), max = 1;
-    else {
+    if (REG < 0 || (REG == REG_BANK && cpub->xmem == NULL)) {
         fprintf(stderr, "Unknown register name: %s\n", regname);
         return;
     }
 
+    sscanf(strval, "%x", &value);
+    set_reg_value(cpub, REG, value);
+}
+
+int find_reg(const char *regname) {
+    int reg;
+
+    for (reg = 0; reg < N_REGS; reg++)
+        if (!strcmp(regname, REG_NAMES[reg])) return reg;
+    return -1;
+}
+
+void set_reg_value(Cpub *cpub, int reg, unsigned int value) {
+    unsigned int max = 0xff;
+    unsigned char *p;
+
+    switch (reg) {
+        case REG_PC:
+            p = &(cpub->pc);
+            break;
+        case REG_ACC:
+            p = &(cpub->acc);
+            break;
+        case REG_IX:
+            p = &(cpub->ix);
+            break;
+        case REG_CF:
+            p = &(cpub->cf), max = 1;
+            break;
+        case REG_VF:
+            p = &(cpub->vf), max = 1;
+            break;
+        case REG_NF:
+            p = &(cpub->nf), max = 1;
+            break;
+        case REG_ZF:
+            p = &(cpub->zf), max = 1;
+            break;
+        case REG_IBUF:
+            p = &(cpub->ibuf->buf), cpub->ibuf->flag = 1;
+            break;
+        case REG_IF:
+            p = &(cpub->ibuf->flag), max = 1;
+            break;
+        case REG_OBUF:
+            p = &(cpub->obuf.buf), cpub->obuf.flag = 1;
+            break;
+        case REG_OF:
+            p = &(cpub->obuf.flag), max = 1;
+            break;
+        default: /* REG_BANK: the pages are swapped, not just the register */
+            if (cpub->xmem == NULL) {
+                fprintf(stderr, "Unknown register name: bank\n");
+                return;
+            }
+            if (value >= (unsigned int)cpub->n_banks)
+                fprintf(stderr, "Invalid value (out of range): 0x%x\n", value);
+            else
+                set_bank(cpub, value);
+            if (verbose) display_regs(cpub);
+            return;
+    }
+
     /*
      *   Write to the register/flag
      */
-    sscanf(strval, "%x", &value);
     if (value > max)
         fprintf(stderr, "Invalid value (out of range): 0x%x\n", value);
     else
-        *reg = value;
+        *p = value;
 
     /*
      *   For confirmation
      */
-    display_regs(cpub);
+    if (verbose) display_regs(cpub);
+}
+
+/*=============================================================================
+ *   Command: Extended Memory (Banks)
+ *===========================================================================*/
+void bank_command(Cpub *cpub, char *strbanks) {
+    int n_banks;
+
+    if (strbanks != NULL) {
+        if (sscanf(strbanks, "%i", &n_banks) != 1) {
+            cmd_syntax_error();
+            return;
+        }
+        if (n_banks == 0)
+            xmem_detach(cpub);
+        else if (xmem_attach(cpub, n_banks) < 0)
+            return;
+    }
+    if (cpub->xmem == NULL)
+        fprintf(stderr, "\tno banks (base memory mode)\n");
+    else
+        fprintf(stderr, "\tbank=0x%02x (of %d)\n", cpub->bank, cpub->n_banks);
 }
 
 /*=============================================================================
@@ -323,6 +1008,46 @@ void display_mem_all(Cpub *cpub) {
     for (addr = 0; addr < MEMORY_SIZE; addr += 16) display_mem_line(cpub, addr);
 }
 
+/*=============================================================================
+ *   Command: Disassemble the Program Area
+ *===========================================================================*/
+void display_disasm(Cpub *cpub, char *strbegin, char *strend) {
+#define DISASM_LINES 8
+    unsigned int begin, end;
+    int i, len, lines;
+    const char *text;
+
+    begin = cpub->pc;
+    if (strbegin != NULL) sscanf(strbegin, "%x", &begin);
+    if (begin >= IMEMORY_SIZE) {
+        fprintf(stderr, "Invalid address (out of range): 0x%x\n", begin);
+        return;
+    }
+    end = IMEMORY_SIZE - 1;
+    lines = DISASM_LINES;
+    if (strend != NULL) {
+        sscanf(strend, "%x", &end);
+        if (end >= IMEMORY_SIZE || end < begin) {
+            fprintf(stderr, "Invalid address (out of range): 0x%x\n", end);
+            return;
+        }
+        lines = IMEMORY_SIZE;
+    }
+
+    while (begin <= end && lines-- > 0) {
+        len = disasm(cpub, (Addr)begin, &text);
+        fprintf(stderr, "    | %03x: ", begin);
+        for (i = 0; i < 2; i++) {
+            if (i < len)
+                fprintf(stderr, " %02x", cpub->mem[(begin + i) & 0xff]);
+            else
+                fprintf(stderr, "   ");
+        }
+        fprintf(stderr, "    %s\n", text);
+        begin += len;
+    }
+}
+
 /*=============================================================================
  *   Command: Write a Word to a Memory Location
  *===========================================================================*/
@@ -341,64 +1066,299 @@ void set_mem(Cpub *cpub, char *straddr, char *strval) {
         return;
     }
 
+    write_mem(cpub, addr, value);
+}
+
+void write_mem(Cpub *cpub, Addr addr, Uword value) {
     cpub->mem[addr] = value;
-    display_mem_line(cpub, (Addr)MemLineBase(addr));
+    if (verbose) display_mem_line(cpub, (Addr)MemLineBase(addr));
 }
 
 /*=============================================================================
- *   Command: Read a Program File
+ *   Command: Save a Snapshot or Compare with It
  *===========================================================================*/
-void read_mem_file(Cpub *cpub, char *file) {
-#define TOKENSIZE 160
-    FILE *fp;
-    unsigned int addr, word;
-    Addr area;
-    char token[TOKENSIZE];
+void diff_snapshot(Cpub *cpub, int cpub_id, char *strsave) {
+#define ROW_HEAD 11 /* "    - 100: " */
+    static const char *const REG[] = {"pc", "acc", "ix", "cf", "vf",
+                                      "nf", "zf", "ibuf", "obuf"};
+    static const char HEX[] = "0123456789abcdef";
+    Snapshot *snap = &snapshot[cpub_id];
+    const Cpub *old = &snap->cpub;
+    StateDiff d;
+    char line[3][ROW_HEAD + 3 * DIFF_ROW_SIZE + 2];
+    int r, i;
 
-    if ((fp = fopen(file, "r")) == NULL) {
-        fprintf(stderr, "Unable to open %s\n", file);
+    if (strsave != NULL) {
+        if (strcmp(strsave, "save")) {
+            cmd_syntax_error();
+            return;
+        }
+        snap->cpub = *cpub;
+        snap->ibuf = *cpub->ibuf;
+        snap->cpub.ibuf = &snap->ibuf;
+        snap->valid = 1;
+        return;
+    }
+    if (!snap->valid) {
+        fprintf(stderr, "No snapshot. Type \'v save\' to save one.\n");
+        return;
+    }
+    if (!diff_state(old, cpub, &d)) {
+        fprintf(stderr, "No difference from the snapshot.\n");
         return;
     }
 
-    addr = 0; /* default initial address */
-    while (fscanf(fp, "%s", token) == 1) {
-        if (token[0] == '.') { /* directive */
-            /*
-             *   Check the directive type
-             */
-            if (!strcmp(token + 1, "text")) {
-                area = 0x000;
-            } else if (!strcmp(token + 1, "data")) {
-                area = 0x100;
-            } else {
-                fprintf(stderr, "Unknown directive: %s\n", token);
-                goto error;
-            }
+    /*
+     *   Registers: snapshot -> current
+     */
+    if (d.regs) {
+        const Uword WAS[] = {old->pc, old->acc, old->ix, old->cf, old->vf,
+                             old->nf, old->zf, old->ibuf->buf, old->obuf.buf};
+        const Uword NOW[] = {cpub->pc, cpub->acc, cpub->ix, cpub->cf,
+                             cpub->vf, cpub->nf, cpub->zf, cpub->ibuf->buf,
+                             cpub->obuf.buf};
+        const Bit WAS_FLAG[] = {old->ibuf->flag, old->obuf.flag};
+        const Bit NOW_FLAG[] = {cpub->ibuf->flag, cpub->obuf.flag};
 
-            /*
-             *   Change the current address
-             */
-            fscanf(fp, "%x", &addr);
-            if (addr > 0xff) {
-                fprintf(stderr, "Invalid address: %s %x\n", token, addr);
-                goto error;
-            }
-            addr |= area;
-        } else { /* instruction word or data */
-            sscanf(token, "%x", &word);
-            if (word > 0xff) {
-                fprintf(stderr,
-                        "Invalid value at addr=0x%03x: "
-                        "0x%x\n",
-                        addr, word);
-                goto error;
+        for (i = 0; i < 9; i++) {
+            if (!(d.regs & (1 << i))) continue;
+            if (i < 7)
+                fprintf(stderr, "\t%s=0x%02x -> 0x%02x\n", REG[i], WAS[i],
+                        NOW[i]);
+            else
+                fprintf(stderr, "\t%s=%x:0x%02x -> %x:0x%02x\n", REG[i],
+                        WAS_FLAG[i - 7], WAS[i], NOW_FLAG[i - 7], NOW[i]);
+        }
+    }
+
+    /*
+     *   Memory: only the rows that differ, marking the changed words
+     */
+    for (r = 0; r < DIFF_ROWS; r++) {
+        const Addr BASE = r * DIFF_ROW_SIZE;
+        if (!(d.rows & ((uint32_t)1 << r))) continue;
+        sprintf(line[0], "    - %03x: ", BASE);
+        sprintf(line[1], "    + %03x: ", BASE);
+        memset(line[2], ' ', ROW_HEAD);
+        for (i = 0; i < DIFF_ROW_SIZE; i++) {
+            char *p0 = line[0] + ROW_HEAD + 3 * i;
+            char *p1 = line[1] + ROW_HEAD + 3 * i;
+            p0[0] = p1[0] = ' ';
+            p0[1] = HEX[old->mem[BASE + i] >> 4];
+            p0[2] = HEX[old->mem[BASE + i] & 0xf];
+            p1[1] = HEX[cpub->mem[BASE + i] >> 4];
+            p1[2] = HEX[cpub->mem[BASE + i] & 0xf];
+            memcpy(line[2] + ROW_HEAD + 3 * i, d.mask[r] & (1 << i) ? " ^^" : "   ",
+                   3);
+        }
+        strcpy(line[0] + ROW_HEAD + 3 * DIFF_ROW_SIZE, "\n");
+        strcpy(line[1] + ROW_HEAD + 3 * DIFF_ROW_SIZE, "\n");
+        for (i = DIFF_ROW_SIZE; !(d.mask[r] & (1 << (i - 1))); i--)
+            ;
+        strcpy(line[2] + ROW_HEAD + 3 * i, "\n");
+        fputs(line[0], stderr);
+        fputs(line[1], stderr);
+        fputs(line[2], stderr);
+    }
+}
+
+/*=============================================================================
+ *   Command: Sampling Profiler
+ *===========================================================================*/
+void profile_command(Cpub *cpub, char *strop, char *strarg) {
+#define PROFILE_LINES 16
+    long counts[IMEMORY_SIZE], total, outside;
+    int hz = PROFILE_HZ, order[IMEMORY_SIZE], i, j, k;
+    const char *text;
+    FILE *fp;
+
+    if (strop == NULL) {
+        /* flat profile: the instructions with the most samples */
+        total = profile_counts(counts, &outside);
+        fprintf(stderr, "%ld samples (%ld outside the program)\n", total,
+                outside);
+        for (i = 0; i < IMEMORY_SIZE; i++) order[i] = i;
+        for (i = 0; i < PROFILE_LINES && i < IMEMORY_SIZE; i++) {
+            for (j = i + 1; j < IMEMORY_SIZE; j++) {
+                if (counts[order[j]] > counts[order[i]]) {
+                    k = order[i];
+                    order[i] = order[j];
+                    order[j] = k;
+                }
             }
-            cpub->mem[addr++] = word;
+            if (counts[order[i]] == 0) break;
+            disasm(cpub, order[i], &text);
+            fprintf(stderr, "    | %03x:  %-20s%8ld %5.1f%%\n", order[i], text,
+                    counts[order[i]], 100.0 * counts[order[i]] / total);
         }
+    } else if (!strcmp(strop, "start")) {
+        if (strarg != NULL &&
+            (sscanf(strarg, "%d", &hz) != 1 || hz < 1 || hz > 100000)) {
+            fprintf(stderr, "Invalid sampling rate: %s\n", strarg);
+            return;
+        }
+        if (profile_start(hz) < 0) perror("setitimer");
+    } else if (!strcmp(strop, "stop") && strarg == NULL) {
+        profile_stop();
+    } else if (!strcmp(strop, "fold") && strarg != NULL) {
+        if ((fp = fopen(strarg, "w")) == NULL) {
+            fprintf(stderr, "Unable to open %s\n", strarg);
+            return;
+        }
+        profile_fold(cpub, fp);
+        fclose(fp);
+    } else {
+        cmd_syntax_error();
     }
+}
 
-error:
+/*=============================================================================
+ *   Script Mode
+ *===========================================================================*/
+/*
+ *   The whole script is parsed into a vector before it runs.  The operands
+ *   of s, w, c and m are converted then; any other line, or one of these
+ *   that does not parse, is kept as words for command(), so that its error
+ *   is reported when it is reached, as at the prompt.
+ */
+enum Script_kind { CMD_WORDS, CMD_SET_REG, CMD_WRITE, CMD_CONT, CMD_MEM };
+
+typedef struct script_line {
+    int kind;
+    int n;         /* words, up to 4 as at the prompt */
+    char *word[3]; /* in the text of the script */
+    int reg;
+    unsigned int addr, value;
+} ScriptLine;
+
+static int parse_script(char *, ScriptLine *);
+static void parse_script_line(ScriptLine *);
+
+int run_script_file(int cpub_id, const char *file) {
+    static char outbuf[1 << 16];
+    FILE *fp;
+    char *text;
+    ScriptLine *lines;
+    long size;
+    int n_lines, i;
+
+    /* stderr is unbuffered; everything goes out at the end */
+    setvbuf(stderr, outbuf, _IOFBF, sizeof(outbuf));
+
+    if ((fp = fopen(file, "r")) == NULL) {
+        fprintf(stderr, "Unable to open %s\n", file);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    if (size < 0 || (text = malloc(size + 1)) == NULL) {
+        fprintf(stderr, "Unable to read %s\n", file);
+        fclose(fp);
+        return 1;
+    }
+    size = fread(text, 1, size, fp);
+    text[size] = '\0';
     fclose(fp);
+
+    for (n_lines = 1, i = 0; i < size; i++) n_lines += text[i] == '\n';
+    if ((lines = malloc(n_lines * sizeof(ScriptLine))) == NULL) {
+        fprintf(stderr, "Not enough memory for %d lines\n", n_lines);
+        free(text);
+        return 1;
+    }
+    n_lines = parse_script(text, lines);
+
+    for (i = 0; i < n_lines && cpub_id >= 0; i++) {
+        const ScriptLine *l = &lines[i];
+        Cpub *cpub = &(cpuboard[cpub_id]);
+
+        switch (l->kind) {
+            case CMD_SET_REG:
+                set_reg_value(cpub, l->reg, l->value);
+                break;
+            case CMD_WRITE:
+                write_mem(cpub, l->addr, l->value);
+                break;
+            case CMD_CONT:
+                cont_to(cpub, &debugger[cpub_id], l->addr);
+                break;
+            case CMD_MEM:
+                display_mem_line(cpub, (Addr)MemLineBase(l->addr));
+                break;
+            default:
+                cpub_id = command(cpub_id, l->n, l->word[0], l->word[1],
+                                  l->word[2]);
+                break;
+        }
+    }
+
+    fflush(stderr);
+    free(lines);
+    free(text);
+    return 0;
+}
+
+/*
+ *   Splits the text into words in place; returns the number of the
+ *   nonempty lines
+ */
+static int parse_script(char *text, ScriptLine *lines) {
+    static const char SPACE[] = " \t\v\f\r";
+    ScriptLine *l = lines;
+    char *p = text, *end;
+
+    while (*p != '\0') {
+        if ((end = strchr(p, '\n')) != NULL)
+            *end++ = '\0';
+        else
+            end = p + strlen(p);
+        l->n = 0;
+        l->word[1] = l->word[2] = NULL;
+        while (*(p += strspn(p, SPACE)) != '\0') {
+            if (l->n < 3) l->word[l->n] = p;
+            if (l->n < 4) l->n++;
+            p += strcspn(p, SPACE);
+            if (*p != '\0') *p++ = '\0';
+        }
+        if (l->n > 0) parse_script_line(l++);
+        p = end;
+    }
+    return l - lines;
+}
+
+static void parse_script_line(ScriptLine *l) {
+    const char *const *w = (const char *const *)l->word;
+
+    l->kind = CMD_WORDS;
+    if (w[0][1] != '\0') return;
+    switch (w[0][0]) {
+        case 's':
+            if (l->n == 3 && (l->reg = find_reg(w[1])) >= 0 &&
+                sscanf(w[2], "%x", &l->value) == 1)
+                l->kind = CMD_SET_REG;
+            break;
+        case 'w':
+            if (l->n == 3 && sscanf(w[1], "%x", &l->addr) == 1 &&
+                sscanf(w[2], "%x", &l->value) == 1 && l->addr < MEMORY_SIZE &&
+                l->value <= 0xff)
+                l->kind = CMD_WRITE;
+            break;
+        case 'c':
+            if (l->n == 1) {
+                l->addr = 0xffff; /* no break-point */
+                l->kind = CMD_CONT;
+            } else if (l->n == 2 && sscanf(w[1], "%x", &l->addr) == 1 &&
+                       l->addr < IMEMORY_SIZE) {
+                l->kind = CMD_CONT;
+            }
+            break;
+        case 'm':
+            if (l->n == 2 && sscanf(w[1], "%x", &l->addr) == 1 &&
+                l->addr < MEMORY_SIZE)
+                l->kind = CMD_MEM;
+            break;
+    }
 }
 
 /*=============================================================================
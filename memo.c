@@ -0,0 +1,269 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	memo.c
+ *	Descrioption:	persistent cache of run results
+ *
+ *	The cache file is an open-addressing hash table mapped with MAP_SHARED,
+ *	so every simulator process using the same file sees the same table.
+ *	A slot is claimed by an atomic compare-and-swap of its state word,
+ *	filled, and then published; a published slot is never written again,
+ *	so readers need no lock.  A slot left half-written by a crashed process
+ *	is just skipped.
+ */
+
+#include "memo.h"
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MEMO_MAGIC 0x4f4d454d42555043ULL /* "CPUBMEMO" */
+#define MEMO_VERSION 2 /* 2: IX-modified addresses wrap within their area */
+#define MEMO_PROBES 32
+#define MEMO_MAX_OUT 256
+
+/* slot states */
+#define SLOT_EMPTY 0
+#define SLOT_WRITING 1
+#define SLOT_VALID 2
+
+typedef struct memo_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t n_slots;
+    uint64_t pad[5];
+} MemoHeader;
+
+typedef struct memo_value {
+    Uword pc, acc, ix, cf, vf, nf, zf;
+    IOBuf ibuf, obuf;
+    int32_t status;
+    int32_t in_pos;
+    int32_t n_out;
+    int64_t steps;
+    int64_t loop_period;
+    Uword mem[MEMORY_SIZE];
+    Uword out[MEMO_MAX_OUT];
+} MemoValue;
+
+typedef struct memo_slot {
+    _Atomic uint64_t state;
+    uint64_t key[2];
+    MemoValue value;
+} MemoSlot;
+
+static MemoHeader *memo;
+static MemoSlot *memo_slots;
+static size_t memo_size;
+
+static void memo_key(const Cpub *, const RunScript *, long, uint64_t *);
+static uint64_t hash_bytes(uint64_t, const Uword *, long);
+
+/*=============================================================================
+ *   Open/Close the Cache File
+ *===========================================================================*/
+/*
+ *   Maps the cache file, creating it with n_slots slots if it does not
+ *   exist.  Returns 0, or -1 if the file cannot be used.
+ */
+int memo_open(const char *path, long n_slots) {
+    MemoHeader hdr;
+    struct stat st;
+    void *p;
+    int fd;
+
+    memo_close();
+    if (n_slots <= 0) {
+        fprintf(stderr, "Invalid number of cache slots: %ld\n", n_slots);
+        return -1;
+    }
+    if ((fd = open(path, O_RDWR | O_CREAT, 0666)) < 0) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return -1;
+    }
+
+    /* the first process to get the lock initializes the file */
+    if (lockf(fd, F_LOCK, 0) < 0 || fstat(fd, &st) < 0) goto error;
+    if (st.st_size == 0) {
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic = MEMO_MAGIC;
+        hdr.version = MEMO_VERSION;
+        hdr.slot_size = sizeof(MemoSlot);
+        hdr.n_slots = n_slots;
+        st.st_size = sizeof(hdr) + sizeof(MemoSlot) * n_slots;
+        if (ftruncate(fd, st.st_size) < 0 ||
+            pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+            goto error;
+    } else if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+               hdr.magic != MEMO_MAGIC || hdr.version != MEMO_VERSION ||
+               hdr.slot_size != sizeof(MemoSlot) || hdr.n_slots == 0 ||
+               (off_t)(sizeof(hdr) + sizeof(MemoSlot) * hdr.n_slots) !=
+                   st.st_size) {
+        fprintf(stderr, "%s is not a cache file of this simulator\n", path);
+        goto error;
+    }
+    lockf(fd, F_ULOCK, 0);
+
+    p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s\n", path);
+        return -1;
+    }
+    memo = p;
+    memo_slots = (MemoSlot *)(memo + 1);
+    memo_size = st.st_size;
+    return 0;
+
+error:
+    close(fd);
+    return -1;
+}
+
+void memo_close(void) {
+    if (memo != NULL) munmap(memo, memo_size);
+    memo = NULL;
+}
+
+/*=============================================================================
+ *   Run a Program through the Cache
+ *===========================================================================*/
+/*
+ *   Same as run_script(), but a run that has been done before (by any
+ *   process) with the same memory, registers, I/O buffers, inputs and
+ *   limits is not executed: its final state is copied from the cache.
+ */
+int memo_run(Cpub *cpub, RunScript *rs, long max_steps) {
+    uint64_t key[2], i, n;
+    MemoSlot *slot;
+    MemoValue *v;
+    uint64_t expected;
+    int status, probe;
+
+    if (memo == NULL || cpub->watch != NULL || cpub->xmem != NULL ||
+        cpub->mmio != NULL || rs->steps != 0 || rs->n_out != 0 ||
+        rs->in_pos != 0)
+        return run_script(cpub, rs, max_steps);
+
+    memo_key(cpub, rs, max_steps, key);
+    n = memo->n_slots;
+
+    /*
+     *   Lookup
+     */
+    for (probe = 0, i = key[0] % n; probe < MEMO_PROBES;
+         probe++, i = (i + 1) % n) {
+        slot = &memo_slots[i];
+        expected = atomic_load_explicit(&slot->state, memory_order_acquire);
+        if (expected == SLOT_EMPTY) break;
+        if (expected != SLOT_VALID || slot->key[0] != key[0] ||
+            slot->key[1] != key[1])
+            continue;
+
+        v = &slot->value;
+        cpub->pc = v->pc;
+        cpub->acc = v->acc;
+        cpub->ix = v->ix;
+        cpub->cf = v->cf;
+        cpub->vf = v->vf;
+        cpub->nf = v->nf;
+        cpub->zf = v->zf;
+        *cpub->ibuf = v->ibuf;
+        cpub->obuf = v->obuf;
+        memcpy(cpub->mem, v->mem, MEMORY_SIZE);
+        rs->in_pos = v->in_pos;
+        rs->n_out = v->n_out;
+        n = v->n_out < rs->max_out ? v->n_out : rs->max_out;
+        memcpy(rs->out, v->out, n < MEMO_MAX_OUT ? n : MEMO_MAX_OUT);
+        rs->steps = v->steps;
+        rs->loop_period = v->loop_period;
+        return v->status;
+    }
+
+    /*
+     *   Miss: run, then publish the result
+     */
+    status = run_script(cpub, rs, max_steps);
+    /* too many outputs to be replayed, or only the first max_out kept */
+    if (rs->n_out > MEMO_MAX_OUT || rs->n_out > rs->max_out) return status;
+
+    for (probe = 0, i = key[0] % n; probe < MEMO_PROBES;
+         probe++, i = (i + 1) % n) {
+        slot = &memo_slots[i];
+        expected = SLOT_EMPTY;
+        if (!atomic_compare_exchange_strong(&slot->state, &expected,
+                                            SLOT_WRITING))
+            continue;
+
+        slot->key[0] = key[0];
+        slot->key[1] = key[1];
+        v = &slot->value;
+        v->pc = cpub->pc;
+        v->acc = cpub->acc;
+        v->ix = cpub->ix;
+        v->cf = cpub->cf;
+        v->vf = cpub->vf;
+        v->nf = cpub->nf;
+        v->zf = cpub->zf;
+        v->ibuf = *cpub->ibuf;
+        v->obuf = cpub->obuf;
+        memcpy(v->mem, cpub->mem, MEMORY_SIZE);
+        v->status = status;
+        v->in_pos = rs->in_pos;
+        v->n_out = rs->n_out;
+        memcpy(v->out, rs->out,
+               rs->n_out < MEMO_MAX_OUT ? rs->n_out : MEMO_MAX_OUT);
+        v->steps = rs->steps;
+        v->loop_period = rs->loop_period;
+        atomic_store_explicit(&slot->state, SLOT_VALID, memory_order_release);
+        break;
+    }
+    return status;
+}
+
+/*=============================================================================
+ *   Key: 128-bit Content Hash of the Initial State and the Run Parameters
+ *===========================================================================*/
+static void memo_key(const Cpub *cpub, const RunScript *rs, long max_steps,
+                     uint64_t *key) {
+    const Uword REGS[] = {cpub->pc,         cpub->acc,        cpub->ix,
+                          cpub->cf,         cpub->vf,         cpub->nf,
+                          cpub->zf,         cpub->ibuf->flag, cpub->ibuf->buf,
+                          cpub->obuf.flag,  cpub->obuf.buf};
+    const int64_t PARAMS[] = {rs->n_in, rs->stop_out, rs->max_out, max_steps};
+    int k;
+
+    for (k = 0; k < 2; k++) {
+        uint64_t h = k ? 0x6a09e667f3bcc909ULL : 0xbb67ae8584caa73bULL;
+        h = hash_bytes(h, cpub->mem, MEMORY_SIZE);
+        h = hash_bytes(h, REGS, sizeof(REGS));
+        h = hash_bytes(h, (const Uword *)PARAMS, sizeof(PARAMS));
+        h = hash_bytes(h, rs->in, rs->n_in);
+        key[k] = h;
+    }
+}
+
+/*
+ *   Processes 8 bytes at a time with a multiply-xorshift mixer
+ */
+static uint64_t hash_bytes(uint64_t h, const Uword *p, long len) {
+    uint64_t w;
+
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+    }
+    w = (uint64_t)len << 56; /* the rest is shorter than 8 bytes */
+    memcpy(&w, p, len);
+    h = (h ^ w) * 0xbf58476d1ce4e5b9ULL;
+    return h ^ (h >> 31);
+}
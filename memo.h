@@ -0,0 +1,25 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	memo.h
+ *	Descrioption:	persistent cache of run results
+ */
+
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "cpuboard.h"
+#include "run.h"
+
+/*=============================================================================
+ *   Run Result Cache (memory-mapped file shared by processes)
+ *===========================================================================*/
+#define MEMO_ENV "CPUB_CACHE" /* path of the cache file */
+#define MEMO_SLOTS 4096       /* slots of a new cache file */
+
+int memo_open(const char *, long);
+void memo_close(void);
+int memo_run(Cpub *, RunScript *, long);
+
+#endif /* MEMO_H */
@@ -0,0 +1,135 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	metrics.c
+ *	Descrioption:	counters of the engine published in shared memory
+ *
+ *	Every thread that steps a board owns a cache-line aligned slot of
+ *	counters in the segment and updates it with plain relaxed stores, so
+ *	threads never share a line and a reader (simtop) never blocks them.
+ */
+
+#include "metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+MetricsBlock *metrics_block;
+_Thread_local MetricsCounters *metrics_self;
+
+static char metrics_name[64];
+static pthread_key_t metrics_key;
+static pthread_once_t metrics_once = PTHREAD_ONCE_INIT;
+
+static void init_key(void);
+static void release_slot(void *);
+static int stale_segment(const char *);
+
+/*=============================================================================
+ *   Segment
+ *===========================================================================*/
+int metrics_open(const char *name) {
+    MetricsBlock *b;
+    int fd;
+
+    pthread_once(&metrics_once, init_key);
+    /* never truncate a segment that a running simulator has mapped */
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST && stale_segment(name)) {
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) {
+        if (errno == EEXIST)
+            fprintf(stderr, "%s: in use by another simulator\n", name);
+        else
+            perror(name);
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(MetricsBlock)) < 0) {
+        perror(name);
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+    b = mmap(NULL, sizeof(MetricsBlock), PROT_READ | PROT_WRITE, MAP_SHARED,
+             fd, 0);
+    close(fd);
+    if (b == MAP_FAILED) {
+        perror(name);
+        shm_unlink(name);
+        return -1;
+    }
+
+    b->version = METRICS_VERSION;
+    b->pid = getpid();
+    atomic_thread_fence(memory_order_release);
+    b->magic = METRICS_MAGIC; /* last: simtop waits for it */
+    snprintf(metrics_name, sizeof(metrics_name), "%s", name);
+    metrics_block = b;
+    return 0;
+}
+
+/*
+ *   Stop publishing and remove the segment (called at exit)
+ */
+void metrics_close(void) {
+    if (metrics_block == NULL) return;
+    shm_unlink(metrics_name);
+    /* the mapping is kept: other threads may still be counting */
+}
+
+/*
+ *   Whether the segment was left by a simulator that is gone
+ */
+static int stale_segment(const char *name) {
+    int32_t pid;
+    int fd, stale;
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0) return 0;
+    stale = pread(fd, &pid, sizeof(pid), offsetof(MetricsBlock, pid)) !=
+                sizeof(pid) ||
+            pid <= 0 || (kill(pid, 0) < 0 && errno == ESRCH);
+    close(fd);
+    return stale;
+}
+
+/*=============================================================================
+ *   Slot of the Calling Thread
+ *===========================================================================*/
+MetricsCounters *metrics_attach(void) {
+    static _Thread_local MetricsCounters lost; /* when no slot is free */
+    MetricsCounters *c;
+    uint32_t free_slot;
+    int i;
+
+    for (i = 0; i < METRICS_THREADS; i++) {
+        c = &metrics_block->thread[i];
+        free_slot = 0;
+        if (atomic_compare_exchange_strong(&c->owned, &free_slot, 1)) {
+            metrics_self = c;
+            pthread_setspecific(metrics_key, c);
+            return c;
+        }
+    }
+    atomic_fetch_add(&metrics_block->dropped, 1);
+    metrics_self = &lost;
+    return metrics_self;
+}
+
+static void init_key(void) {
+    pthread_key_create(&metrics_key, release_slot);
+}
+
+static void release_slot(void *slot) {
+    MetricsCounters *c = slot;
+    atomic_store(&c->owned, 0);
+}
@@ -0,0 +1,69 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	metrics.h
+ *	Descrioption:	counters of the engine published in shared memory
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*=============================================================================
+ *   Metrics Block (POSIX shared memory)
+ *===========================================================================*/
+#define METRICS_ENV "CPUB_METRICS" /* name of the segment, e.g. /cpub */
+#define METRICS_MAGIC 0x5254454d42555043ULL /* "CPUBMETR" */
+#define METRICS_VERSION 1
+#define METRICS_THREADS 256
+
+/*
+ *   Counters of one thread, written by that thread only.  A slot is taken
+ *   by a thread at its first step and given back when the thread exits;
+ *   the counters are never cleared, so a reader may always add them up.
+ */
+typedef struct metrics_counters {
+    _Alignas(64) _Atomic uint32_t owned;
+    _Atomic uint64_t steps;       /* instructions executed */
+    _Atomic uint64_t halts;       /* HLT executed */
+    _Atomic uint64_t illegals;    /* unknown instruction codes */
+    _Atomic uint64_t st_faults;   /* ST to ACC, IX or an immediate */
+    _Atomic uint64_t io_waits;    /* BNI without input, BNO with output */
+    _Atomic uint64_t opcode[256]; /* by the first word */
+} MetricsCounters;
+
+typedef struct metrics_block {
+    _Alignas(64) uint64_t magic;
+    uint32_t version;
+    int32_t pid;              /* of the simulator */
+    _Atomic uint32_t dropped; /* threads that found no free slot */
+    MetricsCounters thread[METRICS_THREADS];
+} MetricsBlock;
+
+/* increment by the owner: no locked instruction is needed */
+#define METRICS_INC(C, F)                                                   \
+    atomic_store_explicit(                                                  \
+        &(C)->F, atomic_load_explicit(&(C)->F, memory_order_relaxed) + 1,   \
+        memory_order_relaxed)
+
+extern MetricsBlock *metrics_block;
+extern _Thread_local MetricsCounters *metrics_self;
+
+int metrics_open(const char *);
+void metrics_close(void);
+MetricsCounters *metrics_attach(void);
+
+/*
+ *   Counters of the calling thread, or NULL if metrics are not published
+ */
+static inline MetricsCounters *metrics_counters(void) {
+    if (metrics_self != NULL) return metrics_self;
+    if (metrics_block == NULL) return NULL;
+    return metrics_attach();
+}
+
+#endif /* METRICS_H */
@@ -0,0 +1,606 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	opt.c
+ *	Descrioption:	peephole optimizer of the program area
+ *
+ *	The instructions reachable from address 0 are decoded into a list in
+ *	address order.  Rewrites only delete instructions, change a branch
+ *	condition or target, or turn a BA into HLT; a deleted instruction falls
+ *	through to the next one, so the list is laid out again in the same
+ *	order and every branch target is relocated to its new address.
+ *
+ *	Which flags and registers are read later is found by a backward
+ *	liveness analysis with the flag effects of the step_* handlers: ADD,
+ *	SUB and CMP write VNZ and keep CF; ADC and SBC read and write all four;
+ *	AND, OR and EOR clear VF; the shifts write all four and RRA/RLA read
+ *	CF; BC reads CF and may clear it.  At HLT the registers are live and
+ *	the flags are not.  JR may go anywhere, so everything is live there.
+ *
+ *	If the program reads or writes its own area ([d], [IX+d]), or jumps by
+ *	JR without a JAL, code must stay where it is: then branches are only
+ *	retargeted.
+ */
+
+#include "opt.h"
+
+#include <string.h>
+
+#include "disasm.h"
+#include "run.h"
+#include "wcet.h"
+
+#define OPT_MAX_STEPS 1000000
+#define OPT_MAX_OUT 256
+
+/* liveness */
+#define LV_C 0x01
+#define LV_V 0x02
+#define LV_Z 0x04
+#define LV_N 0x08
+#define LV_FLAGS 0x0f
+#define LV_ACC 0x10
+#define LV_IX 0x20
+#define LV_ALL 0x3f
+
+/* how an instruction goes on */
+#define GO_NEXT 0
+#define GO_BRANCH 1 /* to the next or the target */
+#define GO_JUMP 2   /* BA */
+#define GO_CALL 3   /* JAL: to the target, and to the next after JR */
+#define GO_END 4    /* HLT, JR or an illegal instruction */
+
+#define BC (BBC | 0x0d)
+
+typedef struct inst {
+    Uword addr; /* original address */
+    Uword code;
+    Uword word; /* second word */
+    Uword length;
+    short fall;   /* instruction at addr + length, or -1 */
+    short target; /* instruction at the branch/JAL target, or -1 */
+    Uword deleted;
+    Uword live;   /* LV_* live after it */
+} Inst;
+
+typedef struct program {
+    Inst inst[IMEMORY_SIZE];
+    int n;
+    short at[IMEMORY_SIZE];     /* instruction at an address, or -1 */
+    short labels[IMEMORY_SIZE]; /* ways into it other than falling through */
+    int fixed;
+} Program;
+
+static int go(Uword);
+static void effect(Uword, Uword *, Uword *);
+static int discover(Program *, const Uword *);
+static int resolve(const Program *, int);
+static int successors(const Program *, int, int *);
+static int prev_of(const Program *, int);
+static void liveness(Program *);
+static void count_labels(Program *);
+static int thread(Program *, OptStats *);
+static int peephole(Program *, OptStats *);
+static int sweep(Program *, OptStats *);
+static void emit(const Program *, Cpub *, OptStats *);
+static int same_reg(const OptStats *, Uword, Uword);
+
+/*=============================================================================
+ *   Optimization
+ *===========================================================================*/
+/*
+ *   Writes the optimized board into *out (the data area is copied as it
+ *   is).  Returns -1 if the program cannot be decoded.
+ */
+int optimize(const Cpub *cpub, Cpub *out, OptStats *st) {
+    static Program prog;
+    int i, changed;
+
+    memset(st, 0, sizeof(*st));
+    memset(st->returns, -1, sizeof(st->returns));
+    if (discover(&prog, cpub->mem) < 0) return -1;
+    st->fixed = prog.fixed;
+    for (i = 0; i < prog.n; i++) {
+        st->insts[0]++;
+        st->words[0] += prog.inst[i].length;
+    }
+
+    do {
+        changed = thread(&prog, st);
+        if (!prog.fixed) {
+            changed |= peephole(&prog, st);
+            changed |= sweep(&prog, st);
+        }
+    } while (changed);
+
+    *out = *cpub;
+    emit(&prog, out, st);
+    return 0;
+}
+
+static int go(Uword code) {
+    const Decoded *d = &decode_table[code];
+
+    if (d->format == FMT_UNKNOWN || ((code & 0xfc) | 0x03) == HLT ||
+        code == JR || (code & 0xf0) == BNK ||
+        ((code & 0xf0) == ST && d->opb < ABSOLUTE_PROGRAM_ADDRESS))
+        return GO_END;
+    if (code == JAL) return GO_CALL;
+    if (code == BBC) return GO_JUMP;
+    if ((code & 0xf0) == BBC && code != BC) return GO_BRANCH;
+    return GO_NEXT;
+}
+
+/*
+ *   Flags and registers read (*use) and always written (*kill)
+ */
+static void effect(Uword code, Uword *use, Uword *kill) {
+    static const Uword BRANCH_USE[16] = {
+        0,    LV_Z,        LV_N, LV_N | LV_Z, 0,    LV_C,        LV_V | LV_N,
+        LV_V | LV_N | LV_Z,  LV_V, LV_Z,        LV_N, LV_N | LV_Z, 0,    LV_C,
+        LV_V | LV_N,         LV_V | LV_N | LV_Z};
+    const Decoded *d = &decode_table[code];
+    const Uword A = d->opa == ACC ? LV_ACC : LV_IX;
+    const Uword B = d->format != FMT_AB                      ? 0
+                  : d->opb == ACC                            ? LV_ACC
+                  : d->opb == IX ||
+                    d->opb >= IX_MODIFICATION_PROGRAM_ADDRESS ? LV_IX
+                                                             : 0;
+
+    *use = *kill = 0;
+    if (go(code) == GO_END) {
+        *use = ((code & 0xfc) | 0x03) == HLT ? LV_ACC | LV_IX : LV_ALL;
+        return;
+    }
+    switch (code & 0xf0) {
+        case 0x00:
+            if (code == JAL) *kill = LV_ACC;
+            break;
+        case 0x10:
+            if ((code & 0xf8) == OUT)
+                *use = LV_ACC;
+            else
+                *kill = LV_ACC;
+            break;
+        case 0x20:
+            *kill = LV_C;
+            break;
+        case LD:
+            *use = B;
+            *kill = A;
+            break;
+        case ST:
+            *use = A | B;
+            break;
+        case CMP:
+            *use = A | B;
+            *kill = LV_V | LV_N | LV_Z;
+            break;
+        case ADD:
+        case SUB:
+        case AND:
+        case OR:
+        case EOR:
+            *use = A | B;
+            *kill = A | LV_V | LV_N | LV_Z;
+            break;
+        case ADC:
+        case SBC:
+            *use = A | B | LV_C;
+            *kill = A | LV_FLAGS;
+            break;
+        case SRSM: /* RRA and RLA rotate CF in */
+            *use = A | ((code & 0x06) == 0x04 ? LV_C : 0);
+            *kill = A | LV_FLAGS;
+            break;
+        case BBC:
+            *use = BRANCH_USE[code & 0x0f];
+            break;
+    }
+}
+
+/*=============================================================================
+ *   Program as a List of Instructions
+ *===========================================================================*/
+static int discover(Program *p, const Uword *mem) {
+    Uword start[IMEMORY_SIZE], work[IMEMORY_SIZE];
+    int n_work = 0, a, g, i, has_jal = 0, has_jr = 0;
+
+    memset(start, 0, sizeof(start));
+    start[0] = 1;
+    work[n_work++] = 0;
+    while (n_work > 0) {
+        const Uword A = work[--n_work];
+        const Uword CODE = mem[A];
+        const Decoded *d = &decode_table[CODE];
+        const Uword TO[2] = {(Uword)(A + d->length), mem[(Uword)(A + 1)]};
+
+        g = go(CODE);
+        for (i = 0; i < 2; i++) {
+            if (i == 0 && (g == GO_JUMP || g == GO_END)) continue;
+            if (i == 1 && g != GO_BRANCH && g != GO_JUMP && g != GO_CALL)
+                continue;
+            if (!start[TO[i]]) {
+                start[TO[i]] = 1;
+                work[n_work++] = TO[i];
+            }
+        }
+    }
+
+    p->n = 0;
+    p->fixed = 0;
+    for (a = 0; a < IMEMORY_SIZE; a++) {
+        Inst *x = &p->inst[p->n];
+        const Decoded *d = &decode_table[mem[a]];
+
+        p->at[a] = -1;
+        if (!start[a]) continue;
+        if (d->length == 2 && start[(a + 1) & 0xff]) {
+            fprintf(stderr, "Instructions overlap at %02x\n", (a + 1) & 0xff);
+            return -1;
+        }
+        x->addr = a;
+        x->code = mem[a];
+        x->word = mem[(a + 1) & 0xff];
+        x->length = d->length;
+        x->deleted = 0;
+        x->live = 0;
+        p->at[a] = p->n++;
+
+        if (d->format == FMT_AB && (d->opb == ABSOLUTE_PROGRAM_ADDRESS ||
+                                    d->opb == IX_MODIFICATION_PROGRAM_ADDRESS))
+            p->fixed = 1;
+        if (x->code == JAL) has_jal = 1;
+        if (x->code == JR) has_jr = 1;
+        g = go(x->code);
+        if (a + d->length > 0xff && g != GO_JUMP && g != GO_END)
+            p->fixed = 1; /* falls through from 0xff to 0 */
+    }
+    if (has_jr && !has_jal) p->fixed = 1;
+
+    for (i = 0; i < p->n; i++) {
+        Inst *x = &p->inst[i];
+
+        g = go(x->code);
+        x->fall = x->addr + x->length <= 0xff ? p->at[x->addr + x->length] : -1;
+        x->target = g == GO_BRANCH || g == GO_JUMP || g == GO_CALL
+                        ? p->at[x->word]
+                        : -1;
+    }
+    return 0;
+}
+
+/*
+ *   The instruction that runs for i: the next one not deleted
+ */
+static int resolve(const Program *p, int i) {
+    int n;
+
+    for (n = 0; i >= 0 && p->inst[i].deleted && n < p->n; n++)
+        i = p->inst[i].fall;
+    return i;
+}
+
+static int successors(const Program *p, int i, int *s) {
+    const Inst *x = &p->inst[i];
+    int n = 0, k, m;
+
+    switch (go(x->code)) {
+        case GO_NEXT:
+            s[n++] = resolve(p, x->fall);
+            break;
+        case GO_BRANCH:
+            s[n++] = resolve(p, x->fall);
+            s[n++] = resolve(p, x->target);
+            break;
+        case GO_JUMP:
+        case GO_CALL:
+            s[n++] = resolve(p, x->target);
+            break;
+    }
+    for (k = m = 0; k < n; k++)
+        if (s[k] >= 0) s[m++] = s[k];
+    return m;
+}
+
+/*
+ *   The instruction that falls through into i, or -1
+ */
+static int prev_of(const Program *p, int i) {
+    int j, g;
+
+    for (j = i - 1; j >= 0 && p->inst[j].deleted; j--)
+        ;
+    if (j < 0) return -1;
+    g = go(p->inst[j].code);
+    if ((g != GO_NEXT && g != GO_BRANCH) || resolve(p, p->inst[j].fall) != i)
+        return -1;
+    return j;
+}
+
+static void liveness(Program *p) {
+    Uword use, kill, out;
+    int i, k, n, s[2], changed;
+
+    for (i = 0; i < p->n; i++) p->inst[i].live = 0;
+    do {
+        changed = 0;
+        for (i = p->n - 1; i >= 0; i--) {
+            if (p->inst[i].deleted) continue;
+            n = successors(p, i, s);
+            for (k = 0, out = 0; k < n; k++) {
+                effect(p->inst[s[k]].code, &use, &kill);
+                out |= use | (p->inst[s[k]].live & ~kill);
+            }
+            if (out != p->inst[i].live) {
+                p->inst[i].live = out;
+                changed = 1;
+            }
+        }
+    } while (changed);
+}
+
+static void count_labels(Program *p) {
+    int i, g;
+
+    memset(p->labels, 0, sizeof(p->labels));
+    if ((i = resolve(p, p->at[0])) >= 0) p->labels[i]++;
+    for (i = 0; i < p->n; i++) {
+        if (p->inst[i].deleted) continue;
+        g = go(p->inst[i].code);
+        if (g == GO_BRANCH || g == GO_JUMP || g == GO_CALL)
+            if (resolve(p, p->inst[i].target) >= 0)
+                p->labels[resolve(p, p->inst[i].target)]++;
+        if (g == GO_CALL && resolve(p, p->inst[i].fall) >= 0)
+            p->labels[resolve(p, p->inst[i].fall)]++; /* back from JR */
+    }
+}
+
+/*=============================================================================
+ *   Rewrites
+ *===========================================================================*/
+/*
+ *   Jump threading, and in a movable layout:
+ *	branch to the next instruction		-> (none)
+ *	BA to HLT				-> HLT
+ *	Bcc L1; BA L2; L1:			-> B!cc L2; L1:
+ */
+static int thread(Program *p, OptStats *st) {
+    int i, t, u, f, hops, g, changed = 0;
+
+    for (i = 0; i < p->n; i++) {
+        Inst *x = &p->inst[i];
+
+        if (x->deleted) continue;
+        g = go(x->code);
+        if (g != GO_BRANCH && g != GO_JUMP && g != GO_CALL) continue;
+
+        /* the end of a chain of BAs, if it is not a cycle */
+        t = resolve(p, x->target);
+        for (u = t, hops = 0; u >= 0 && p->inst[u].code == BBC &&
+                              hops < p->n;
+             hops++)
+            u = resolve(p, p->inst[u].target);
+        if (u >= 0 && u != t && p->inst[u].code != BBC) {
+            x->target = t = u;
+            st->threaded++;
+            changed = 1;
+        }
+        if (p->fixed || t < 0 || g == GO_CALL) continue;
+
+        count_labels(p);
+        f = resolve(p, x->fall);
+        if (t == f) {
+            x->deleted = 1;
+            st->branches++;
+            changed = 1;
+        } else if (g == GO_JUMP &&
+                   ((p->inst[t].code & 0xfc) | 0x03) == HLT) {
+            x->code = p->inst[t].code;
+            x->length = 1;
+            x->target = -1;
+            st->branches++;
+            changed = 1;
+        } else if (g == GO_BRANCH && f >= 0 && p->inst[f].code == BBC &&
+                   p->labels[f] == 0 && t == resolve(p, p->inst[f].fall) &&
+                   ((0xce >> (x->code & 0x07)) & 1)) { /* NZ ZP P GE GT */
+            x->code ^= 0x08;
+            x->target = p->inst[f].target;
+            p->inst[f].deleted = 1;
+            st->branches++;
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+/*
+ *   Deletes one instruction that has no effect later:
+ *	NOP
+ *	CMP, RCF, SCF, BC, and ADD/SUB/OR/EOR #0, AND #ff, whose flags are dead
+ *	CMP A,#0 right after an ALU result in A, when VF is dead
+ *	LD into a dead register, or LD A,A
+ *	LD A,(d) right after ST A,(d), and ST A,(d) right after LD A,(d)
+ */
+static int peephole(Program *p, OptStats *st) {
+    Uword use, kill;
+    int i, j;
+
+    liveness(p);
+    count_labels(p);
+    for (i = 0; i < p->n; i++) {
+        Inst *x = &p->inst[i];
+        const Decoded *d = &decode_table[x->code];
+        const Uword OP = x->code & 0xf0;
+        const Uword A = d->opa == ACC ? LV_ACC : LV_IX;
+        const int IMM = d->format == FMT_AB && d->opb == IMMEDIATE_ADDRESS;
+        const int MEM = d->format == FMT_AB &&
+                        (d->opb == ABSOLUTE_PROGRAM_ADDRESS ||
+                         d->opb == ABSOLUTE_DATA_ADDRESS);
+        int *count = NULL;
+
+        if (x->deleted || go(x->code) != GO_NEXT) continue;
+        effect(x->code, &use, &kill);
+        j = p->labels[i] ? -1 : prev_of(p, i);
+
+        if ((x->code & 0xf8) == NOP) {
+            count = &st->dead_flags;
+        } else if ((OP == CMP || OP == 0x20 || x->code == BC ||
+                    (IMM && (OP == ADD || OP == SUB || OP == OR || OP == EOR) &&
+                     x->word == 0x00) ||
+                    (IMM && OP == AND && x->word == 0xff)) &&
+                   !((x->code == BC ? LV_C : kill & LV_FLAGS) & x->live)) {
+            count = &st->dead_flags;
+        } else if (OP == CMP && IMM && x->word == 0x00 &&
+                   !(x->live & LV_V) && j >= 0 &&
+                   decode_table[p->inst[j].code].opa == d->opa &&
+                   ((p->inst[j].code & 0xf0) == SRSM ||
+                    ((p->inst[j].code & 0xf0) >= SBC &&
+                     (p->inst[j].code & 0xf0) != CMP))) {
+            count = &st->dead_flags;
+        } else if (OP == LD &&
+                   (!(x->live & A) || (d->opb == ACC && A == LV_ACC) ||
+                    (d->opb == IX && A == LV_IX))) {
+            count = &st->dead_loads;
+        } else if ((OP == LD || OP == ST) && MEM && j >= 0 &&
+                   (p->inst[j].code & 0xf0) == (OP == LD ? ST : LD) &&
+                   (p->inst[j].code & 0x0f) == (x->code & 0x0f) &&
+                   p->inst[j].word == x->word) {
+            count = &st->dead_loads;
+        }
+
+        if (count != NULL) {
+            x->deleted = 1;
+            (*count)++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ *   Deletes what is no longer reached from address 0
+ */
+static int sweep(Program *p, OptStats *st) {
+    Uword seen[IMEMORY_SIZE];
+    int work[IMEMORY_SIZE], s[3];
+    int n_work = 0, i, k, n, changed = 0;
+
+    memset(seen, 0, sizeof(seen));
+    if ((i = resolve(p, p->at[0])) < 0) return 0;
+    seen[i] = 1;
+    work[n_work++] = i;
+    while (n_work > 0) {
+        i = work[--n_work];
+        n = successors(p, i, s);
+        if (go(p->inst[i].code) == GO_CALL)
+            if ((s[n] = resolve(p, p->inst[i].fall)) >= 0) n++;
+        for (k = 0; k < n; k++)
+            if (!seen[s[k]]) {
+                seen[s[k]] = 1;
+                work[n_work++] = s[k];
+            }
+    }
+    for (i = 0; i < p->n; i++)
+        if (!p->inst[i].deleted && !seen[i]) {
+            p->inst[i].deleted = 1;
+            st->unreachable++;
+            changed = 1;
+        }
+    return changed;
+}
+
+/*=============================================================================
+ *   Layout
+ *===========================================================================*/
+static void emit(const Program *p, Cpub *out, OptStats *st) {
+    Uword addr[IMEMORY_SIZE];
+    int i, a = 0;
+
+    if (!p->fixed) memset(out->mem, 0, IMEMORY_SIZE);
+    for (i = 0; i < p->n; i++) {
+        if (p->inst[i].deleted) continue;
+        addr[i] = p->fixed ? p->inst[i].addr : a;
+        a += p->inst[i].length;
+        st->insts[1]++;
+        st->words[1] += p->inst[i].length;
+    }
+    for (i = 0; i < p->n; i++) {
+        const Inst *x = &p->inst[i];
+        const int T = resolve(p, x->target);
+
+        if (x->code == JAL && resolve(p, x->fall) >= 0)
+            st->returns[(Uword)(x->addr + 2)] = addr[resolve(p, x->fall)];
+        if (x->deleted) continue;
+        out->mem[addr[i]] = x->code;
+        if (x->length == 2)
+            out->mem[(Uword)(addr[i] + 1)] =
+                x->target >= 0 && T >= 0 ? addr[T] : x->word;
+    }
+}
+
+/*=============================================================================
+ *   Differential Check
+ *===========================================================================*/
+/*
+ *   Runs copies of both boards from address 0 on the same inputs.  Returns
+ *   nonzero if the runs end the same way after the same inputs, with the
+ *   same outputs and data area, and at HLT the same ACC and IX (or the
+ *   same JAL return address, relocated).
+ */
+int opt_compare(const Cpub *a, const Cpub *b, const OptStats *st,
+                const Uword *in, int n_in, OptRun *r) {
+    const Cpub *BOARD[2] = {a, b};
+    Uword out[2][OPT_MAX_OUT];
+    RunScript rs[2];
+    IOBuf ibuf[2];
+    Cpub c[2], start;
+    int k, halted;
+
+    for (k = 0; k < 2; k++) {
+        c[k] = *BOARD[k];
+        c[k].pc = 0;
+        ibuf[k] = *BOARD[k]->ibuf;
+        c[k].ibuf = &ibuf[k];
+        c[k].watch = NULL;
+        c[k].mmio = NULL;
+        memset(&rs[k], 0, sizeof(rs[k]));
+        rs[k].in = in;
+        rs[k].n_in = n_in;
+        rs[k].out = out[k];
+        rs[k].max_out = OPT_MAX_OUT;
+        r->status[k] = run_script(&c[k], &rs[k], OPT_MAX_STEPS);
+        r->steps[k] = rs[k].steps;
+
+        /* the same steps again from the start, counting cycles */
+        start = *BOARD[k];
+        start.pc = 0;
+        r->cycles[k] = wcet_measure(&start, in, n_in, rs[k].steps, &halted);
+    }
+
+    if (r->status[0] == SCRIPT_LIMIT)
+        r->differ = "no end of the original";
+    else if (r->status[1] != r->status[0])
+        r->differ = "end";
+    else if (rs[1].in_pos != rs[0].in_pos)
+        r->differ = "inputs";
+    else if (rs[1].n_out != rs[0].n_out ||
+             memcmp(out[1], out[0],
+                    rs[0].n_out < OPT_MAX_OUT ? rs[0].n_out : OPT_MAX_OUT) != 0)
+        r->differ = "outputs";
+    else if (memcmp(c[1].mem + IMEMORY_SIZE, c[0].mem + IMEMORY_SIZE,
+                    IMEMORY_SIZE) != 0)
+        r->differ = "data";
+    else if (r->status[0] == SCRIPT_HALT &&
+             (!same_reg(st, c[0].acc, c[1].acc) ||
+              !same_reg(st, c[0].ix, c[1].ix)))
+        r->differ = "registers";
+    else
+        r->differ = NULL;
+    return r->differ == NULL;
+}
+
+static int same_reg(const OptStats *st, Uword before, Uword after) {
+    return after == before || st->returns[before] == after;
+}
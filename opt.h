@@ -0,0 +1,44 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	opt.h
+ *	Descrioption:	peephole optimizer of the program area
+ */
+
+#ifndef OPT_H
+#define OPT_H
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Optimization
+ *===========================================================================*/
+typedef struct opt_stats {
+    int insts[2];    /* reachable instructions: before, after */
+    int words[2];
+    int fixed;       /* the layout is kept: only branches are retargeted */
+    int threaded;    /* branches retargeted past a BA */
+    int branches;    /* branches removed or turned into HLT */
+    int dead_flags;  /* CMP, SCF, ... whose flags are never read */
+    int dead_loads;  /* LD whose register is never read, or already held */
+    int unreachable; /* instructions no longer reached */
+    short returns[IMEMORY_SIZE]; /* new address of a JAL return, or -1 */
+} OptStats;
+
+int optimize(const Cpub *, Cpub *, OptStats *);
+
+/*=============================================================================
+ *   Differential Check on an Input
+ *===========================================================================*/
+typedef struct opt_run {
+    int status[2]; /* SCRIPT_*: original, optimized */
+    long steps[2];
+    long cycles[2];
+    const char *differ; /* what differs, or NULL */
+} OptRun;
+
+int opt_compare(const Cpub *, const Cpub *, const OptStats *, const Uword *,
+                int, OptRun *);
+
+#endif /* OPT_H */
@@ -0,0 +1,272 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	packed.c
+ *	Descrioption:	simulation of an instruction on a packed state
+ *
+ *	packed_step() computes the same results and flags as step() does.  The
+ *	only difference is that CF is a single bit here, so the value that BC
+ *	stores into CF (see step_BBC) is kept as 0 or 1 from the start, as
+ *	every following instruction except ADC and SBC would make it anyway.
+ */
+
+#include "packed.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* how arith() sets CF and VF */
+#define ALU_ADD 0    /* CF is kept, and a carry is an overflow */
+#define ALU_SUB 1    /* CF is kept */
+#define ALU_CARRY 2  /* CF is the carry */
+#define ALU_BORROW 3 /* CF is the borrow */
+
+static Uword *operand_b(PackedCpub *, Uword);
+static Uword arith(PackedCpub *, Uword, Uword, int, int);
+static Uword shift(PackedCpub *, int, Uword);
+static int branch(const PackedCpub *, Uword);
+
+/*=============================================================================
+ *   Conversion from/to Cpub
+ *===========================================================================*/
+void pack_cpub(PackedCpub *p, const Cpub *cpub) {
+    p->pc = cpub->pc;
+    p->acc = cpub->acc;
+    p->ix = cpub->ix;
+    p->flags = (cpub->nf ? PF_N : 0) | (cpub->zf ? PF_Z : 0) |
+               (cpub->vf ? PF_V : 0) | (cpub->cf ? PF_C : 0);
+    p->ibuf = *cpub->ibuf;
+    p->obuf = cpub->obuf;
+    p->quiet = 0;
+    memcpy(p->mem, cpub->mem, MEMORY_SIZE);
+}
+
+/*
+ *   ibuf is written back to the IOBuf that cpub->ibuf points to
+ */
+void unpack_cpub(Cpub *cpub, const PackedCpub *p) {
+    cpub->pc = p->pc;
+    cpub->acc = p->acc;
+    cpub->ix = p->ix;
+    cpub->nf = (p->flags & PF_N) != 0;
+    cpub->zf = (p->flags & PF_Z) != 0;
+    cpub->vf = (p->flags & PF_V) != 0;
+    cpub->cf = (p->flags & PF_C) != 0;
+    *cpub->ibuf = p->ibuf;
+    cpub->obuf = p->obuf;
+    memcpy(cpub->mem, p->mem, MEMORY_SIZE);
+}
+
+/*=============================================================================
+ *   Top Function of an Instruction Simulation
+ *===========================================================================*/
+int packed_step(PackedCpub *p) {
+    const Uword IR = p->mem[p->pc++];
+    Uword *a = (IR & 0x08) ? &p->ix : &p->acc;
+    Uword *b, c;
+
+    switch (IR & 0xf0) {
+        case 0x00:
+            if ((IR & 0xf8) == NOP) {
+                break;
+            } else if (((IR & 0xfc) | 0x03) == HLT) {
+                return RUN_HALT;
+            } else if (IR == JAL) {
+                c = p->mem[p->pc++];
+                p->acc = p->pc;
+                p->pc = c;
+            } else if (IR == JR) {
+                p->pc = p->acc;
+            } else {
+                if (!p->quiet)
+                    fprintf(stderr, "%#x is unknown or not implemented "
+                                    "instruction code.\n",
+                            IR);
+                return RUN_HALT;
+            }
+            break;
+        case 0x10:
+            if ((IR & 0xf8) == OUT) {
+                p->obuf.buf = p->acc;
+                p->obuf.flag = 1;
+            } else {
+                p->acc = p->ibuf.buf;
+                p->ibuf.flag = 0;
+            }
+            break;
+        case 0x20:
+            p->flags = (p->flags & ~PF_C) | ((IR & 0xf8) == RCF ? 0 : PF_C);
+            break;
+        case LD:
+            *a = *operand_b(p, IR & 0x07);
+            break;
+        case ST:
+            if ((IR & 0x07) < ABSOLUTE_PROGRAM_ADDRESS) {
+                /* same messages as step_ST */
+                p->pc++;
+                if (p->quiet)
+                    ;
+                else if ((IR & 0x07) == ACC)
+                    fprintf(stderr, "ACC is Undefined operating(ST)\n");
+                else if ((IR & 0x07) == IX)
+                    fprintf(stderr, "IX is Undefined operating (ST)\n");
+                else
+                    fprintf(stderr, "IMMEDIATE_ADDRESS is Undefined "
+                                    "operating in (ST)\n");
+                return RUN_HALT;
+            }
+            *operand_b(p, IR & 0x07) = *a;
+            break;
+        case ADD:
+            b = operand_b(p, IR & 0x07);
+            *a = arith(p, *a, *b, *a + *b, ALU_ADD);
+            break;
+        case ADC:
+            b = operand_b(p, IR & 0x07);
+            *a = arith(p, *a, *b, *a + *b + (p->flags & PF_C), ALU_CARRY);
+            break;
+        case SUB:
+            c = ~*operand_b(p, IR & 0x07) + 1;
+            *a = arith(p, *a, c, *a + c, ALU_SUB);
+            break;
+        case CMP:
+            c = ~*operand_b(p, IR & 0x07) + 1;
+            arith(p, *a, c, *a + c, ALU_SUB);
+            break;
+        case SBC:
+            c = ~*operand_b(p, IR & 0x07) + 1;
+            *a = arith(p, *a, c, *a + c - (p->flags & PF_C), ALU_BORROW);
+            break;
+        case EOR:
+        case OR:
+        case AND:
+            b = operand_b(p, IR & 0x07);
+            c = (IR & 0xf0) == AND ? *a & *b
+              : (IR & 0xf0) == OR  ? *a | *b
+                                   : *a ^ *b;
+            p->flags = (p->flags & PF_C) | (c & 0x80 ? PF_N : 0) |
+                       (c ? 0 : PF_Z);
+            *a = c;
+            break;
+        case SRSM:
+            *a = shift(p, IR & 0x07, *a);
+            break;
+        case BBC:
+            c = p->mem[p->pc++];
+            if ((IR & 0x0f) == 0xd) { /* BC: as step_BBC does */
+                if (!c) p->flags &= ~PF_C;
+            } else if (branch(p, IR & 0x0f)) {
+                p->pc = c;
+            }
+            break;
+        default:
+            if (!p->quiet)
+                fprintf(stderr,
+                        "%#x is unknown or not implemented instruction code.\n",
+                        IR);
+            return RUN_HALT;
+    }
+    return RUN_STEP;
+}
+
+int packed_step_n(PackedCpub *p, long max_steps, long *n_steps) {
+    int status = RUN_STEP;
+    long n = 0;
+
+    while (n < max_steps && status == RUN_STEP) {
+        status = packed_step(p);
+        n++;
+    }
+    if (n_steps) *n_steps = n;
+    return status;
+}
+
+/*=============================================================================
+ *   Operand and ALU
+ *===========================================================================*/
+/*
+ *   Location of operand B; the second word is fetched if the mode has one
+ */
+static inline Uword *operand_b(PackedCpub *p, Uword opb) {
+    switch (opb) {
+        case ACC:
+            return &p->acc;
+        case IX:
+            return &p->ix;
+        case ABSOLUTE_PROGRAM_ADDRESS:
+            return &p->mem[p->mem[p->pc++]];
+        case ABSOLUTE_DATA_ADDRESS:
+            return &p->mem[0x100 + p->mem[p->pc++]];
+        case IX_MODIFICATION_PROGRAM_ADDRESS:
+            return &p->mem[(Uword)(p->ix + p->mem[p->pc++])];
+        case IX_MODIFICATION_DATA_ADDRESS:
+            return &p->mem[0x100 + (Uword)(p->ix + p->mem[p->pc++])];
+        default: /* IMMEDIATE_ADDRESS */
+            return &p->mem[p->pc++];
+    }
+}
+
+static inline Uword arith(PackedCpub *p, Uword x, Uword y, int sum, int mode) {
+    const Uword CARRY = (sum >> 8) & 1;
+    Uword f = p->flags & PF_C;
+
+    if (((x ^ sum) & (y ^ sum) & 0x80) || (mode == ALU_ADD && CARRY))
+        f |= PF_V;
+    if (mode == ALU_CARRY) f = (f & ~PF_C) | CARRY;
+    if (mode == ALU_BORROW) f = (f & ~PF_C) | !CARRY;
+    if (sum & 0x80) f |= PF_N;
+    if (!(sum & 0xff)) f |= PF_Z;
+    p->flags = f;
+    return sum;
+}
+
+/*
+ *   SRA SLA SRL SLL RRA RLA RRL RLL, as in step_SRSM
+ */
+static Uword shift(PackedCpub *p, int mode, Uword v) {
+    Uword ans, push, f;
+
+    if (mode & 1) {
+        push = (mode == 5) ? (p->flags & PF_C) : (mode == 7) ? (v >> 7) : 0;
+        ans = ((v << 1) & 0xfe) | push;
+        f = v >> 7;
+        if ((mode == 1 || mode == 5) && ((v ^ ans) & 0x80)) f |= PF_V;
+    } else {
+        push = (mode == 0) ? (v >> 7) : (mode == 4) ? (p->flags & PF_C)
+                                      : (mode == 6) ? (v & 1) : 0;
+        ans = ((v >> 1) & 0x7f) | (push << 7);
+        f = v & 1;
+    }
+    if (ans & 0x80) f |= PF_N;
+    if (!ans) f |= PF_Z;
+    p->flags = f;
+    return ans;
+}
+
+/*
+ *   Branch conditions, as in step_BBC (except BC)
+ */
+static int branch(const PackedCpub *p, Uword code) {
+    const Uword F = p->flags;
+    const int N = (F & PF_N) != 0, Z = (F & PF_Z) != 0, V = (F & PF_V) != 0;
+
+    switch (code & 0x07) {
+        case 0x0: /* BA/BVF */
+            return code & 0x08 ? V : 1;
+        case 0x1: /* BNZ/BZ */
+            return Z == ((code & 0x08) != 0);
+        case 0x2: /* BZP/BN */
+            return N == ((code & 0x08) != 0);
+        case 0x3: /* BP/BZN */
+            return (N | Z) == ((code & 0x08) != 0);
+        case 0x4: /* BNI/BNO */
+            return code & 0x08 ? p->obuf.flag != 0 : !p->ibuf.flag;
+        case 0x5: /* BNC */
+            return !(F & PF_C);
+        case 0x6: /* BGE/BLT */
+            return (V ^ N) == ((code & 0x08) != 0);
+        default: /* BGT/BLE */
+            return ((V ^ N) | Z) == ((code & 0x08) != 0);
+    }
+}
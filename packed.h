@@ -0,0 +1,48 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	packed.h
+ *	Descrioption:	packed state of a board for running many boards at once
+ */
+
+#ifndef PACKED_H
+#define PACKED_H
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Packed Board State
+ *===========================================================================*/
+#define PF_N 0x08
+#define PF_Z 0x04
+#define PF_V 0x02
+#define PF_C 0x01
+
+/*
+ *   The registers, the flags (one byte, NZVC) and both I/O buffers are on
+ *   the first cache line, and the memory starts on the next one.  ibuf is
+ *   held in place, so no pointer is followed by IN and BNI.  pack_cpub()
+ *   clears quiet.
+ */
+typedef struct packed_cpub {
+    Uword pc;
+    Uword acc;
+    Uword ix;
+    Uword flags;
+    IOBuf ibuf;
+    IOBuf obuf;
+    Uword quiet; /* no message on an illegal instruction */
+    _Alignas(64) Uword mem[MEMORY_SIZE]; /* 0XX:Program, 1XX:Data */
+} PackedCpub;
+
+void pack_cpub(PackedCpub *, const Cpub *);
+void unpack_cpub(Cpub *, const PackedCpub *);
+
+/*=============================================================================
+ *   Simulation on a Packed State (no watchpoints, no memory banks)
+ *===========================================================================*/
+int packed_step(PackedCpub *);
+int packed_step_n(PackedCpub *, long max_steps, long *n_steps);
+
+#endif /* PACKED_H */
@@ -0,0 +1,118 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	profile.c
+ *	Descrioption:	sampling profiler of the simulated program
+ *
+ *	ITIMER_PROF sends SIGPROF for every 1/hz second of CPU time used by the
+ *	process, to the thread that is running.  The handler reads step_pc of
+ *	that thread, which step() keeps up to date with two plain stores, and
+ *	adds one to the counter of that PC.  Nothing else is done while the
+ *	program runs, so the cost is a few stores per step and one short
+ *	handler per sample.
+ */
+
+#include "profile.h"
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "disasm.h"
+
+static atomic_long samples[IMEMORY_SIZE];
+static atomic_long other; /* outside step(): the simulator itself */
+
+static void on_sigprof(int);
+
+/*=============================================================================
+ *   Start/Stop Sampling
+ *===========================================================================*/
+int profile_start(int hz) {
+    struct sigaction sa;
+    struct itimerval it;
+    const long USEC = 1000000 / hz;
+    int pc;
+
+    for (pc = 0; pc < IMEMORY_SIZE; pc++) atomic_store(&samples[pc], 0);
+    atomic_store(&other, 0);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigprof;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) < 0) return -1;
+
+    it.it_interval.tv_sec = USEC / 1000000;
+    it.it_interval.tv_usec = USEC % 1000000;
+    it.it_value = it.it_interval;
+    return setitimer(ITIMER_PROF, &it, NULL);
+}
+
+void profile_stop(void) {
+    struct itimerval it;
+
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, NULL);
+}
+
+static void on_sigprof(int sig) {
+    const sig_atomic_t PC = step_pc;
+
+    (void)sig;
+    if (PC >= 0)
+        atomic_fetch_add_explicit(&samples[PC], 1, memory_order_relaxed);
+    else
+        atomic_fetch_add_explicit(&other, 1, memory_order_relaxed);
+}
+
+/*=============================================================================
+ *   Results
+ *===========================================================================*/
+/*
+ *   Samples by PC into counts[IMEMORY_SIZE], and the samples outside
+ *   step() into *outside.  Returns the number of samples in step().
+ */
+long profile_counts(long *counts, long *outside) {
+    long total = 0;
+    int pc;
+
+    for (pc = 0; pc < IMEMORY_SIZE; pc++) {
+        counts[pc] = atomic_load_explicit(&samples[pc], memory_order_relaxed);
+        total += counts[pc];
+    }
+    if (outside != NULL) *outside = atomic_load(&other);
+    return total;
+}
+
+/*
+ *   Folded stacks for flamegraph.pl: the samples of each instruction are
+ *   under the basic block that contains it, which starts at the nearest
+ *   branch target (or address 0) at or before the instruction.
+ */
+void profile_fold(Cpub *cpub, FILE *fp) {
+    long counts[IMEMORY_SIZE], outside;
+    Uword target[IMEMORY_SIZE / 8];
+    const char *text;
+    int pc, block;
+
+    profile_counts(counts, &outside);
+    memset(target, 0, sizeof(target));
+    for (pc = 0; pc < IMEMORY_SIZE; pc += decode_table[cpub->mem[pc]].length) {
+        if (decode_table[cpub->mem[pc]].format == FMT_ADDR) {
+            const Uword TO = cpub->mem[(pc + 1) & 0xff];
+            target[TO >> 3] |= 1 << (TO & 7);
+        }
+    }
+
+    for (pc = 0, block = 0; pc < IMEMORY_SIZE; pc++) {
+        if (target[pc >> 3] & (1 << (pc & 7))) block = pc;
+        if (counts[pc] == 0) continue;
+        disasm(cpub, pc, &text);
+        fprintf(fp, "cpub;block_%02x;%02x %s %ld\n", block, pc, text,
+                counts[pc]);
+    }
+    if (outside) fprintf(fp, "cpub;[simulator] %ld\n", outside);
+}
@@ -0,0 +1,26 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	profile.h
+ *	Descrioption:	sampling profiler of the simulated program
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Sampling Profiler (SIGPROF)
+ *===========================================================================*/
+#define PROFILE_HZ 997 /* default rate: prime, not in step with loops */
+
+int profile_start(int);
+void profile_stop(void);
+long profile_counts(long *, long *);
+void profile_fold(Cpub *, FILE *);
+
+#endif /* PROFILE_H */
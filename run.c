@@ -0,0 +1,59 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	run.c
+ *	Descrioption:	input-scripted execution
+ */
+
+#include "run.h"
+
+#include "loop.h"
+
+/*=============================================================================
+ *   Run a Program with Scripted Input
+ *===========================================================================*/
+/*
+ *   Whenever ibuf is empty, the next input byte is put into it, so every IN
+ *   and every NO_INPUT poll sees the script.  Every OUT is taken from obuf
+ *   into the output buffer.  Runs at most max_steps instructions.
+ *
+ *   A loop that can neither consume an input nor reach the output count
+ *   stops the run as soon as its state repeats.
+ */
+int run_script(Cpub *cpub, RunScript *rs, long max_steps) {
+    IOBuf *ibuf = cpub->ibuf;
+    LoopDetector ld;
+    Uword prev_pc;
+    int status;
+
+    loop_reset(&ld);
+    while (rs->steps < max_steps) {
+        if (!ibuf->flag && rs->in_pos < rs->n_in) {
+            ibuf->buf = rs->in[rs->in_pos++];
+            ibuf->flag = 1;
+        }
+
+        prev_pc = cpub->pc;
+        status = step(cpub);
+        rs->steps++;
+
+        if (cpub->obuf.flag) {
+            if (rs->n_out < rs->max_out) rs->out[rs->n_out] = cpub->obuf.buf;
+            rs->n_out++;
+            cpub->obuf.flag = 0;
+            if (rs->n_out == rs->stop_out) return SCRIPT_OUTPUT;
+        }
+
+        if (status == RUN_HALT) return SCRIPT_HALT;
+        if (status == RUN_BREAK) return SCRIPT_BREAK;
+
+        if (cpub->pc <= prev_pc &&
+            loop_head(&ld, cpub, rs->steps,
+                      (long)rs->in_pos << 32 | (rs->stop_out ? rs->n_out : 0))) {
+            rs->loop_period = ld.period;
+            return SCRIPT_LOOP;
+        }
+    }
+    return SCRIPT_LIMIT;
+}
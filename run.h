@@ -0,0 +1,38 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	run.h
+ *	Descrioption:	input-scripted execution
+ */
+
+#ifndef RUN_H
+#define RUN_H
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Input Script and Output Buffer of a Run
+ *===========================================================================*/
+typedef struct run_script {
+    const Uword *in; /* input bytes fed to ibuf */
+    int n_in;
+    int in_pos;      /* next input byte */
+    Uword *out;      /* output bytes taken from obuf */
+    int max_out;     /* size of out */
+    int n_out;
+    int stop_out;    /* stop after this many outputs (0: run until HLT) */
+    long steps;      /* executed instructions */
+    long loop_period; /* instructions per iteration of an endless loop */
+} RunScript;
+
+/* reasons to stop */
+#define SCRIPT_HALT 0   /* HLT or an illegal instruction */
+#define SCRIPT_OUTPUT 1 /* stop_out outputs are collected */
+#define SCRIPT_LIMIT 2  /* step limit is reached */
+#define SCRIPT_BREAK 3  /* a watchpoint was hit */
+#define SCRIPT_LOOP 4   /* an endless loop is detected */
+
+int run_script(Cpub *, RunScript *, long);
+
+#endif /* RUN_H */
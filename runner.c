@@ -0,0 +1,69 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	runner.c
+ *	Descrioption:	standalone runner of a program compiled by cpubgen
+ *
+ *	Usage:	runner [-n max-steps] [-o outputs] [input(hex) ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpubgen.h"
+
+#define MAX_RUNNER_IO 4096
+
+int main(int argc, char *argv[]) {
+    static const char *const REASON[] = {
+        "Program Halted.", "Output Count Reached.",
+        "Too Many Instructions are Executed.", "Watchpoint Hit.",
+        "Endless Loop Detected."};
+    static Uword in[MAX_RUNNER_IO], out[MAX_RUNNER_IO];
+    static Cpub cpub;
+    IOBuf ibuf = {0, 0};
+    RunScript rs = {0};
+    long max_steps = 100000000;
+    unsigned int value;
+    int opt, i, status;
+
+    while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+        switch (opt) {
+            case 'n':
+                max_steps = atol(optarg);
+                break;
+            case 'o':
+                rs.stop_out = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n max-steps] [-o outputs] "
+                                "[input(hex) ...]\n", argv[0]);
+                return 1;
+        }
+    }
+    for (i = optind; i < argc && rs.n_in < MAX_RUNNER_IO; i++) {
+        if (sscanf(argv[i], "%x", &value) != 1 || value > 0xff) {
+            fprintf(stderr, "Invalid value (out of range): %s\n", argv[i]);
+            return 1;
+        }
+        in[rs.n_in++] = value;
+    }
+
+    memcpy(cpub.mem, gen_image, MEMORY_SIZE);
+    cpub.ibuf = &ibuf;
+    rs.in = in;
+    rs.out = out;
+    rs.max_out = MAX_RUNNER_IO;
+
+    status = gen_run(&cpub, &rs, max_steps);
+
+    printf("%s\n\tsteps=%ld inputs=%d/%d\n\toutput:", REASON[status], rs.steps,
+           rs.in_pos, rs.n_in);
+    for (i = 0; i < rs.n_out && i < rs.max_out; i++) printf(" %02x", out[i]);
+    printf("\n\tpc=0x%02x acc=0x%02x ix=0x%02x cf=%d vf=%d nf=%d zf=%d\n",
+           cpub.pc, cpub.acc, cpub.ix, cpub.cf, cpub.vf, cpub.nf, cpub.zf);
+    return status == SCRIPT_HALT || status == SCRIPT_OUTPUT ? 0 : 2;
+}
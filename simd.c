@@ -0,0 +1,599 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	simd.c
+ *	Descrioption:	job server keeping program images resident
+ *
+ *	Usage:	simd [-t threads] socket-path
+ *
+ *	The main thread owns every socket: one epoll_wait() wakeup reads all
+ *	ready connections, parses every complete request in their buffers and
+ *	hands the runs to the worker pool under a single lock.  A worker runs a
+ *	job on its own copy of the board and puts it on the done list; the
+ *	main thread, woken by an eventfd, writes the replies.  Images are only
+ *	added by the main thread and a job carries a pointer to its image, so
+ *	workers read them without a lock.
+ *
+ *	A connection with SIMD_MAX_PENDING runs in flight is not read until
+ *	some of them finish.
+ */
+
+#define _GNU_SOURCE /* accept4 */
+
+#include "simd.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "run.h"
+
+#define SIMD_IMAGES 1024 /* slots of the image table (a power of 2) */
+#define SIMD_EVENTS 64
+#define SIMD_BUF 65536
+#define SIMD_MAX_BODY \
+    (sizeof(SimdRun) + IMEMORY_SIZE + SIMD_MAX_IO)
+#define SIMD_MAX_PENDING 256
+
+typedef struct image {
+    uint64_t hash;
+    int used;
+    Uword mem[MEMORY_SIZE];
+} Image;
+
+typedef struct conn {
+    struct conn *next; /* on the touched or the closed list */
+    int fd;
+    int eof;     /* no more requests: close when the replies are out */
+    int broken;  /* cannot be written: drop the replies */
+    int closed;  /* freed at the end of the wakeup */
+    int touched;
+    int pending; /* runs in flight */
+    uint32_t events;
+    size_t n_in; /* bytes in in[] */
+    Uword in[SIMD_BUF];
+    Uword *out;
+    size_t n_out, out_size;
+} Conn;
+
+typedef struct job {
+    struct job *next;
+    Conn *conn;
+    const Image *image;
+    SimdRun run;
+    Uword data[IMEMORY_SIZE];
+    Uword in[SIMD_MAX_IO];
+    /* the reply */
+    SimdHeader header;
+    SimdResult result;
+    Uword out[SIMD_MAX_IO];
+} Job;
+
+typedef struct queue {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    Job *head, **tail;
+} Queue;
+
+static Image images[SIMD_IMAGES];
+static Queue todo = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                     NULL, &todo.head};
+static Queue done = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                     NULL, &done.head};
+static Job *free_jobs;
+static Conn *closed;
+static int epfd, donefd;
+static volatile sig_atomic_t stopping;
+
+static void on_signal(int);
+static int open_socket(const char *);
+static void accept_conns(int);
+static void read_conn(Conn *, Job ***);
+static void parse_requests(Conn *, Job ***);
+static int load_image(const Uword *, uint64_t *);
+static const Image *find_image(uint64_t);
+static uint64_t hash_image(const Uword *);
+static void reply(Conn *, uint32_t, int, int, const void *, size_t,
+                  const void *, size_t);
+static void flush_conn(Conn *);
+static void update_conn(Conn *);
+static void finish_jobs(Job ***);
+static void *worker(void *);
+static void run_job(Job *);
+
+/*=============================================================================
+ *   Main Routine: Event Loop
+ *===========================================================================*/
+int main(int argc, char *argv[]) {
+    static struct epoll_event ev[SIMD_EVENTS];
+    struct sigaction sa;
+    pthread_t *threads;
+    long threads_n = sysconf(_SC_NPROCESSORS_ONLN);
+    long wakeups = 0, jobs = 0;
+    int opt, lfd, n, i;
+
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+            case 't':
+                threads_n = atol(optarg);
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    }
+    if (optind != argc - 1 || threads_n <= 0) {
+        fprintf(stderr, "usage: %s [-t threads] socket-path\n", argv[0]);
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal; /* no SA_RESTART: epoll_wait returns EINTR */
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    if (getenv(METRICS_ENV) != NULL && metrics_open(getenv(METRICS_ENV)) == 0)
+        atexit(metrics_close);
+
+    if ((lfd = open_socket(argv[optind])) < 0) return 1;
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    donefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || donefd < 0) {
+        perror("epoll");
+        return 1;
+    }
+    ev[0].events = EPOLLIN;
+    ev[0].data.ptr = &lfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev[0]);
+    ev[0].data.ptr = &donefd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, donefd, &ev[0]);
+
+    threads = malloc(threads_n * sizeof(pthread_t));
+    for (i = 0; i < threads_n; i++)
+        pthread_create(&threads[i], NULL, worker, NULL);
+    fprintf(stderr, "simd: listening on %s with %ld threads\n", argv[optind],
+            threads_n);
+
+    while (!stopping) {
+        Job *batch = NULL, **tail = &batch, *j;
+        Conn *c;
+
+        if ((n = epoll_wait(epfd, ev, SIMD_EVENTS, -1)) < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        wakeups++;
+        for (i = 0; i < n; i++) {
+            if (ev[i].data.ptr == &lfd) {
+                accept_conns(lfd);
+            } else if (ev[i].data.ptr == &donefd) {
+                finish_jobs(&tail);
+            } else {
+                c = ev[i].data.ptr;
+                if (c->closed) continue;
+                if (ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    read_conn(c, &tail);
+                if (ev[i].events & (EPOLLHUP | EPOLLERR))
+                    c->broken = 1; /* the client is gone */
+                if (ev[i].events & EPOLLOUT) flush_conn(c);
+                update_conn(c);
+            }
+        }
+        while ((c = closed) != NULL) {
+            closed = c->next;
+            free(c->out);
+            free(c);
+        }
+
+        /* all runs of this wakeup at once */
+        for (j = batch; j != NULL; j = j->next) jobs++;
+        if (batch != NULL) {
+            pthread_mutex_lock(&todo.lock);
+            *todo.tail = batch;
+            todo.tail = tail;
+            pthread_cond_broadcast(&todo.ready);
+            pthread_mutex_unlock(&todo.lock);
+        }
+    }
+
+    pthread_mutex_lock(&todo.lock);
+    pthread_cond_broadcast(&todo.ready);
+    pthread_mutex_unlock(&todo.lock);
+    for (i = 0; i < threads_n; i++) pthread_join(threads[i], NULL);
+    free(threads);
+    unlink(argv[optind]);
+    fprintf(stderr, "simd: %ld runs in %ld wakeups\n", jobs, wakeups);
+    return 0;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+static int open_socket(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path); /* left by a server that was killed */
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        perror(path);
+        return -1;
+    }
+    return fd;
+}
+
+/*=============================================================================
+ *   Connections
+ *===========================================================================*/
+static void accept_conns(int lfd) {
+    struct epoll_event ev;
+    Conn *c;
+    int fd;
+
+    while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if ((c = calloc(1, sizeof(Conn))) == NULL) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+        ev.events = c->events;
+        ev.data.ptr = c;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static void read_conn(Conn *c, Job ***tail) {
+    ssize_t n;
+
+    while (!c->eof && c->n_in < SIMD_BUF) {
+        n = read(c->fd, c->in + c->n_in, SIMD_BUF - c->n_in);
+        if (n > 0) {
+            c->n_in += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                c->eof = 1;
+            break;
+        }
+    }
+    parse_requests(c, tail);
+}
+
+/*
+ *   Answers the loads and queues the runs of every complete request
+ */
+static void parse_requests(Conn *c, Job ***tail) {
+    size_t pos = 0;
+
+    while (!c->broken && c->pending < SIMD_MAX_PENDING &&
+           c->n_in - pos >= sizeof(SimdHeader)) {
+        SimdHeader h;
+        const Uword *body = c->in + pos + sizeof(SimdHeader);
+
+        memcpy(&h, c->in + pos, sizeof(h));
+        if (h.length > SIMD_MAX_BODY) { /* cannot be framed any more */
+            reply(c, h.tag, h.type, SIMD_EREQUEST, NULL, 0, NULL, 0);
+            c->eof = 1;
+            pos = c->n_in;
+            break;
+        }
+        if (c->n_in - pos < sizeof(h) + h.length) break;
+        pos += sizeof(h) + h.length;
+
+        if (h.type == SIMD_LOAD && h.length == MEMORY_SIZE) {
+            uint64_t hash;
+            int status = load_image(body, &hash);
+
+            reply(c, h.tag, h.type, status, &hash,
+                  status == SIMD_OK ? sizeof(hash) : 0, NULL, 0);
+        } else if (h.type == SIMD_RUN && h.length >= sizeof(SimdRun)) {
+            Job *j = free_jobs;
+            SimdRun run;
+            size_t need;
+
+            memcpy(&run, body, sizeof(run));
+            need = sizeof(run) + (run.flags & SIMD_DATA ? IMEMORY_SIZE : 0) +
+                   run.n_in;
+            /* flags are 0 or 1, as the 's' command requires */
+            if (h.length != need || run.n_in > SIMD_MAX_IO ||
+                (run.cf | run.vf | run.nf | run.zf) > 1) {
+                reply(c, h.tag, h.type, SIMD_EREQUEST, NULL, 0, NULL, 0);
+                continue;
+            }
+            if (find_image(run.image) == NULL) {
+                reply(c, h.tag, h.type, SIMD_EIMAGE, NULL, 0, NULL, 0);
+                continue;
+            }
+            if (j != NULL)
+                free_jobs = j->next;
+            else if ((j = malloc(sizeof(Job))) == NULL)
+                break; /* try again after some runs finish */
+            j->next = NULL;
+            j->conn = c;
+            j->image = find_image(run.image);
+            j->run = run;
+            body += sizeof(run);
+            if (run.flags & SIMD_DATA) {
+                memcpy(j->data, body, IMEMORY_SIZE);
+                body += IMEMORY_SIZE;
+            }
+            memcpy(j->in, body, run.n_in);
+            j->header.tag = h.tag;
+            j->header.type = h.type;
+            c->pending++;
+            **tail = j;
+            *tail = &j->next;
+        } else {
+            reply(c, h.tag, h.type, SIMD_EREQUEST, NULL, 0, NULL, 0);
+        }
+    }
+    memmove(c->in, c->in + pos, c->n_in - pos);
+    c->n_in -= pos;
+}
+
+/*
+ *   Appends a reply (header, then a and b) to the output of the connection
+ */
+static void reply(Conn *c, uint32_t tag, int type, int status, const void *a,
+                  size_t n_a, const void *b, size_t n_b) {
+    SimdHeader h = {tag, type, status, 0, n_a + n_b};
+    const size_t N = sizeof(h) + n_a + n_b;
+
+    if (c->broken) return;
+    if (c->n_out + N > c->out_size) {
+        size_t size = c->out_size ? c->out_size : SIMD_BUF;
+        Uword *p;
+
+        while (c->n_out + N > size) size *= 2;
+        if ((p = realloc(c->out, size)) == NULL) {
+            c->broken = 1;
+            return;
+        }
+        c->out = p;
+        c->out_size = size;
+    }
+    memcpy(c->out + c->n_out, &h, sizeof(h));
+    if (n_a) memcpy(c->out + c->n_out + sizeof(h), a, n_a);
+    if (n_b) memcpy(c->out + c->n_out + sizeof(h) + n_a, b, n_b);
+    c->n_out += N;
+}
+
+static void flush_conn(Conn *c) {
+    size_t pos = 0;
+    ssize_t n;
+
+    while (!c->broken && pos < c->n_out) {
+        n = send(c->fd, c->out + pos, c->n_out - pos, MSG_NOSIGNAL);
+        if (n > 0)
+            pos += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                c->broken = 1;
+            break;
+        }
+    }
+    if (c->broken) pos = c->n_out;
+    memmove(c->out, c->out + pos, c->n_out - pos);
+    c->n_out -= pos;
+}
+
+/*
+ *   Closes a finished connection, or waits for what it can do next
+ */
+static void update_conn(Conn *c) {
+    struct epoll_event ev;
+    uint32_t events = 0;
+
+    if (c->n_out > 0) flush_conn(c);
+    if ((c->eof || c->broken) && c->pending == 0 && c->n_out == 0) {
+        close(c->fd); /* also leaves the epoll set */
+        c->closed = 1;
+        c->next = closed;
+        closed = c;
+        return;
+    }
+    if (c->broken) { /* only waits for its runs */
+        if (c->events != 0) epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        c->events = 0;
+        return;
+    }
+    if (!c->eof && c->pending < SIMD_MAX_PENDING &&
+        c->n_in < SIMD_BUF)
+        events |= EPOLLIN;
+    if (c->n_out > 0) events |= EPOLLOUT;
+    if (events != c->events) {
+        c->events = events;
+        ev.events = events;
+        ev.data.ptr = c;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    }
+}
+
+/*=============================================================================
+ *   Image Table (open addressing by the hash)
+ *===========================================================================*/
+static int load_image(const Uword *mem, uint64_t *hash) {
+    uint64_t i, n;
+
+    *hash = hash_image(mem);
+    for (i = *hash, n = 0; n < SIMD_IMAGES; i++, n++) {
+        Image *im = &images[i & (SIMD_IMAGES - 1)];
+
+        if (!im->used) {
+            im->hash = *hash;
+            memcpy(im->mem, mem, MEMORY_SIZE);
+            im->used = 1;
+            return SIMD_OK;
+        }
+        if (im->hash == *hash)
+            return memcmp(im->mem, mem, MEMORY_SIZE) == 0 ? SIMD_OK
+                                                           : SIMD_EFULL;
+    }
+    return SIMD_EFULL;
+}
+
+static const Image *find_image(uint64_t hash) {
+    uint64_t i, n;
+
+    for (i = hash, n = 0; n < SIMD_IMAGES; i++, n++) {
+        const Image *im = &images[i & (SIMD_IMAGES - 1)];
+
+        if (!im->used) return NULL;
+        if (im->hash == hash) return im;
+    }
+    return NULL;
+}
+
+/*
+ *   Processes 8 bytes at a time with a multiply-xorshift mixer
+ */
+static uint64_t hash_image(const Uword *mem) {
+    uint64_t h = 0xcbf29ce484222325ULL, w;
+    int i;
+
+    for (i = 0; i < MEMORY_SIZE; i += 8) {
+        memcpy(&w, mem + i, 8);
+        h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+/*=============================================================================
+ *   Worker Pool
+ *===========================================================================*/
+static void *worker(void *arg) {
+    static const uint64_t ONE = 1;
+    Job *j;
+    int first;
+
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&todo.lock);
+        while (todo.head == NULL && !stopping)
+            pthread_cond_wait(&todo.ready, &todo.lock);
+        if ((j = todo.head) == NULL) {
+            pthread_mutex_unlock(&todo.lock);
+            return NULL;
+        }
+        if ((todo.head = j->next) == NULL) todo.tail = &todo.head;
+        pthread_mutex_unlock(&todo.lock);
+
+        run_job(j);
+
+        /* the first job on the done list wakes the main thread */
+        j->next = NULL;
+        pthread_mutex_lock(&done.lock);
+        first = done.head == NULL;
+        *done.tail = j;
+        done.tail = &j->next;
+        pthread_mutex_unlock(&done.lock);
+        if (first && write(donefd, &ONE, sizeof(ONE)) < 0) perror("eventfd");
+    }
+}
+
+static void run_job(Job *j) {
+    const SimdRun *r = &j->run;
+    SimdResult *res = &j->result;
+    IOBuf ibuf = {r->flags & SIMD_IBUF ? 1 : 0, r->ibuf};
+    RunScript rs = {0};
+    Cpub cpub;
+
+    memset(&cpub, 0, sizeof(cpub));
+    memcpy(cpub.mem, j->image->mem, MEMORY_SIZE);
+    if (r->flags & SIMD_DATA)
+        memcpy(cpub.mem + IMEMORY_SIZE, j->data, IMEMORY_SIZE);
+    cpub.pc = r->pc;
+    cpub.acc = r->acc;
+    cpub.ix = r->ix;
+    cpub.cf = r->cf;
+    cpub.vf = r->vf;
+    cpub.nf = r->nf;
+    cpub.zf = r->zf;
+    cpub.ibuf = &ibuf;
+    rs.in = j->in;
+    rs.n_in = r->n_in;
+    rs.out = j->out;
+    rs.max_out = SIMD_MAX_IO;
+    rs.stop_out = r->stop_out;
+
+    res->status = run_script(&cpub, &rs, r->max_steps);
+    res->steps = rs.steps;
+    res->in_pos = rs.in_pos;
+    res->n_out = rs.n_out < SIMD_MAX_IO ? rs.n_out : SIMD_MAX_IO;
+    res->ibuf_flag = ibuf.flag;
+    res->pc = cpub.pc;
+    res->acc = cpub.acc;
+    res->ix = cpub.ix;
+    res->cf = cpub.cf;
+    res->vf = cpub.vf;
+    res->nf = cpub.nf;
+    res->zf = cpub.zf;
+    res->reserved = 0;
+    memcpy(res->data, cpub.mem + IMEMORY_SIZE, IMEMORY_SIZE);
+}
+
+/*
+ *   Sends the replies of the finished runs.  A connection that was held
+ *   back goes on with the requests in its buffer.
+ */
+static void finish_jobs(Job ***tail) {
+    uint64_t count;
+    Job *list, *j;
+    Conn *touched = NULL, *c;
+
+    if (read(donefd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("eventfd");
+    pthread_mutex_lock(&done.lock);
+    list = done.head;
+    done.head = NULL;
+    done.tail = &done.head;
+    pthread_mutex_unlock(&done.lock);
+
+    while ((j = list) != NULL) {
+        list = j->next;
+        c = j->conn;
+        reply(c, j->header.tag, j->header.type, SIMD_OK, &j->result,
+              sizeof(j->result), j->out, j->result.n_out);
+        c->pending--;
+        if (!c->touched) {
+            c->touched = 1;
+            c->next = touched;
+            touched = c;
+        }
+        j->next = free_jobs;
+        free_jobs = j;
+    }
+    while ((c = touched) != NULL) {
+        touched = c->next;
+        c->touched = 0;
+        parse_requests(c, tail);
+        update_conn(c);
+    }
+}
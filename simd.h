@@ -0,0 +1,76 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	simd.h
+ *	Descrioption:	protocol of the simulator job server (simd)
+ *
+ *	A client connects to the Unix-domain stream socket of simd and sends
+ *	requests, each a SimdHeader and a body of header.length bytes.  Every
+ *	request gets one reply of the same form with the same tag; replies to
+ *	runs come back in the order the runs finish, not the order they were
+ *	sent.  All fields are in the byte order of the host (the socket is
+ *	local).
+ *
+ *	SIMD_LOAD	body: the memory image (Uword[MEMORY_SIZE])
+ *			reply: uint64_t hash of the image, which stays loaded
+ *	SIMD_RUN	body: SimdRun, the data area if SIMD_DATA, n_in inputs
+ *			reply: SimdResult and n_out outputs
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Requests and Replies
+ *===========================================================================*/
+#define SIMD_MAX_IO 4096 /* inputs of a run, and outputs returned */
+
+typedef struct simd_header {
+    uint32_t tag;      /* chosen by the client, echoed in the reply */
+    uint8_t type;      /* SIMD_LOAD, SIMD_RUN */
+    uint8_t status;    /* reply: SIMD_OK or SIMD_E* */
+    uint16_t reserved;
+    uint32_t length;   /* bytes of the body that follows */
+} SimdHeader;
+
+/* types */
+#define SIMD_LOAD 1
+#define SIMD_RUN 2
+
+/* statuses */
+#define SIMD_OK 0
+#define SIMD_EREQUEST 1 /* malformed request (no body in the reply) */
+#define SIMD_EIMAGE 2   /* unknown image hash */
+#define SIMD_EFULL 3    /* no room for another image */
+
+typedef struct simd_run {
+    uint64_t image;      /* hash from SIMD_LOAD */
+    uint32_t max_steps;
+    uint32_t flags;      /* SIMD_DATA, SIMD_IBUF */
+    uint16_t n_in;       /* input bytes fed to ibuf */
+    uint16_t stop_out;   /* stop after this many outputs (0: until HLT) */
+    Uword pc, acc, ix, cf, vf, nf, zf;
+    Uword ibuf;          /* in ibuf at the start, if SIMD_IBUF */
+    uint32_t reserved;
+} SimdRun;
+
+#define SIMD_DATA 0x01 /* the data area (Uword[IMEMORY_SIZE]) follows */
+#define SIMD_IBUF 0x02
+
+typedef struct simd_result {
+    uint64_t steps;
+    uint32_t in_pos;     /* inputs taken */
+    uint16_t n_out;      /* output bytes that follow */
+    Uword status;        /* SCRIPT_* */
+    Uword ibuf_flag;     /* an input is left unread in ibuf */
+    Uword pc, acc, ix, cf, vf, nf, zf;
+    Uword reserved;
+    Uword data[IMEMORY_SIZE];
+} SimdResult;
+
+#endif /* SIMD_H */
@@ -0,0 +1,174 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	simtop.c
+ *	Descrioption:	live view of the counters published by the simulator
+ *
+ *	Usage:	simtop [-i seconds] [-n count] [segment-name]
+ *
+ *	The segment is mapped read only and sampled with relaxed loads, so the
+ *	simulator is never stopped or slowed down by this reader.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "disasm.h"
+#include "metrics.h"
+
+#define TOP_OPCODES 8
+
+typedef struct sample {
+    uint64_t steps, halts, illegals, st_faults, io_waits;
+    uint64_t opcode[256];
+    int threads;
+} Sample;
+
+static void take_sample(const MetricsBlock *, Sample *);
+static void display(const MetricsBlock *, const char *, const Sample *,
+                    const Sample *, double);
+static double now(void);
+
+int main(int argc, char *argv[]) {
+    static Sample s[2];
+    const char *name = getenv(METRICS_ENV) ? getenv(METRICS_ENV) : "/cpub";
+    const MetricsBlock *b;
+    double interval = 1.0, t0, t1;
+    long count = -1;
+    int opt, fd, k;
+
+    while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+        switch (opt) {
+            case 'i':
+                interval = atof(optarg);
+                break;
+            case 'n':
+                count = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-i seconds] [-n count] "
+                                "[segment-name]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc) name = argv[optind];
+    if (interval <= 0) interval = 1.0;
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+        perror(name);
+        return 1;
+    }
+    b = mmap(NULL, sizeof(MetricsBlock), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (b == MAP_FAILED) {
+        perror(name);
+        return 1;
+    }
+    if (b->magic != METRICS_MAGIC || b->version != METRICS_VERSION) {
+        fprintf(stderr, "%s is not a metrics segment of this version\n", name);
+        return 1;
+    }
+    init_disasm();
+
+    take_sample(b, &s[0]);
+    t0 = now();
+    for (k = 1; count < 0 || k <= count; k++) {
+        usleep((useconds_t)(interval * 1e6));
+        take_sample(b, &s[k & 1]);
+        t1 = now();
+        display(b, name, &s[k & 1], &s[(k - 1) & 1], t1 - t0);
+        t0 = t1;
+        if (kill(b->pid, 0) < 0 && errno == ESRCH) {
+            printf("simulator (pid %d) has exited\n", b->pid);
+            break;
+        }
+    }
+    return 0;
+}
+
+/*
+ *   Add up the counters of all slots
+ */
+static void take_sample(const MetricsBlock *b, Sample *s) {
+    int i, op;
+
+    memset(s, 0, sizeof(*s));
+    for (i = 0; i < METRICS_THREADS; i++) {
+        const MetricsCounters *c = &b->thread[i];
+#define LOAD(F) atomic_load_explicit(&c->F, memory_order_relaxed)
+        s->threads += LOAD(owned) != 0;
+        s->steps += LOAD(steps);
+        s->halts += LOAD(halts);
+        s->illegals += LOAD(illegals);
+        s->st_faults += LOAD(st_faults);
+        s->io_waits += LOAD(io_waits);
+        for (op = 0; op < 256; op++) s->opcode[op] += LOAD(opcode[op]);
+#undef LOAD
+    }
+}
+
+static void display(const MetricsBlock *b, const char *name, const Sample *s,
+                    const Sample *prev, double dt) {
+    const char *mnemonic[256];
+    uint64_t count[256], total = 0;
+    int n = 0, i, j, op;
+
+    if (isatty(STDOUT_FILENO)) printf("\033[H\033[J");
+    printf("%s  pid %d  threads %d (dropped %u)\n", name, b->pid, s->threads,
+           atomic_load_explicit(&b->dropped, memory_order_relaxed));
+    printf("\t%-12s%14s%16s\n", "", "per second", "total");
+#define RATE(L, F)                                                            \
+    printf("\t%-12s%14.0f%16llu\n", L, (s->F - prev->F) / dt,                  \
+           (unsigned long long)s->F)
+    RATE("steps", steps);
+    RATE("halts", halts);
+    RATE("illegals", illegals);
+    RATE("ST faults", st_faults);
+    RATE("I/O waits", io_waits);
+#undef RATE
+
+    /* executed instructions of the interval by mnemonic */
+    for (op = 0; op < 256; op++) {
+        const uint64_t D = s->opcode[op] - prev->opcode[op];
+        if (D == 0) continue;
+        for (i = 0; i < n && strcmp(mnemonic[i], decode_table[op].mnemonic);
+             i++)
+            ;
+        if (i == n) {
+            mnemonic[n] = decode_table[op].mnemonic;
+            count[n++] = 0;
+        }
+        count[i] += D;
+        total += D;
+    }
+    for (i = 0; i < n && i < TOP_OPCODES; i++) {
+        for (j = i + 1; j < n; j++) {
+            if (count[j] > count[i]) {
+                const char *m = mnemonic[i];
+                uint64_t c = count[i];
+                mnemonic[i] = mnemonic[j];
+                count[i] = count[j];
+                mnemonic[j] = m;
+                count[j] = c;
+            }
+        }
+        printf("\t%-12s%14.0f%15.1f%%\n", mnemonic[i], count[i] / dt,
+               100.0 * count[i] / total);
+    }
+    fflush(stdout);
+}
+
+static double now(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
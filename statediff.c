@@ -0,0 +1,74 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	statediff.c
+ *	Descrioption:	binary comparison of two board states
+ *
+ *	A row of 16 words is compared by one SSE2 compare and a move mask, so
+ *	the whole memory takes 32 compares and identical rows cost nothing
+ *	more.  Without SSE2 the row is compared as two 64-bit words first.
+ */
+
+#include "statediff.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*=============================================================================
+ *   Compare Two States
+ *===========================================================================*/
+/*
+ *   Returns nonzero if the states differ
+ */
+int diff_state(const Cpub *a, const Cpub *b, StateDiff *d) {
+    d->regs = (a->pc != b->pc ? DIFF_PC : 0) |
+              (a->acc != b->acc ? DIFF_ACC : 0) |
+              (a->ix != b->ix ? DIFF_IX : 0) |
+              (a->cf != b->cf ? DIFF_CF : 0) |
+              (a->vf != b->vf ? DIFF_VF : 0) |
+              (a->nf != b->nf ? DIFF_NF : 0) |
+              (a->zf != b->zf ? DIFF_ZF : 0) |
+              (a->ibuf->flag != b->ibuf->flag || a->ibuf->buf != b->ibuf->buf
+                   ? DIFF_IBUF
+                   : 0) |
+              (a->obuf.flag != b->obuf.flag || a->obuf.buf != b->obuf.buf
+                   ? DIFF_OBUF
+                   : 0);
+    d->rows = diff_mem(a->mem, b->mem, d->mask);
+    return d->regs || d->rows;
+}
+
+/*
+ *   Compare two memories row by row.  Returns the bitmap of the rows that
+ *   differ; mask[r] is the bitmap of the words that differ in row r.
+ */
+uint32_t diff_mem(const Uword *a, const Uword *b, uint16_t *mask) {
+    uint32_t rows = 0;
+    int r;
+
+    for (r = 0; r < DIFF_ROWS; r++) {
+        const Uword *x = a + r * DIFF_ROW_SIZE, *y = b + r * DIFF_ROW_SIZE;
+#ifdef __SSE2__
+        const __m128i EQ = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)x),
+                                          _mm_loadu_si128((const __m128i *)y));
+        mask[r] = ~_mm_movemask_epi8(EQ) & 0xffff;
+#else
+        uint64_t x2[2], y2[2];
+        int i;
+
+        memcpy(x2, x, DIFF_ROW_SIZE);
+        memcpy(y2, y, DIFF_ROW_SIZE);
+        mask[r] = 0;
+        if (x2[0] != y2[0] || x2[1] != y2[1]) {
+            for (i = 0; i < DIFF_ROW_SIZE; i++)
+                if (x[i] != y[i]) mask[r] |= 1 << i;
+        }
+#endif
+        if (mask[r]) rows |= (uint32_t)1 << r;
+    }
+    return rows;
+}
@@ -0,0 +1,42 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	statediff.h
+ *	Descrioption:	binary comparison of two board states
+ */
+
+#ifndef STATEDIFF_H
+#define STATEDIFF_H
+
+#include <stdint.h>
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Difference of Two States
+ *===========================================================================*/
+#define DIFF_ROW_SIZE 16
+#define DIFF_ROWS (MEMORY_SIZE / DIFF_ROW_SIZE)
+
+/* registers */
+#define DIFF_PC 0x001
+#define DIFF_ACC 0x002
+#define DIFF_IX 0x004
+#define DIFF_CF 0x008
+#define DIFF_VF 0x010
+#define DIFF_NF 0x020
+#define DIFF_ZF 0x040
+#define DIFF_IBUF 0x080 /* flag or buffer */
+#define DIFF_OBUF 0x100
+
+typedef struct state_diff {
+    unsigned int regs;         /* DIFF_* of the registers that differ */
+    uint32_t rows;             /* bit r: row r of the memory differs */
+    uint16_t mask[DIFF_ROWS];  /* bit i: word i of the row differs */
+} StateDiff;
+
+int diff_state(const Cpub *, const Cpub *, StateDiff *);
+uint32_t diff_mem(const Uword *, const Uword *, uint16_t *);
+
+#endif /* STATEDIFF_H */
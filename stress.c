@@ -0,0 +1,226 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	stress.c
+ *	Descrioption:	multi-thread stress test of step_n()
+ *
+ *	Usage:	stress [-b boards] [-t threads] [-n steps] [-s slice]
+ *
+ *	Each board runs one of two programs over its own random data area,
+ *	from random registers and with an input of its own.  The threads take
+ *	the boards in turn and step them round robin, slice instructions at a
+ *	time, so that all threads are in step() together.  The final states are
+ *	then compared with those of the same boards run one after another on
+ *	the main thread.  The flag table of the adder is also checked against
+ *	the helpers.  Returns 2 if any board differs or the table is wrong.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "asm.h"
+#include "cpuboard.h"
+
+#define MAX_THREADS 64
+
+/* checksum over the data area, with inputs, forever */
+static const char WORKLOAD[] =
+    "        LD   IX,0\n"
+    "loop:   LD   ACC,(IX+0)\n"
+    "        ADC  ACC,(0xff)\n"
+    "        RLL  ACC\n"
+    "        EOR  ACC,IX\n"
+    "        ST   ACC,(IX+0)\n"
+    "        BNI  next\n"
+    "        IN\n"
+    "        ST   ACC,(0xff)\n"
+    "next:   SUB  IX,1\n"
+    "        BNZ  loop\n"
+    "        LD   ACC,(0)\n"
+    "        OUT\n"
+    "        BA   loop\n";
+
+/* branches on the flags of the adder and the shifter, and a subroutine */
+static const char FLAGS_WORKLOAD[] =
+    "        LD   IX,0\n"
+    "loop:   LD   ACC,(IX+0)\n"
+    "        ST   ACC,(0xfd)\n"
+    "        JAL  mix\n"
+    "        LD   ACC,(0xfd)\n"
+    "        ST   ACC,(IX+0)\n"
+    "        SUB  IX,1\n"
+    "        BNZ  loop\n"
+    "        LD   ACC,(0x80)\n"
+    "        OUT\n"
+    "        BA   loop\n"
+    "mix:    ST   ACC,(0xfe)\n"
+    "        LD   ACC,(0xfd)\n"
+    "        SBC  ACC,(0xfc)\n"
+    "        BVF  ovf\n"
+    "        SRA  ACC\n"
+    "        BC   cy\n"
+    "        RLA  ACC\n"
+    "        BA   done\n"
+    "ovf:    EOR  ACC,0x5a\n"
+    "        SLL  ACC\n"
+    "cy:     ADC  ACC,IX\n"
+    "        CMP  ACC,(0xfc)\n"
+    "        BLE  done\n"
+    "        OR   ACC,0x81\n"
+    "        AND  ACC,(0xfb)\n"
+    "done:   ST   ACC,(0xfd)\n"
+    "        ST   ACC,(0xfc)\n"
+    "        LD   ACC,(0xfe)\n"
+    "        JR\n";
+
+typedef struct worker {
+    pthread_t thread;
+    Cpub *cpubs;
+    long *left; /* steps to go of each board, 0 once it stops */
+    long n_boards, first, stride, slice;
+} Worker;
+
+static void *run_boards(void *);
+static uint64_t mix64(uint64_t);
+
+int main(int argc, char *argv[]) {
+    static Cpub init[2];
+    static Worker w[MAX_THREADS];
+    IOBuf ibuf = {0, 0};
+    long n_boards = 4096, steps = 10000, slice = 64, n_threads, done, i, j;
+    Cpub *cpubs, *serial;
+    IOBuf *ibufs;
+    long *left;
+    int opt, t;
+    long n_diff = 0, n_alu;
+
+    n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "b:t:n:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                n_boards = atol(optarg);
+                break;
+            case 't':
+                n_threads = atol(optarg);
+                break;
+            case 'n':
+                steps = atol(optarg);
+                break;
+            case 's':
+                slice = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b boards] [-t threads] "
+                                "[-n steps] [-s slice]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (n_threads < 2) n_threads = 2;
+    if (n_threads > MAX_THREADS) n_threads = MAX_THREADS;
+    if (n_boards < 1 || steps < 1 || slice < 1) {
+        fprintf(stderr, "Invalid value (out of range)\n");
+        return 1;
+    }
+
+    init[0].ibuf = init[1].ibuf = &ibuf;
+    if (assemble(&init[0], WORKLOAD, sizeof(WORKLOAD) - 1) < 0 ||
+        assemble(&init[1], FLAGS_WORKLOAD, sizeof(FLAGS_WORKLOAD) - 1) < 0)
+        return 1;
+
+    cpubs = malloc(n_boards * sizeof(Cpub));
+    serial = malloc(n_boards * sizeof(Cpub));
+    ibufs = malloc(2 * n_boards * sizeof(IOBuf));
+    left = malloc(n_boards * sizeof(long));
+    if (cpubs == NULL || serial == NULL || ibufs == NULL || left == NULL) {
+        fprintf(stderr, "Not enough memory for %ld boards\n", n_boards);
+        return 1;
+    }
+    for (i = 0; i < n_boards; i++) {
+        uint64_t x = mix64(i + 1);
+
+        memcpy(&cpubs[i], &init[i & 1], sizeof(Cpub));
+        for (j = 0; j < IMEMORY_SIZE; j++)
+            cpubs[i].mem[0x100 + j] = (Uword)(x = mix64(x));
+        cpubs[i].acc = (Uword)(x >> 8);
+        cpubs[i].ix = (Uword)(x >> 16);
+        cpubs[i].cf = (x >> 24) & 1;
+        cpubs[i].vf = (x >> 25) & 1;
+        cpubs[i].nf = (x >> 26) & 1;
+        cpubs[i].zf = (x >> 27) & 1;
+        ibufs[i].flag = ibufs[n_boards + i].flag = 1;
+        ibufs[i].buf = ibufs[n_boards + i].buf = (Uword)(x >> 40);
+        cpubs[i].ibuf = &ibufs[i];
+        memcpy(&serial[i], &cpubs[i], sizeof(Cpub));
+        serial[i].ibuf = &ibufs[n_boards + i];
+        left[i] = steps;
+    }
+
+    for (t = 0; t < n_threads; t++) {
+        w[t].cpubs = cpubs;
+        w[t].left = left;
+        w[t].n_boards = n_boards;
+        w[t].first = t;
+        w[t].stride = n_threads;
+        w[t].slice = slice;
+        pthread_create(&w[t].thread, NULL, run_boards, &w[t]);
+    }
+    for (i = 0; i < n_boards; i++) step_n(&serial[i], steps, &done);
+    for (t = 0; t < n_threads; t++) pthread_join(w[t].thread, NULL);
+
+    for (i = 0; i < n_boards; i++) {
+        if (memcmp(cpubs[i].ibuf, serial[i].ibuf, sizeof(IOBuf))) {
+            n_diff++;
+            continue;
+        }
+        cpubs[i].ibuf = serial[i].ibuf = NULL;
+        if (memcmp(&cpubs[i], &serial[i], sizeof(Cpub))) n_diff++;
+    }
+
+    printf("%ld boards x %ld steps on %ld threads (slice %ld)\n", n_boards,
+           steps, n_threads, slice);
+    printf("\tresults: %ld boards differ from the serial run\n", n_diff);
+    n_alu = alu_verify();
+    printf("\tALU table: %ld mismatches in 5 x 2^24 inputs\n", n_alu);
+
+    free(cpubs);
+    free(serial);
+    free(ibufs);
+    free(left);
+    return n_diff || n_alu ? 2 : 0;
+}
+
+/*
+ *   Steps every stride-th board from first, slice instructions at a time,
+ *   until each has run its steps or stopped
+ */
+static void *run_boards(void *arg) {
+    Worker *w = arg;
+    long i, done;
+    int running;
+
+    do {
+        running = 0;
+        for (i = w->first; i < w->n_boards; i += w->stride) {
+            if (w->left[i] == 0) continue;
+            if (step_n(&w->cpubs[i],
+                       w->left[i] < w->slice ? w->left[i] : w->slice,
+                       &done) != RUN_STEP)
+                w->left[i] = 0;
+            else
+                w->left[i] -= done;
+            running |= w->left[i] != 0;
+        }
+    } while (running);
+    return NULL;
+}
+
+static uint64_t mix64(uint64_t x) { /* splitmix64 finalizer */
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
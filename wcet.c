@@ -0,0 +1,508 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	wcet.c
+ *	Descrioption:	static worst-case execution time of a program
+ *
+ *	The program is split into subroutines (the entry, and every JAL target,
+ *	which ends at JR).  The natural loops of a subroutine are found from
+ *	the back edges of a depth-first search; they must nest, and a loop may
+ *	be entered only at its header, otherwise the analysis gives up.
+ *
+ *	V(v, m) is the longest number of cycles from v to the end of a pass:
+ *	bit d of m tells if the pass of the loop at depth d+1 around v ends by
+ *	going back to its header (an iteration), or by leaving it (the exit).
+ *	A loop of header h and bound n entered with mask m then costs
+ *
+ *		(n - 1) * V(h, m | iteration) + V(h, m)
+ *
+ *	Every cycle of the control flow goes through a back edge, which ends a
+ *	pass, so the recursion over V always terminates.  Each V(v, m) is
+ *	computed once, with the successor it takes, which gives the path.
+ */
+
+#include "wcet.h"
+
+#include <string.h>
+
+#include "arena.h"
+#include "disasm.h"
+
+#define UNKNOWN -2
+#define NO_PATH -1
+
+/* how an instruction goes on */
+#define FLOW_NEXT 0
+#define FLOW_HALT 1   /* HLT or an illegal instruction */
+#define FLOW_RETURN 2 /* JR */
+#define FLOW_CALL 3   /* JAL */
+
+#define IN(set, v) ((set)[(v) >> 3] & (1 << ((v) & 7)))
+#define ADD(set, v) ((set)[(v) >> 3] |= 1 << ((v) & 7))
+
+typedef struct loop {
+    Uword header;
+    int depth;  /* 1: outermost */
+    int parent; /* -1: none */
+    long bound;
+    Uword body[IMEMORY_SIZE / 8];
+} Loop;
+
+typedef struct proc {
+    Uword entry;
+    int top;   /* the program itself, not a subroutine */
+    int busy;  /* being analyzed: a call to it is a recursion */
+    long value;
+    Uword member[IMEMORY_SIZE / 8];
+    int n_loops;
+    Loop loop[IMEMORY_SIZE];
+    short loop_of[IMEMORY_SIZE]; /* innermost loop around, or -1 */
+    short head_of[IMEMORY_SIZE]; /* loop of the header, or -1 */
+    long val[IMEMORY_SIZE][1 << WCET_MAX_DEPTH];
+    signed char choice[IMEMORY_SIZE][1 << WCET_MAX_DEPTH];
+} Proc;
+
+typedef struct wcet_ctx {
+    const Uword *mem;
+    const long *bounds;
+    int base_mode; /* BNK is illegal */
+    int error;
+    Proc *proc[IMEMORY_SIZE]; /* by entry */
+    Uword waits[IMEMORY_SIZE / 8];
+    Arena arena;
+} WcetCtx;
+
+static int flow(WcetCtx *, Uword, Uword *, int *, Uword *);
+static Proc *get_proc(WcetCtx *, Uword, int);
+static void search(WcetCtx *, Uword, Uword *, Uword *, Uword *);
+static int find_loops(WcetCtx *, Proc *, const Uword *);
+static long call(WcetCtx *, Uword);
+static long enter(WcetCtx *, Proc *, Uword, int, int);
+static long value(WcetCtx *, Proc *, Uword, int);
+static int back_edge(const Proc *, Uword, Uword, int *);
+static void print_enter(WcetCtx *, Proc *, Uword, int, int, FILE *);
+static void print_path(WcetCtx *, Proc *, Uword, int, FILE *);
+
+/*=============================================================================
+ *   Cycles of the Board
+ *===========================================================================*/
+/*
+ *   Phases (clock cycles) of the board: P0 and P1 fetch the instruction,
+ *   one more phase fetches the second word, and one more reads or writes
+ *   the memory operand.  OUT and IN take a phase for the I/O buffer.
+ */
+int inst_cycles(Uword IR) {
+    const Decoded *d = &decode_table[IR];
+
+    switch (d->format) {
+        case FMT_AB:
+            return d->opb < IMMEDIATE_ADDRESS          ? 3
+                 : d->opb < ABSOLUTE_PROGRAM_ADDRESS ? 4
+                                                       : 5;
+        case FMT_ADDR: /* BBC, JAL */
+            return 4;
+        default:
+            return (IR & 0xf0) == 0x10 ? 4 : 3;
+    }
+}
+
+/*=============================================================================
+ *   Analysis
+ *===========================================================================*/
+/*
+ *   Worst-case cycles from entry to HLT; the critical path is written to
+ *   fp.  Returns -1 if there is no bound.
+ */
+long wcet(const Cpub *cpub, Uword entry, const long *bounds, FILE *fp) {
+    WcetCtx x;
+    Proc *p;
+    long cycles;
+    int pc, l, n;
+
+    memset(&x, 0, sizeof(x));
+    x.mem = cpub->mem;
+    x.bounds = bounds;
+    x.base_mode = cpub->xmem == NULL;
+
+    if ((p = get_proc(&x, entry, 1)) == NULL) {
+        arena_destroy(&x.arena);
+        return -1;
+    }
+    cycles = enter(&x, p, entry, 0, 0);
+    if (x.error || cycles < 0) {
+        if (!x.error) fprintf(stderr, "No path from %02x reaches HLT\n", entry);
+        arena_destroy(&x.arena);
+        return -1;
+    }
+
+    fprintf(fp, "WCET: %ld cycles from %02x\n", cycles, entry);
+    fprintf(fp, "\tpath:");
+    print_enter(&x, p, entry, 0, 0, fp);
+    fprintf(fp, "\n");
+    for (pc = 0; pc < IMEMORY_SIZE; pc++) {
+        if ((p = x.proc[pc]) == NULL) continue;
+        if (!p->top) fprintf(fp, "\tsubroutine %02x: %ld cycles\n", pc,
+                             p->value);
+        for (l = 0; l < p->n_loops; l++)
+            fprintf(fp, "\tloop %02x: bound %ld\n", p->loop[l].header,
+                    p->loop[l].bound);
+    }
+    for (pc = 0, n = 0; pc < IMEMORY_SIZE; pc++) {
+        if (!IN(x.waits, pc)) continue;
+        fprintf(fp, n++ ? " %02x" : "\tI/O waits counted once: %02x", pc);
+    }
+    if (n) fprintf(fp, "\n");
+    arena_destroy(&x.arena);
+    return cycles;
+}
+
+/*
+ *   Successors of pc in its subroutine (a JAL goes on at its return
+ *   address; the target is *callee)
+ */
+static int flow(WcetCtx *x, Uword pc, Uword *succ, int *n_succ,
+                Uword *callee) {
+    const Uword IR = x->mem[pc];
+    const Decoded *d = &decode_table[IR];
+    const Uword NEXT = pc + d->length;
+    const Uword TO = x->mem[(Uword)(pc + 1)];
+
+    *n_succ = 0;
+    if (d->format == FMT_UNKNOWN || ((IR & 0xfc) | 0x03) == HLT ||
+        ((IR & 0xf0) == BNK && x->base_mode))
+        return FLOW_HALT;
+    if (IR == JR) return FLOW_RETURN;
+    if (IR == JAL) {
+        succ[(*n_succ)++] = NEXT;
+        *callee = TO;
+        return FLOW_CALL;
+    }
+    if ((IR & 0xf0) == BBC) {
+        if ((IR & 0x07) == 0x04 && TO == pc) { /* BNI/BNO to itself */
+            ADD(x->waits, pc);
+            succ[(*n_succ)++] = NEXT;
+            return FLOW_NEXT;
+        }
+        if ((IR & 0x0f) != 0x0) succ[(*n_succ)++] = NEXT; /* not BA */
+        if ((IR & 0x0f) != 0xd) succ[(*n_succ)++] = TO;   /* not BC */
+        return FLOW_NEXT;
+    }
+    succ[(*n_succ)++] = NEXT;
+    return FLOW_NEXT;
+}
+
+/*=============================================================================
+ *   Subroutines and Loops
+ *===========================================================================*/
+static Proc *get_proc(WcetCtx *x, Uword entry, int top) {
+    Uword visited[IMEMORY_SIZE / 8], on_stack[IMEMORY_SIZE / 8];
+    Uword back[IMEMORY_SIZE]; /* bit i: successor i is a back edge */
+    Proc *p;
+    int v, m;
+
+    if (x->proc[entry] != NULL) return x->proc[entry];
+    if ((p = arena_alloc(&x->arena, sizeof(Proc))) == NULL) {
+        fprintf(stderr, "Unable to allocate memory for the analysis\n");
+        x->error = 1;
+        return NULL;
+    }
+    p->entry = entry;
+    p->top = top;
+    p->busy = 0;
+    p->value = UNKNOWN;
+    memset(p->member, 0, sizeof(p->member));
+    for (v = 0; v < IMEMORY_SIZE; v++)
+        for (m = 0; m < 1 << WCET_MAX_DEPTH; m++) p->val[v][m] = UNKNOWN;
+
+    memset(visited, 0, sizeof(visited));
+    memset(on_stack, 0, sizeof(on_stack));
+    memset(back, 0, sizeof(back));
+    search(x, entry, visited, on_stack, back);
+    memcpy(p->member, visited, sizeof(visited));
+    if (find_loops(x, p, back) < 0) {
+        x->error = 1;
+        return NULL;
+    }
+    x->proc[entry] = p;
+    return p;
+}
+
+static void search(WcetCtx *x, Uword u, Uword *visited, Uword *on_stack,
+                   Uword *back) {
+    Uword succ[2], callee;
+    int n, i;
+
+    ADD(visited, u);
+    ADD(on_stack, u);
+    flow(x, u, succ, &n, &callee);
+    for (i = 0; i < n; i++) {
+        if (IN(on_stack, succ[i]))
+            back[u] |= 1 << i;
+        else if (!IN(visited, succ[i]))
+            search(x, succ[i], visited, on_stack, back);
+    }
+    on_stack[u >> 3] &= ~(1 << (u & 7));
+}
+
+/*
+ *   One loop for each header, with the nodes that reach one of its back
+ *   edges without passing the header.  If the entry is one of them, the
+ *   loop can be entered other than at its header.
+ */
+static int find_loops(WcetCtx *x, Proc *p, const Uword *back) {
+    Uword succ[2], callee, work[IMEMORY_SIZE], heads[IMEMORY_SIZE / 8];
+    int u, v, h, i, l, k, n, n_work;
+
+    p->n_loops = 0;
+    memset(heads, 0, sizeof(heads));
+    for (v = 0; v < IMEMORY_SIZE; v++) {
+        p->loop_of[v] = p->head_of[v] = -1;
+        flow(x, v, succ, &n, &callee);
+        for (i = 0; i < n; i++)
+            if (back[v] & (1 << i)) ADD(heads, succ[i]);
+    }
+
+    for (h = 0; h < IMEMORY_SIZE; h++) {
+        Loop *L;
+
+        if (!IN(heads, h)) continue;
+        L = &p->loop[p->n_loops];
+        L->header = h;
+        L->bound = x->bounds[h];
+        memset(L->body, 0, sizeof(L->body));
+        ADD(L->body, h);
+        p->head_of[h] = p->n_loops++;
+
+        /* the sources of the back edges, then their predecessors */
+        n_work = 0;
+        for (u = 0; u < IMEMORY_SIZE; u++) {
+            if (!back[u] || u == h) continue;
+            flow(x, u, succ, &n, &callee);
+            for (i = 0; i < n; i++)
+                if ((back[u] & (1 << i)) && succ[i] == h &&
+                    !IN(L->body, u)) {
+                    ADD(L->body, u);
+                    work[n_work++] = u;
+                }
+        }
+        while (n_work > 0) {
+            v = work[--n_work];
+            for (u = 0; u < IMEMORY_SIZE; u++) {
+                if (!IN(p->member, u) || IN(L->body, u)) continue;
+                flow(x, u, succ, &n, &callee);
+                for (i = 0; i < n; i++)
+                    if (succ[i] == v) {
+                        ADD(L->body, u);
+                        work[n_work++] = u;
+                        break;
+                    }
+            }
+        }
+        if (IN(L->body, p->entry) && h != p->entry) {
+            fprintf(stderr, "Loop at %02x is entered around its header "
+                            "(irreducible)\n",
+                    h);
+            return -1;
+        }
+    }
+
+    /* nesting */
+    for (l = 0; l < p->n_loops; l++) {
+        Loop *L = &p->loop[l];
+
+        L->depth = 1;
+        L->parent = -1;
+        for (k = 0; k < p->n_loops; k++)
+            if (k != l && IN(p->loop[k].body, L->header)) L->depth++;
+        if (L->depth > WCET_MAX_DEPTH) {
+            fprintf(stderr, "Loop at %02x is nested too deep\n", L->header);
+            return -1;
+        }
+        if (L->bound <= 0) {
+            fprintf(stderr, "Loop at %02x has no bound (l %02x n)\n",
+                    L->header, L->header);
+            x->error = 1;
+        }
+    }
+    for (l = 0; l < p->n_loops; l++)
+        for (k = 0; k < p->n_loops; k++)
+            if (IN(p->loop[k].body, p->loop[l].header) &&
+                p->loop[k].depth == p->loop[l].depth - 1)
+                p->loop[l].parent = k;
+    for (v = 0; v < IMEMORY_SIZE; v++)
+        for (l = 0; l < p->n_loops; l++)
+            if (IN(p->loop[l].body, v) &&
+                (p->loop_of[v] < 0 ||
+                 p->loop[l].depth > p->loop[p->loop_of[v]].depth))
+                p->loop_of[v] = l;
+    return x->error ? -1 : 0;
+}
+
+/*=============================================================================
+ *   Longest Path
+ *===========================================================================*/
+static int depth_of(const Proc *p, Uword v) {
+    return p->loop_of[v] < 0 ? 0 : p->loop[p->loop_of[v]].depth;
+}
+
+/*
+ *   Cycles of a subroutine from its entry to JR
+ */
+static long call(WcetCtx *x, Uword entry) {
+    Proc *p = get_proc(x, entry, 0);
+
+    if (p == NULL) return NO_PATH;
+    if (p->busy) {
+        fprintf(stderr, "Subroutine %02x is called recursively\n", entry);
+        x->error = 1;
+        return NO_PATH;
+    }
+    if (p->value == UNKNOWN) {
+        p->busy = 1;
+        p->value = enter(x, p, entry, 0, 0);
+        p->busy = 0;
+    }
+    return p->value;
+}
+
+/*
+ *   Cycles from s, where the depth of the loops around both the edge and s
+ *   is dc: s is either at that depth or the header of a loop one deeper
+ */
+static long enter(WcetCtx *x, Proc *p, Uword s, int m, int dc) {
+    long it, ex;
+
+    if (depth_of(p, s) == dc) return value(x, p, s, m);
+    it = value(x, p, s, m | 1 << dc);
+    ex = value(x, p, s, m);
+    if (ex < 0) return NO_PATH;
+    return it < 0 ? ex : (p->loop[p->head_of[s]].bound - 1) * it + ex;
+}
+
+/*
+ *   V(v, m)
+ */
+static long value(WcetCtx *x, Proc *p, Uword v, int m) {
+    Uword succ[2], callee;
+    long best = NO_PATH, e, sub = 0;
+    int n, i, dc, kind;
+
+    if (p->val[v][m] != UNKNOWN) return p->val[v][m];
+    p->choice[v][m] = -1;
+    kind = flow(x, v, succ, &n, &callee);
+
+    if (kind == FLOW_RETURN && p->top) {
+        fprintf(stderr, "JR at %02x is not in a subroutine\n", v);
+        x->error = 1;
+    } else if (kind == FLOW_HALT || kind == FLOW_RETURN) {
+        best = m == 0 ? inst_cycles(x->mem[v]) : NO_PATH;
+    } else if (kind != FLOW_CALL || (sub = call(x, callee)) >= 0) {
+        for (i = 0; i < n && !x->error; i++) {
+            if (back_edge(p, v, succ[i], &dc) >= 0)
+                e = m >> dc == 1 ? 0 : NO_PATH;
+            else
+                e = m >> dc ? NO_PATH : enter(x, p, succ[i], m, dc);
+            if (e > best) {
+                best = e;
+                p->choice[v][m] = i;
+            }
+        }
+        if (best >= 0) best += inst_cycles(x->mem[v]) + sub;
+    }
+    if (x->error) return NO_PATH;
+    return p->val[v][m] = best;
+}
+
+/*
+ *   If u -> s goes back to the header of a loop around u, returns that
+ *   loop and its level (depth - 1) in *dc.  Otherwise returns -1, and *dc
+ *   is the depth of the innermost loop around both u and s.
+ */
+static int back_edge(const Proc *p, Uword u, Uword s, int *dc) {
+    int l;
+
+    for (l = p->loop_of[u]; l >= 0; l = p->loop[l].parent) {
+        if (p->loop[l].header == s) {
+            *dc = p->loop[l].depth - 1;
+            return l;
+        }
+    }
+    for (l = p->loop_of[u]; l >= 0 && !IN(p->loop[l].body, s);
+         l = p->loop[l].parent)
+        ;
+    *dc = l < 0 ? 0 : p->loop[l].depth;
+    return -1;
+}
+
+/*=============================================================================
+ *   Critical Path
+ *===========================================================================*/
+/*
+ *   A loop is written as [iteration]xN before its last pass, and a call as
+ *   {subroutine} after the JAL
+ */
+static void print_enter(WcetCtx *x, Proc *p, Uword s, int m, int dc,
+                        FILE *fp) {
+    if (depth_of(p, s) > dc && p->val[s][m | 1 << dc] >= 0 &&
+        p->loop[p->head_of[s]].bound > 1) {
+        fprintf(fp, " [");
+        print_path(x, p, s, m | 1 << dc, fp);
+        fprintf(fp, " ]x%ld", p->loop[p->head_of[s]].bound - 1);
+    }
+    print_path(x, p, s, m, fp);
+}
+
+static void print_path(WcetCtx *x, Proc *p, Uword v, int m, FILE *fp) {
+    Uword succ[2], callee;
+    int n, dc, i;
+
+    for (;;) {
+        fprintf(fp, " %02x", v);
+        if (flow(x, v, succ, &n, &callee) == FLOW_CALL) {
+            fprintf(fp, " {");
+            print_enter(x, x->proc[callee], callee, 0, 0, fp);
+            fprintf(fp, " }");
+        }
+        if ((i = p->choice[v][m]) < 0) return;
+        if (back_edge(p, v, succ[i], &dc) >= 0) return;
+        if (depth_of(p, succ[i]) > dc) {
+            print_enter(x, p, succ[i], m, dc, fp);
+            return;
+        }
+        v = succ[i];
+    }
+}
+
+/*=============================================================================
+ *   Measurement
+ *===========================================================================*/
+/*
+ *   Cycles of a run of a copy of the board, fed with the inputs as
+ *   run_script() does.  *halted is set if the run ends before max_steps.
+ */
+long wcet_measure(const Cpub *cpub, const Uword *in, int n_in,
+                  long max_steps, int *halted) {
+    Cpub c = *cpub;
+    IOBuf ibuf = *cpub->ibuf;
+    long cycles = 0, n;
+    int in_pos = 0;
+
+    c.ibuf = &ibuf;
+    c.watch = NULL;
+    c.mmio = NULL;
+    *halted = 0;
+    for (n = 0; n < max_steps; n++) {
+        if (!ibuf.flag && in_pos < n_in) {
+            ibuf.buf = in[in_pos++];
+            ibuf.flag = 1;
+        }
+        cycles += inst_cycles(c.mem[c.pc]);
+        if (step(&c) == RUN_HALT) {
+            *halted = 1;
+            break;
+        }
+        c.obuf.flag = 0;
+    }
+    return cycles;
+}
@@ -0,0 +1,33 @@
+/*
+ *	Project-based Learning II (CPU)
+ *
+ *	Program:	instruction set simulator of the Educational CPU Board
+ *	File Name:	wcet.h
+ *	Descrioption:	static worst-case execution time of a program
+ */
+
+#ifndef WCET_H
+#define WCET_H
+
+#include <stdio.h>
+
+#include "cpuboard.h"
+
+/*=============================================================================
+ *   Cycles of the Board
+ *===========================================================================*/
+int inst_cycles(Uword);
+
+/*=============================================================================
+ *   Analysis
+ *===========================================================================*/
+#define WCET_MAX_DEPTH 6 /* loops nested in a subroutine */
+
+/*
+ *   bounds[h] is the most times the header h of a loop runs each time the
+ *   loop is entered (0: no bound given)
+ */
+long wcet(const Cpub *, Uword, const long *, FILE *);
+long wcet_measure(const Cpub *, const Uword *, int, long, int *);
+
+#endif /* WCET_H */